@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Region allocator.
+ *
+ * Allocations are carved from the current block, a new block is started
+ * when it runs out.  Requests larger than a quarter block get a block of
+ * their own, which is put behind the current block so the space left in
+ * it is not wasted.  Nothing is freed individually.
+ */
+
+#include "arena.h"
+#include "util.h"
+#include <stdlib.h>
+
+#define ARENA_BLOCKSIZE 8192
+/* alignment of all allocations */
+#define ARENA_ALIGN sizeof(union arenaAlign)
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+union arenaAlign {
+	long l;
+	double d;
+	void *p;
+};
+
+struct arenaBlock {
+	arenaBlock_t *next;
+	size_t size;		/* usable bytes */
+	size_t used;
+};
+
+/* start of usable memory of block */
+#define ARENA_DATA(bp) ((char *)(bp) + ARENA_ROUND(sizeof(arenaBlock_t)))
+
+static arenaBlock_t *newBlock(size_t size);
+
+arena_t *
+arenaNew(size_t blockSize)
+{
+	arena_t *ap = (arena_t *)myMalloc(sizeof(arena_t));
+
+	ap->head = NULL;
+	ap->blockSize = blockSize ? blockSize : ARENA_BLOCKSIZE;
+	ap->allocated = 0;
+	return ap;
+}
+
+void *
+arenaAlloc(arena_t *ap, size_t size)
+{
+	arenaBlock_t *bp = ap->head;
+
+	size = ARENA_ROUND(size ? size : 1);
+	ap->allocated += size;
+	if (!bp || bp->size - bp->used < size) {
+		if (size > ap->blockSize / 4) {
+			bp = newBlock(size);
+			bp->used = size;
+			if (ap->head) {
+				bp->next = ap->head->next;
+				ap->head->next = bp;
+			} else
+				ap->head = bp;
+			return ARENA_DATA(bp);
+		}
+		bp = newBlock(ap->blockSize);
+		bp->next = ap->head;
+		ap->head = bp;
+	}
+	bp->used += size;
+	return ARENA_DATA(bp) + bp->used - size;
+}
+
+/*
+ * Give back all allocations.  One block is kept for reuse.
+ */
+void
+arenaReset(arena_t *ap)
+{
+	arenaBlock_t *bp = ap->head, *keep = NULL;
+
+	while (bp) {
+		arenaBlock_t *next = bp->next;
+
+		if (!keep && bp->size == ap->blockSize) {
+			keep = bp;
+			keep->used = 0;
+			keep->next = NULL;
+		} else
+			free(bp);
+		bp = next;
+	}
+	ap->head = keep;
+}
+
+void
+arenaFree(arena_t *ap)
+{
+	if (!ap)
+		return;
+	arenaReset(ap);
+	free(ap->head);
+	free(ap);
+}
+
+static arenaBlock_t *
+newBlock(size_t size)
+{
+	arenaBlock_t *bp = (arenaBlock_t *)myMalloc(ARENA_ROUND(sizeof(arenaBlock_t)) + size);
+
+	bp->next = NULL;
+	bp->size = size;
+	bp->used = 0;
+	return bp;
+}
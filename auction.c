@@ -29,11 +29,21 @@
 
 #include "util.h"
 #include "auction.h"
+#include "bidlog.h"
 #include "buffer.h"
+#include "capture.h"
+#include "daemon.h"
+#include "governor.h"
 #include "http.h"
+#include "journal.h"
+#include "metrics.h"
+#include "retry.h"
+#include "status.h"
+#include "trace.h"
 #include "html.h"
 #include "history.h"
 #include <ctype.h>
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,6 +55,8 @@
 #	define sleep(t) _sleep((t) * 1000)
 #	define strncasecmp(s1, s2, len) strnicmp((s1), (s2), (len))
 #else
+#	include <dirent.h>
+#	include <sys/stat.h>
 #	include <unistd.h>
 #endif
 
@@ -56,6 +68,9 @@
 
 #define TOKEN_FOUND_ALL (TOKEN_FOUND_UIID | TOKEN_FOUND_STOK | TOKEN_FOUND_SRT)
 
+/* upper limit for pages of a My eBay list to follow */
+#define MYITEMS_MAX_PAGES 50
+
 typedef struct _headerattr
 {
   char* name;
@@ -70,6 +85,19 @@ typedef enum searchType { st_attribute, st_value } searchType_t;
 static time_t loginTime = 0;	/* Time of last login */
 static time_t defaultLoginInterval = 12 * 60 * 60;	/* ebay login interval */
 
+/* item on the watch list, see watchListScan() */
+typedef struct {
+	char *auction;
+	char *title;
+} watchItem_t;
+
+/* page of the watch list, as parsed on the last scan */
+typedef struct {
+	char *url;
+	watchItem_t *items;
+	int numItems;
+} watchPage_t;
+
 static int acceptBid(const char *pagename, auctionInfo *aip);
 static int bid(auctionInfo *aip);
 static int ebayLogin(auctionInfo *aip, time_t interval);
@@ -85,6 +113,16 @@ static int parseBid(memBuf_t *mp, auctionInfo *aip);
 static int preBid(auctionInfo *aip);
 static int parsePreBid(memBuf_t *mp, auctionInfo *aip);
 static int printMyItemsRow(char **row, int printNewline);
+static char *myItemsNumber(const char *cell);
+static char *myItemsNextPage(memBuf_t *mp);
+static int refreshRow(char **row, auctionInfo **aips, int num, int *refreshed, time_t start);
+static void watchListAdd(auctionInfo *aip);
+static void wonAuction(auctionInfo *aip, int won);
+static int scanOutcomeList(const char *urlFormat, auctionInfo **aips, int num, int *outcome, int value);
+static int scanOutcomes(auctionInfo **aips, int num, int *outcome, time_t before);
+static int compareWatchItems(const void *p1, const void *p2);
+static void parseWatchPage(memBuf_t *mp, watchPage_t *pp);
+static void freeWatchItems(watchItem_t *items, int num);
 static int signinFormSearch(char* src, size_t srcLen, headerAttr_t* searchdef, searchType_t searchfor);
 static int watch(auctionInfo *aip);
 
@@ -125,10 +163,12 @@ static const char SRCID2[] = "id:\"";
 
 /*
  * Get page info, including pagename variable, page id and srcid comments.
+ * The page info is allocated from the scratch arena of the page.
  */
 pageInfo_t *
 getPageInfo(memBuf_t *mp)
 {
+	arena_t *ap = memArena(mp);
 	const char *line;
 	pageInfo_t p = {NULL, NULL, NULL}, *pp;
 	int needPageName = 1;
@@ -145,14 +185,14 @@ getPageInfo(memBuf_t *mp)
 		if (!strcasecmp(line, "title") ||
                     !strcasecmp(line, "h1 class=\"page-title__main\"")) {
 		    line = getNonTag(mp);
-		    if (line) title = myStrdup(line);
+		    if (line) title = myStrdupIn(ap, line);
 		    continue;
 		}
         if (0 == strncmp(line, "script", 6)) {
             char *line2 = getNonTag(mp);
             char *end;
             if (needPageId && (tmp = strstr(line2, PAGEID2))) {
-                p.pageId = myStrdup(tmp + strlen(PAGEID2));
+                p.pageId = myStrdupIn(ap, tmp + strlen(PAGEID2));
                 end = strchr(p.pageId, ',');
                 if (*end) {
                     *end = '\0';
@@ -161,7 +201,7 @@ getPageInfo(memBuf_t *mp)
                 --needPageId;
             }
             if (needSrcId && (tmp = strstr(line2, SRCID2))) {
-                p.srcId = myStrdup(tmp + strlen(SRCID2));
+                p.srcId = myStrdupIn(ap, tmp + strlen(SRCID2));
                 end = strchr(p.srcId, '"');
                 if (*end) {
                     *end = '\0';
@@ -175,7 +215,7 @@ getPageInfo(memBuf_t *mp)
             char *line2 = getNonTag(mp);
             --needMore;
             --needPageName;
-            p.pageName = myStrdup(line2);
+            p.pageName = myStrdupIn(ap, line2);
             continue;
 
 		} else if (strncmp(line, "!--", 3)) {
@@ -186,19 +226,19 @@ getPageInfo(memBuf_t *mp)
 			if ((tmp = getPageNameInternal(tmp))) {
 				--needMore;
 				--needPageName;
-				p.pageName = myStrdup(tmp);
+				p.pageName = myStrdupIn(ap, tmp);
 			}
 		} else if (needPageId && (tmp = strstr(line, PAGEID))) {
 			if ((tmp = getIdInternal(tmp, sizeof(PAGEID)))) {
 				--needMore;
 				--needPageId;
-				p.pageId = myStrdup(tmp);
+				p.pageId = myStrdupIn(ap, tmp);
 			}
 		} else if (needSrcId && (tmp = strstr(line, SRCID))) {
 			if ((tmp = getIdInternal(tmp, sizeof(SRCID)))) {
 				--needMore;
 				--needSrcId;
-				p.srcId = myStrdup(tmp);
+				p.srcId = myStrdupIn(ap, tmp);
 			}
 		}
 	}
@@ -209,13 +249,12 @@ getPageInfo(memBuf_t *mp)
 	   --needMore;
 	   title = NULL;
 	}
-	if (title) free(title);
 	log(("getPageInfo(): pageName = %s, pageId = %s, srcId = %s\n", nullStr(p.pageName), nullStr(p.pageId), nullStr(p.srcId)));
 	memReset(mp);
 	if (needMore == 3) {
 		return NULL;
 	}
-	pp = (pageInfo_t *)myMalloc(sizeof(pageInfo_t));
+	pp = (pageInfo_t *)arenaAlloc(ap, sizeof(pageInfo_t));
 	pp->pageName = p.pageName;
 	pp->pageId = p.pageId;
 	pp->srcId = p.srcId;
@@ -237,20 +276,6 @@ getIdInternal(char *s, size_t len)
 	return id;
 }
 
-/*
- * Free a pageInfo_t and it's internal members.
- */
-void
-freePageInfo(pageInfo_t *pp)
-{
-	if (pp) {
-		free(pp->pageName);
-		free(pp->pageId);
-		free(pp->srcId);
-		free(pp);
-	}
-}
-
 /*
  * Calculate quantity to bid on.  If it is a dutch auction, never
  * bid on more than 1 less item than what is available.
@@ -290,38 +315,56 @@ getInfo(auctionInfo *aip)
 static int
 getInfoTiming(auctionInfo *aip, time_t *timeToFirstByte)
 {
-	int i, ret;
+	int ret;
 	time_t start;
+	retry_t retry;
 
 	log(("\n\n*** getInfo auction %s price %s user %s\n", aip->auction, aip->bidPriceStr, options.username));
-	if (ebayLogin(aip, 0))
+	traceBegin(te_getInfo, aip->auction);
+	if (ebayLogin(aip, 0)) {
+		traceEnd(te_getInfo);
 		return 1;
+	}
 
-	for (i = 0; i < 3; ++i) {
+	retryInit(&retry, rr_getInfo);
+	for (;;) {
 		memBuf_t *mp = NULL;
+		enum retryAction action;
 
 		if (!aip->query) {
 			size_t urlLen = sizeof(HISTORY_URL) + strlen(options.historyHost) + strlen(aip->auction) - (2*2);
 
-			aip->query = (char *)myMalloc(urlLen);
+			aip->query = (char *)myMallocIn(aip->arena, urlLen);
 			sprintf(aip->query, HISTORY_URL, options.historyHost, aip->auction);
 		}
 		start = time(NULL);
-		if (!(mp = httpGet(aip->query, NULL))) {
+		governorAcquire(gp_getInfo);
+		if (!(mp = httpGetCond(aip->query, NULL)))
+			ret = httpError(aip);
+		else {
+			/* time left on a cached page counts from its fetch */
+			if (mp->timing.notModified && mp->timing.fetched)
+				start = mp->timing.fetched;
+			traceBegin(te_parse, NULL);
+			ret = parseBidHistory(mp, aip, start, timeToFirstByte, 0);
+			traceEnd(te_parse);
 			freeMembuf(mp);
-			return httpError(aip);
 		}
-		ret = parseBidHistory(mp, aip, start, timeToFirstByte, 0);
-		freeMembuf(mp);
-		if (i == 0 && ret == 1 && aip->auctionError == ae_mustsignin) {
+		if (ret == 0)
+			break;
+		action = retryNext(&retry, aip);
+		if (action == ra_login) {
 			if (forceEbayLogin(aip))
 				break;
-		} else if (aip->auctionError == ae_notime)
-			/* Blank time remaining -- give it another chance */
-			sleep(2);
+		} else if (action == ra_retry)
+			retryWait(&retry);
 		else
 			break;
 	}
+	if (ret == 0)
+		journalInfo(aip);
+	statusUpdate(aip);
+	traceEnd(te_getInfo);
 	return ret;
 }
 
@@ -346,20 +389,29 @@ preBid(auctionInfo *aip)
 	char *url;
 	int ret = 0;
 
-	if (ebayLogin(aip, 0))
+	traceBegin(te_preBid, aip->auction);
+	if (ebayLogin(aip, 0)) {
+		traceEnd(te_preBid);
 		return 1;
+	}
 	sprintf(quantityStr, "%d", quantity);
 	urlLen = sizeof(PRE_BID_URL) + strlen(options.prebidHost) + strlen(aip->auction) + strlen(aip->bidPriceStr) + strlen(quantityStr) - (4*2);
 	url = (char *)myMalloc(urlLen);
 	sprintf(url, PRE_BID_URL, options.prebidHost, aip->auction, aip->bidPriceStr, quantityStr);
 	log(("\n\n*** preBid(): url is %s\n", url));
+	governorAcquire(gp_preBid);
 	mp = httpGet(url, NULL);
 	free(url);
-	if (!mp)
+	if (!mp) {
+		traceEnd(te_preBid);
 		return httpError(aip);
+	}
 
+	traceBegin(te_parse, NULL);
 	ret = parsePreBid(mp, aip);
+	traceEnd(te_parse);
 	freeMembuf(mp);
+	traceEnd(te_preBid);
 	return ret;
 }
 
@@ -380,9 +432,8 @@ parsePreBid(memBuf_t *mp, auctionInfo *aip)
 
 		if (!value || !end || value > end)
 			continue;
-		free(aip->biduiid);
 		mp->readptr = value + 7;
-		aip->biduiid = myStrdup(getUntil(mp, '\"'));
+		aip->biduiid = auctionString(aip, aip->biduiid, getUntil(mp, '\"'));
 		log(("preBid(): biduiid is \"%s\"", aip->biduiid));
 		found |= TOKEN_FOUND_UIID;
 		break;
@@ -399,9 +450,8 @@ parsePreBid(memBuf_t *mp, auctionInfo *aip)
 
 		if (!value || !end || value > end)
 			continue;
-		free(aip->bidstok);
 		mp->readptr = value + 7;
-		aip->bidstok = myStrdup(getUntil(mp, '\"'));
+		aip->bidstok = auctionString(aip, aip->bidstok, getUntil(mp, '\"'));
 		log(("preBid(): bidstok is \"%s\"", aip->bidstok));
 		found |= TOKEN_FOUND_STOK;
 		break;
@@ -418,9 +468,8 @@ parsePreBid(memBuf_t *mp, auctionInfo *aip)
 
 		if (!value || !end || value > end)
 			continue;
-		free(aip->bidsrt);
 		mp->readptr = value + 7;
-		aip->bidsrt = myStrdup(getUntil(mp, '\"'));
+		aip->bidsrt = auctionString(aip, aip->bidsrt, getUntil(mp, '\"'));
 		log(("preBid(): bidsrt is \"%s\"", aip->bidsrt));
 		found |= TOKEN_FOUND_SRT;
 		break;
@@ -434,7 +483,6 @@ parsePreBid(memBuf_t *mp, auctionInfo *aip)
 			ret = auctionError(aip, ae_bidtokens, NULL);
 			bugReport("preBid", __FILE__, __LINE__, aip, mp, optiontab, "cannot find bid token (found=%d)", found);
 		}
-		freePageInfo(pageInfo);
 	}
 	return ret;
 }
@@ -567,17 +615,22 @@ ebayLogin(auctionInfo *aip, time_t interval)
 			return 0;
 	}
 
-	cleanupCurlStuff();
-	if (initCurlStuff())
+	traceBegin(te_login, aip ? aip->auction : NULL);
+	if (httpResetSession()) {
+		traceEnd(te_login);
 		return auctionError(aip, ae_unknown, NULL);
+	}
 
 	urlLen = sizeof(LOGIN_1_URL) + strlen(options.loginHost) - (1*2);
 	url = (char *)myMalloc(urlLen);
 	sprintf(url, LOGIN_1_URL, options.loginHost);
+	governorAcquire(gp_preBid);
 	mp = httpGet(url, NULL);
 	free(url);
-	if (!mp)
+	if (!mp) {
+		traceEnd(te_login);
 		return httpError(aip);
+	}
 
 	// Get all atrributes and values needed
 	for(i = 0; i < sizeof(headerAttrs)/sizeof(headerAttr_t); i++)
@@ -648,6 +701,7 @@ ebayLogin(auctionInfo *aip, time_t interval)
 
 	// Using POST method instead of GET
 	log(("HTTP POST login: %s", url));
+	governorAcquire(gp_preBid);
 	mp = httpPost(url, data, logdata);
 
 	// Free memory
@@ -657,8 +711,10 @@ ebayLogin(auctionInfo *aip, time_t interval)
 	free(data);
 	free(logdata);
 
-	if (!mp)
+	if (!mp) {
+		traceEnd(te_login);
 		return httpError(aip);
+	}
 
 	if ((pp = getPageInfo(mp))) {
 		log(("ebayLogin(): pagename = \"%s\", pageid = \"%s\", srcid = \"%s\"", nullStr(pp->pageName), nullStr(pp->pageId), nullStr(pp->srcId)));
@@ -700,7 +756,7 @@ ebayLogin(auctionInfo *aip, time_t interval)
 		bugReport("ebayLogin", __FILE__, __LINE__, aip, mp, optiontab, "pageinfo is NULL");
 	}
 	freeMembuf(mp);
-	freePageInfo(pp);
+	traceEnd(te_login);
 	return ret;
 }
 
@@ -840,7 +896,6 @@ parseBid(memBuf_t *mp, auctionInfo *aip)
 		printLog(stdout, "Cannot determine result of bid\n");
 		ret = 0;	/* prevent another bid */
 	}
-	freePageInfo(pageInfo);
 	return ret;
 } /* parseBid() */
 
@@ -866,8 +921,11 @@ bid(auctionInfo *aip)
 	if (!aip->biduiid || !aip->bidstok || !aip->bidsrt)
 		return auctionError(aip, ae_bidtokens, NULL);
 
-	if (ebayLogin(aip, 0))
+	traceBegin(te_bid, aip->auction);
+	if (ebayLogin(aip, 0)) {
+		traceEnd(te_bid);
 		return 1;
+	}
 	sprintf(quantityStr, "%d", quantity);
 
 	/* create url */
@@ -890,11 +948,24 @@ bid(auctionInfo *aip)
 		printLog(stdout, "Bidding disabled\n");
 		log(("\n\nbid(): query url:\n%s\n", logUrl));
 		ret = aip->bidResult = 0;
-	} else if (!(mp = httpGet(url, logUrl))) {
-		ret = httpError(aip);
 	} else {
-		ret = parseBid(mp, aip);
+		if (options.bidtime > 0)
+			metricsBidTime(aip->endTime - aip->latency -
+				       options.bidtime);
+		metricsCount(mc_bid, 1);
+		governorAcquire(gp_bid);
+		if (!(mp = httpGet(url, logUrl)))
+			ret = httpError(aip);
+		else {
+			traceBegin(te_parse, NULL);
+			ret = parseBid(mp, aip);
+			traceEnd(te_parse);
+		}
 	}
+	traceEnd(te_bid);
+	if (ret == 0)
+		journalBid(aip);
+	statusUpdate(aip);
 	free(url);
 	free(logUrl);
 	freeMembuf(mp);
@@ -911,9 +982,13 @@ bid(auctionInfo *aip)
 static int
 watch(auctionInfo *aip)
 {
-	int errorCount = 0;
 	long remain = LONG_MIN;
 	unsigned int sleepTime = 0;
+	double lastFirstByte = 0.0;	/* of previous poll */
+	long bytesSaved = 0;		/* by compression and caching */
+	retry_t pollRetry;
+
+	retryInit(&pollRetry, rr_watch);
 
 	log(("*** WATCHING auction %s price-each %s quantity %d bidtime %ld\n", aip->auction, aip->bidPriceStr, options.quantity, options.bidtime));
 
@@ -923,57 +998,86 @@ watch(auctionInfo *aip)
 		time_t timeToFirstByte = 0;
 		int ret = getInfoTiming(aip, &timeToFirstByte);
 		time_t end = time(NULL);
-
-		if (timeToFirstByte == 0)
-			timeToFirstByte = end;
-		tmpLatency = (timeToFirstByte - start);
+		const httpTiming_t *tp = httpLastTiming();
+
+		/* prefer libcurl's time to first byte of the info request,
+		 * it is not disturbed by login or retries */
+		if (tp->total > 0) {
+			bytesSaved += tp->bodySize - tp->bytesReceived;
+			log(("poll: %ld bytes received for %ld byte page%s, "
+			     "first byte %.3fs (%+.3fs), %ld bytes saved so far\n",
+			     tp->bytesReceived, tp->bodySize,
+			     tp->notModified ? " (not modified)" : "",
+			     tp->starttransfer,
+			     lastFirstByte > 0 ? tp->starttransfer - lastFirstByte : 0.0,
+			     bytesSaved));
+			lastFirstByte = tp->starttransfer;
+		}
+		if (tp->starttransfer > 0)
+			tmpLatency = (time_t)(tp->starttransfer + 0.5);
+		else {
+			if (timeToFirstByte == 0)
+				timeToFirstByte = end;
+			tmpLatency = (timeToFirstByte - start);
+		}
 		if ((tmpLatency >= 0) && (tmpLatency < 600))
 			aip->latency = tmpLatency;
 		printLog(stdout, "Latency: %d seconds\n", aip->latency);
+		if (bidLogCount(aip) > 1) {
+			log(("bid log: %d bids, %.2f bids/minute in the last hour, "
+			     "largest competitor increment %.2f\n",
+			     bidLogCount(aip), bidLogRate(aip, 3600),
+			     bidLogMaxIncrement(aip, options.username)));
+		}
 
 		if (ret) {
 			printAuctionError(aip, stderr);
 
-			/*
-			 * Fatal error?  We allow up to 50 errors, then quit.
-			 * eBay "unavailable" doesn't count towards the total.
-			 */
-			if (aip->auctionError == ae_unavailable) {
-				if (remain >= 0)
-					remain = newRemain(aip);
-				if (remain == LONG_MIN || remain > 86400) {
-					/* typical eBay maintenance period
-					 * is two hours.  Sleep for half that
-					 * amount of time.
-					 */
-					printLog(stdout, "%s: Will try again, sleeping for an hour\n", timestamp());
-					sleepTime = 3600;
-					sleep(sleepTime);
-					continue;
-				}
-			} else if (remain == LONG_MIN) {
-				/* first time through?  Give it 3 chances then
-				 * make the error fatal.
+			if (remain == LONG_MIN &&
+			    aip->auctionError != ae_unavailable) {
+				/* first time through?  Give it a few chances
+				 * then make the error fatal.
 				 */
-				int j;
+				retry_t firstRetry;
 
-				for (j = 0; ret && j < 3 && aip->auctionError == ae_notitle; ++j)
+				retryInit(&firstRetry, rr_firstInfo);
+				while (ret &&
+				       retryNext(&firstRetry, aip) == ra_retry) {
+					retryWait(&firstRetry);
 					ret = getInfo(aip);
+				}
 				if (ret)
 					return 1;
 				remain = newRemain(aip);
 			} else {
-				/* non-fatal error */
-				log(("ERROR %d!!!\n", ++errorCount));
-				if (errorCount > 50)
+				/*
+				 * Fatal error?  The policy allows up to 50
+				 * errors, then we quit.  eBay "unavailable"
+				 * doesn't count towards the total.
+				 */
+				switch (retryNext(&pollRetry, aip)) {
+				case ra_retry:
+					if (aip->auctionError != ae_unavailable)
+						printLog(stdout, "Cannot find auction - internet or eBay problem?\nWill try again after sleep.\n");
+					retryWait(&pollRetry);
+					continue;
+				case ra_fail:
 					return auctionError(aip, ae_toomany, NULL);
-				printLog(stdout, "Cannot find auction - internet or eBay problem?\nWill try again after sleep.\n");
-				remain = newRemain(aip);
+				default:
+					/* no time to try again before bid */
+					if (remain != LONG_MIN)
+						remain = newRemain(aip);
+					break;
+				}
 			}
 		} else if (!isValidBidPrice(aip))
 			return auctionError(aip, ae_bidprice, NULL);
-		else
+		else {
 			remain = newRemain(aip);
+			governorDeadline(time(NULL) + remain);
+			/* the error limit is for errors in a row */
+			retryInit(&pollRetry, rr_watch);
+		}
 
 		/*
 		 * Check login when we are close to bidding.
@@ -988,19 +1092,19 @@ watch(auctionInfo *aip)
 		 * if we're less than two minutes away, get bid key
 		 */
 		if (remain <= 150 && !aip->biduiid && aip->auctionError == ae_none) {
-			int i;
+			retry_t keyRetry;
 
 			printf("\n");
-			for (i = 0; i < 5; ++i) {
-				/* ae_bidtokens is used when the page loaded
-				 * but failed for some unknown reason.
-				 * Do not try again in this situation.
-				 */
-				if (!preBid(aip) ||
-				    aip->auctionError == ae_bidtokens)
-					break;
-				if (aip->auctionError == ae_mustsignin &&
-				    forceEbayLogin(aip))
+			retryInit(&keyRetry, rr_preBid);
+			while (preBid(aip)) {
+				enum retryAction action = retryNext(&keyRetry, aip);
+
+				if (action == ra_login) {
+					if (forceEbayLogin(aip))
+						break;
+				} else if (action == ra_retry)
+					retryWait(&keyRetry);
+				else
 					break;
 			}
 			if (aip->auctionError != ae_none &&
@@ -1044,7 +1148,7 @@ watch(auctionInfo *aip)
 				sleepTime/60, sleepTime % 60);
 		else
 			printLog(stdout, "Sleeping for %ld seconds\n", sleepTime);
-		sleep(sleepTime);
+		daemonSleep(sleepTime);
 		printf("\n");
 
 		if ((remain=newRemain(aip)) <= 0)
@@ -1063,6 +1167,8 @@ int
 snipeAuction(auctionInfo *aip)
 {
 	char *tmpUsername;
+	int ret;
+	time_t deadline;
 
 	if (!aip)
 		return 0;
@@ -1081,8 +1187,14 @@ snipeAuction(auctionInfo *aip)
 		return 0;
 	}
 
+	/* a captcha pause must not hold up polls past the bid */
+	deadline = governorDeadline(aip->endTime ?
+		aip->endTime - aip->latency - options.bidtime : 0);
 	/* 0 means "now" */
-	if ((options.bidtime == 0) ? preBid(aip) : watch(aip)) {
+	ret = (options.bidtime == 0) ? preBid(aip) : watch(aip);
+	/* the caller's deadline, e.g. the daemon's next bid */
+	governorDeadline(deadline);
+	if (ret) {
 		printAuctionError(aip, stderr);
 		if (aip->auctionError != ae_highbidder)
 			return 0;
@@ -1096,18 +1208,23 @@ snipeAuction(auctionInfo *aip)
 	}
 
 	if (aip->auctionError != ae_highbidder) {
+		retry_t bidRetry;
+
 		printLog(stdout, "\nAuction %s: Bidding...\n", aip->auction);
-		for (;;) {
-			if (bid(aip)) {
-				/* failed bid */
-				if (aip->auctionError == ae_mustsignin) {
-					if (!forceEbayLogin(aip))
-						continue;
-				}
-				printAuctionError(aip, stderr);
-				return 0;
+		retryInit(&bidRetry, rr_bid);
+		while (bid(aip)) {
+			/* failed bid */
+			enum retryAction action = retryNext(&bidRetry, aip);
+
+			if (action == ra_login) {
+				if (!forceEbayLogin(aip))
+					continue;
+			} else if (action == ra_retry) {
+				retryWait(&bidRetry);
+				continue;
 			}
-			break;
+			printAuctionError(aip, stderr);
+			return 0;
 		}
 	}
     return 0;
@@ -1135,8 +1252,8 @@ checkWonAuction(auctionInfo *aip)
 				seconds = 0;
 			/* extra 2 seconds to make sure auction is over */
 			seconds += 2;
-			printLog(stdout, "Auction %s: Waiting %d seconds for auction to complete...\n", aip->auction, seconds);
-			sleep((unsigned int)seconds);
+			printLog(stdout, "Auction %s: Waiting %d seconds for auction to complete...\n", aip->auction, (int)seconds);
+			daemonSleep((unsigned int)seconds);
 		}
 
 		printLog(stdout, "\nAuction %s: Post-bid info:\n",
@@ -1157,7 +1274,184 @@ checkWonAuction(auctionInfo *aip)
 		won = aip->won;
 		printLog(stdout, "\nwon %d item(s)\n", won);
 	}
+	wonAuction(aip, won);
+	return won;
+}
+
+/*
+ * Record outcome of auction.
+ */
+static void
+wonAuction(auctionInfo *aip, int won)
+{
+	journalWon(aip, won);
+	statusWon(aip, won);
+	metricsCount(mc_won, won);
 	options.quantity -= won;
+	metricsGauge(mg_quantity, options.quantity);
+}
+
+static const char WON_URL[] = "http://%s/ws/eBayISAPI.dll?MyeBay&CurrentPage=MyeBayWon";
+static const char DIDNTWIN_URL[] = "http://%s/ws/eBayISAPI.dll?MyeBay&CurrentPage=MyeBayDidntWin";
+/* the lists may lag behind the end of an auction */
+#define OUTCOME_TRIES 3
+#define OUTCOME_WAIT 30
+
+/*
+ * Look for auctions on a My eBay won or didn't win list, and set
+ * outcome[i] to value for each auction found that has no outcome yet.
+ *
+ * returns: number of auctions found, -1 on error
+ */
+static int
+scanOutcomeList(const char *urlFormat, auctionInfo **aips, int num, int *outcome, int value)
+{
+	char *url;
+	int i, count = 0, pages = 0;
+
+	url = (char *)myMalloc(strlen(urlFormat) + strlen(options.myeBayHost));
+	sprintf(url, urlFormat, options.myeBayHost);
+	while (url && pages++ < MYITEMS_MAX_PAGES) {
+		memBuf_t *mp;
+		const char *table;
+		char **row;
+
+		governorAcquire(gp_myItems);
+		mp = httpGet(url, NULL);
+		free(url);
+		if (!mp)
+			return -1;
+		while ((table = getTableStart(mp))) {
+			if (!strstr(table, "class=\"my_itl-iT\""))
+				continue;
+			/* skip first descriptive table row */
+			if (!getTableRow(mp))
+				break;
+			while ((row = getTableRow(mp))) {
+				char *item = row[0] ? myItemsNumber(row[0]) : NULL;
+
+				if (!item)
+					continue;
+				for (i = 0; i < num; ++i) {
+					if (outcome[i] < 0 &&
+					    !strcmp(aips[i]->auction, item)) {
+						outcome[i] = value;
+						++count;
+					}
+				}
+				free(item);
+			}
+		}
+		url = myItemsNextPage(mp);
+		freeMembuf(mp);
+	}
+	free(url);
+	return count;
+}
+
+/*
+ * Look for auctions on the won and didn't win lists until all are found,
+ * OUTCOME_TRIES times, or until another try would not be done before
+ * before (0 = no limit).
+ *
+ * returns: number of auctions found, -1 on error
+ */
+static int
+scanOutcomes(auctionInfo **aips, int num, int *outcome, time_t before)
+{
+	int tries, found = 0;
+
+	for (tries = 1; ; ++tries) {
+		int n = scanOutcomeList(WON_URL, aips, num, outcome, 1);
+
+		if (n >= 0 && found + n < num) {
+			int lost = scanOutcomeList(DIDNTWIN_URL, aips, num, outcome, 0);
+
+			n = lost < 0 ? lost : n + lost;
+		}
+		if (n < 0)
+			return found ? found : -1;
+		found += n;
+		if (found == num || tries >= OUTCOME_TRIES ||
+		    (before && time(NULL) + 2 * OUTCOME_WAIT >= before))
+			return found;
+		printLog(stdout, "%d of %d auctions not on My eBay lists yet, looking again in %d seconds\n",
+			 num - found, num, OUTCOME_WAIT);
+		daemonSleep(OUTCOME_WAIT);
+	}
+}
+
+/*
+ * checkWonAuctions(): check outcome of several ended auctions at once,
+ * from the My eBay won and didn't win lists.  eBay may take a while to
+ * update them, auctions missing from both are looked for again up to
+ * OUTCOME_TRIES times, OUTCOME_WAIT seconds apart, then checked one by
+ * one with checkWonAuction().  A single auction is always checked that
+ * way, its bid history is only one request.  No more tries are made if
+ * they would run into before, the time the next snipe needs esniper
+ * (0 = none).
+ *
+ * returns: number of items won
+ */
+int
+checkWonAuctions(auctionInfo **aips, int num, time_t before)
+{
+	int *outcome;
+	time_t lastEnd = 0;
+	int i, found, won = 0;
+
+	if (num < 2) {
+		for (i = 0; i < num; ++i)
+			won += checkWonAuction(aips[i]);
+		return won;
+	}
+
+	for (i = 0; i < num; ++i) {
+		if (aips[i]->endTime > lastEnd)
+			lastEnd = aips[i]->endTime;
+	}
+	if (options.bidtime > 0 && options.bidtime < 60) {
+		time_t seconds = lastEnd - time(NULL);
+
+		if (seconds < 0)
+			seconds = 0;
+		/* extra 2 seconds to make sure auctions are over */
+		seconds += 2;
+		printLog(stdout, "Waiting %d seconds for %d auctions to complete...\n",
+			 (int)seconds, num);
+		daemonSleep((unsigned int)seconds);
+	}
+
+	outcome = (int *)myMalloc((size_t)num * sizeof(int));
+	for (i = 0; i < num; ++i)
+		outcome[i] = -1;
+	if (ebayLogin(aips[0], 0)) {
+		printAuctionError(aips[0], stderr);
+		found = -1;
+	} else
+		found = scanOutcomes(aips, num, outcome, before);
+	log(("checkWonAuctions(): %d of %d outcomes from My eBay\n", found, num));
+
+	for (i = 0; i < num; ++i) {
+		auctionInfo *aip = aips[i];
+		int n;
+
+		if (outcome[i] < 0) {
+			won += checkWonAuction(aip);
+			continue;
+		}
+		/* the list does not tell how many items of a multiple
+		 * item auction we won */
+		n = outcome[i] ? (options.quantity < aip->quantity ?
+				  options.quantity : aip->quantity) : 0;
+		if (outcome[i] && n < 1)
+			n = 1;
+		aip->won = n;
+		printLog(stdout, "\nAuction %s: won %d item(s)\n", aip->auction, n);
+		wonAuction(aip, n);
+		won += n;
+	}
+	free(outcome);
 	return won;
 }
 
@@ -1190,22 +1484,10 @@ printMyItemsRow(char **row, int printNewline)
 		memBuf_t buf;
 		char *value = NULL;
 
-		if (column == 0) { /* item nr on checkbox in 1st (-1) column */
-			static const char search[] = "value=";
-			char *tmp = strstr(row[column], search);
-
-			if (tmp) {
-				int i;
-
-				tmp += sizeof(search) - 1;
-				for (; !isdigit(*tmp); ++tmp)
-					;
-				for (i = 1; isdigit(tmp[i]); ++i)
-					;
-				value = myStrndup(tmp, (size_t)(i));
-				printLog(stdout, "ItemNr:\t\t%s\n", value);
-				free(value);
-			}
+		/* item nr on checkbox in 1st (-1) column */
+		if (column == 0 && (value = myItemsNumber(row[column]))) {
+			printLog(stdout, "ItemNr:\t\t%s\n", value);
+			free(value);
 		}
 		strToMemBuf(row[column], &buf); /* load new row */
 		for (item_nr = 0; item_nr < MAX_TDS_LENGTH; item_nr++) {
@@ -1225,7 +1507,32 @@ printMyItemsRow(char **row, int printNewline)
 	return ret;
 }
 
+/*
+ * Item number from the checkbox in the first column of a My eBay row.
+ *
+ * returns: item number (free with free()), NULL if not found
+ */
+static char *
+myItemsNumber(const char *cell)
+{
+	static const char search[] = "value=";
+	const char *tmp = strstr(cell, search);
+	int i;
+
+	if (!tmp)
+		return NULL;
+	tmp += sizeof(search) - 1;
+	for (; *tmp && !isdigit(*tmp); ++tmp)
+		;
+	if (!*tmp)
+		return NULL;
+	for (i = 1; isdigit(tmp[i]); ++i)
+		;
+	return myStrndup(tmp, (size_t)(i));
+}
+
 static const char MYITEMS_URL[] = "http://%s/ws/eBayISAPI.dll?MyeBay&CurrentPage=MyeBayWatching";
+static const char MAKETRACK_URL[] = "http://%s/ws/eBayISAPI.dll?MakeTrack&item=%s";
 
 /*
  * TODO: allow user configuration of myItems.
@@ -1248,6 +1555,7 @@ printMyItems(void)
 	urlLen = sizeof(MYITEMS_URL) + strlen(options.myeBayHost) - (1*2);
 	url = (char *)myMalloc(urlLen);
 	sprintf(url, MYITEMS_URL, options.myeBayHost);
+	governorAcquire(gp_myItems);
 	mp = httpGet(url, NULL);
 	free(url);
 	if (!mp) {
@@ -1264,15 +1572,12 @@ printMyItems(void)
 		if (!strstr(table, "class=\"my_itl-iT\""))
 			continue;
 		/* skip first descriptive table row */
-		if ((row = getTableRow(mp)))
-			freeTableRow(row);
-		else {
+		if (!getTableRow(mp)) {
 			freeAuction(dummy);
 			return 0; /* error? */
 		}
 		while ((row = getTableRow(mp))) {
 			printNewline = printMyItemsRow(row, printNewline);
-			freeTableRow(row);
 		}
 	}
 	freeAuction(dummy);
@@ -1280,11 +1585,548 @@ printMyItems(void)
 	return 0;
 }
 
-/* secret option - test parser */
-void
-testParser(int flag)
+/*
+ * URL of the next page of the watch list, from the "Next" link.
+ *
+ * returns: URL (free with free()), NULL if this is the last page
+ */
+static char *
+myItemsNextPage(memBuf_t *mp)
+{
+	const char *next, *href, *end;
+	char *url, *cp;
+
+	memReset(mp);
+	if (!(next = memStr(mp, ">Next<")))
+		return NULL;
+	/* find start of the link */
+	for (href = next; href > mp->memory && strncasecmp(href, "<a ", 3);
+	     --href)
+		;
+	if (href == mp->memory || !(href = strstr(href, "href=\"")) ||
+	    href > next)
+		return NULL;
+	href += 6;
+	if (!(end = strchr(href, '"')) || end > next)
+		return NULL;
+	if (*href == '/')
+		url = myStrdup3("http://", options.myeBayHost, "");
+	else
+		url = myStrdup("");
+	url = (char *)myRealloc(url, strlen(url) + (size_t)(end - href) + 1);
+	cp = url + strlen(url);
+	/* copy, undoing &amp; */
+	while (href < end) {
+		if (!strncmp(href, "&amp;", 5)) {
+			*cp++ = '&';
+			href += 5;
+		} else
+			*cp++ = *href++;
+	}
+	*cp = '\0';
+	return url;
+}
+
+/*
+ * Update an auction from a row of the watch list, if it is one of ours.
+ *
+ * returns: 1 if auction was updated, 0 otherwise
+ */
+static int
+refreshRow(char **row, auctionInfo **aips, int num, int *refreshed, time_t start)
 {
-	memBuf_t *mp = readFile(stdin);
+	auctionInfo *aip;
+	memBuf_t buf;
+	char *item, *value;
+	long remain;
+	int i;
+
+	if (numColumns(row) < 7 || !(item = myItemsNumber(row[0])))
+		return 0;
+	for (i = 0; i < num && strcmp(aips[i]->auction, item); ++i)
+		;
+	free(item);
+	if (i == num)
+		return 0;
+	aip = aips[i];
+	aip->onWatchList = 1;
+
+	/* time left, ended auctions are left to the bid history */
+	strToMemBuf(row[6], &buf);
+	value = getNonTag(&buf);
+	if (!value || (remain = getSeconds(value)) <= 0) {
+		log(("bulkRefresh(): auction %s, time left \"%s\" ignored\n",
+		     aip->auction, nullStr(value)));
+		return 0;
+	}
+
+	if (!aip->title) {
+		strToMemBuf(row[2], &buf);
+		value = getNonTag(&buf);
+		/* there may be a "ENDING SOON" message */
+		if (value && strstr(value, "ENDING SOON"))
+			value = getNonTag(&buf);
+		if (value)
+			aip->title = auctionString(aip, aip->title, value);
+	}
+	strToMemBuf(row[3], &buf);
+	if ((value = getNonTag(&buf)) && isdigit((int)*value))
+		aip->bids = (int)strtol(value, NULL, 10);
+	strToMemBuf(row[4], &buf);
+	if ((value = getNonTag(&buf))) {
+		const char *priceStr = priceFixup(value, aip);
+
+		if (priceStr && atof(priceStr) >= 0.01)
+			aip->price = atof(priceStr);
+	}
+	aip->remain = remain;
+	aip->endTime = start + remain;
+	refreshed[i] = 1;
+	log(("bulkRefresh(): auction %s, %d bids, price %.2f, %ld seconds left\n",
+	     aip->auction, aip->bids, aip->price, remain));
+	journalInfo(aip);
+	statusUpdate(aip);
+	return 1;
+}
+
+/*
+ * Put auction on the watch list, so that bulkRefresh() finds it.  Only
+ * tried once per auction.
+ */
+static void
+watchListAdd(auctionInfo *aip)
+{
+	memBuf_t *mp;
+	char *url;
+
+	if (aip->onWatchList)
+		return;
+	url = (char *)myMalloc(sizeof(MAKETRACK_URL) +
+		strlen(options.myeBayHost) + strlen(aip->auction) - (2*2));
+	sprintf(url, MAKETRACK_URL, options.myeBayHost, aip->auction);
+	governorAcquire(gp_myItems);
+	mp = httpGet(url, NULL);
+	free(url);
+	aip->onWatchList = mp ? 1 : -1;
+	log(("watchListAdd(): auction %s %s watch list\n", aip->auction,
+	     mp ? "added to" : "could not be added to"));
+	freeMembuf(mp);
+}
+
+/*
+ * bulkRefresh(): update price, bids and end time of many auctions from
+ * the My eBay watch list, one request per page of the list instead of
+ * one per auction.  Auctions not found on the list are put on it, for
+ * the next refresh.  refreshed[i] is set to 1 for each auction updated,
+ * 0 for the others, which need getInfo().
+ *
+ * returns: number of auctions refreshed, -1 on error
+ */
+int
+bulkRefresh(auctionInfo **aips, int num, int *refreshed)
+{
+	char *url;
+	int i, count = 0, pages = 0;
+
+	for (i = 0; i < num; ++i)
+		refreshed[i] = 0;
+	if (num == 0)
+		return 0;
+	if (ebayLogin(aips[0], 0)) {
+		printAuctionError(aips[0], stderr);
+		return -1;
+	}
+	url = (char *)myMalloc(sizeof(MYITEMS_URL) + strlen(options.myeBayHost) - (1*2));
+	sprintf(url, MYITEMS_URL, options.myeBayHost);
+	while (url && pages++ < MYITEMS_MAX_PAGES && count < num) {
+		memBuf_t *mp;
+		const char *table;
+		char **row;
+		time_t start = time(NULL);
+
+		governorAcquire(gp_myItems);
+		mp = httpGet(url, NULL);
+		free(url);
+		url = NULL;
+		if (!mp) {
+			log(("bulkRefresh(): cannot get watch list page %d\n", pages));
+			return count ? count : -1;
+		}
+		while ((table = getTableStart(mp))) {
+			if (!strstr(table, "class=\"my_itl-iT\""))
+				continue;
+			/* skip first descriptive table row */
+			if (!getTableRow(mp))
+				break;
+			while ((row = getTableRow(mp)))
+				count += refreshRow(row, aips, num, refreshed, start);
+		}
+		url = myItemsNextPage(mp);
+		freeMembuf(mp);
+	}
+	free(url);
+	log(("bulkRefresh(): %d of %d auctions refreshed from %d page(s)\n",
+	     count, num, pages));
+	for (i = 0; i < num; ++i) {
+		if (!refreshed[i] && aips[i]->onWatchList != 1)
+			watchListAdd(aips[i]);
+	}
+	return count;
+}
+
+static watchPage_t *watchPages = NULL;	/* last scan, per page */
+static int numWatchPages = 0;
+static watchItem_t *watchItems = NULL;	/* last scan, sorted by auction */
+static int numWatchItems = 0;
+
+static int
+compareWatchItems(const void *p1, const void *p2)
+{
+	const watchItem_t *w1 = (const watchItem_t *)p1;
+	const watchItem_t *w2 = (const watchItem_t *)p2;
+	size_t l1 = strlen(w1->auction), l2 = strlen(w2->auction);
+
+	/* numeric order, without overflow */
+	if (l1 != l2)
+		return l1 < l2 ? -1 : 1;
+	return strcmp(w1->auction, w2->auction);
+}
+
+static void
+freeWatchItems(watchItem_t *items, int num)
+{
+	int i;
+
+	for (i = 0; i < num; ++i) {
+		free(items[i].auction);
+		free(items[i].title);
+	}
+	free(items);
+}
+
+/*
+ * Collect auction number and title of all running auctions on a page of
+ * the watch list.  Ended auctions are left out.
+ */
+static void
+parseWatchPage(memBuf_t *mp, watchPage_t *pp)
+{
+	const char *table;
+	char **row;
+	size_t size = 0;
+
+	freeWatchItems(pp->items, pp->numItems);
+	pp->items = NULL;
+	pp->numItems = 0;
+	memReset(mp);
+	while ((table = getTableStart(mp))) {
+		if (!strstr(table, "class=\"my_itl-iT\""))
+			continue;
+		/* skip first descriptive table row */
+		if (!getTableRow(mp))
+			break;
+		while ((row = getTableRow(mp))) {
+			memBuf_t buf;
+			char *item, *value;
+
+			if (numColumns(row) < 7 || !(item = myItemsNumber(row[0])))
+				continue;
+			strToMemBuf(row[6], &buf);
+			value = getNonTag(&buf);
+			if (!value || getSeconds(value) == 0) {
+				free(item);
+				continue;
+			}
+			strToMemBuf(row[2], &buf);
+			value = getNonTag(&buf);
+			/* there may be a "ENDING SOON" message */
+			if (value && strstr(value, "ENDING SOON"))
+				value = getNonTag(&buf);
+			if ((size_t)pp->numItems == size) {
+				size = size ? size * 2 : 64;
+				pp->items = (watchItem_t *)myRealloc(pp->items,
+						size * sizeof(watchItem_t));
+			}
+			pp->items[pp->numItems].auction = item;
+			pp->items[pp->numItems].title = myStrdup(value ? value : "");
+			++pp->numItems;
+		}
+	}
+}
+
+/*
+ * watchListScan(): compare the watch list with the last scan, and call
+ * callback for every auction that was added, has changed or is gone.
+ * With all set, every auction still listed is reported as changed.
+ *
+ * Pages are fetched with conditional requests: a page that did not
+ * change since the last scan is not parsed again.
+ *
+ * returns: number of auctions on the watch list, -1 on error (nothing
+ *	reported)
+ */
+int
+watchListScan(watchListCallback callback, int all)
+{
+	auctionInfo *dummy = newAuctionInfo("0", "0");
+	watchItem_t *items = NULL;
+	char *url;
+	int i, j, page, numItems = 0, reparsed = 0;
+
+	if (ebayLogin(dummy, 0)) {
+		printAuctionError(dummy, stderr);
+		freeAuction(dummy);
+		return -1;
+	}
+	url = (char *)myMalloc(sizeof(MYITEMS_URL) + strlen(options.myeBayHost) - (1*2));
+	sprintf(url, MYITEMS_URL, options.myeBayHost);
+	for (page = 0; url && page < MYITEMS_MAX_PAGES; ++page) {
+		memBuf_t *mp;
+		watchPage_t *pp;
+
+		governorAcquire(gp_myItems);
+		if (!(mp = httpGetCond(url, NULL))) {
+			httpError(dummy);
+			printAuctionError(dummy, stderr);
+			freeAuction(dummy);
+			free(url);
+			return -1;
+		}
+		if (page == numWatchPages) {
+			watchPages = (watchPage_t *)myRealloc(watchPages,
+				(size_t)(numWatchPages + 1) * sizeof(watchPage_t));
+			memset(&watchPages[numWatchPages++], 0, sizeof(watchPage_t));
+		}
+		pp = &watchPages[page];
+		if (!httpLastTiming()->notModified || !pp->url ||
+		    strcmp(pp->url, url)) {
+			parseWatchPage(mp, pp);
+			++reparsed;
+		}
+		free(pp->url);
+		pp->url = url;
+		url = myItemsNextPage(mp);
+		freeMembuf(mp);
+	}
+	free(url);
+	freeAuction(dummy);
+	/* list got shorter */
+	while (numWatchPages > page) {
+		--numWatchPages;
+		free(watchPages[numWatchPages].url);
+		freeWatchItems(watchPages[numWatchPages].items,
+			       watchPages[numWatchPages].numItems);
+	}
+
+	for (i = 0; i < numWatchPages; ++i)
+		numItems += watchPages[i].numItems;
+	items = (watchItem_t *)myMalloc((size_t)(numItems + 1) * sizeof(watchItem_t));
+	for (i = numItems = 0; i < numWatchPages; ++i) {
+		for (j = 0; j < watchPages[i].numItems; ++j) {
+			items[numItems].auction = myStrdup(watchPages[i].items[j].auction);
+			items[numItems++].title = myStrdup(watchPages[i].items[j].title);
+		}
+	}
+	qsort(items, (size_t)numItems, sizeof(watchItem_t), compareWatchItems);
+	/* listed twice if the list changed between pages */
+	for (i = j = 1; i < numItems; ++i) {
+		if (compareWatchItems(&items[i], &items[j - 1]))
+			items[j++] = items[i];
+		else {
+			free(items[i].auction);
+			free(items[i].title);
+		}
+	}
+	if (numItems > 1)
+		numItems = j;
+
+	/* merge with last scan */
+	for (i = j = 0; i < numItems || j < numWatchItems; ) {
+		int cmp = i == numItems ? 1 : j == numWatchItems ? -1 :
+			compareWatchItems(&items[i], &watchItems[j]);
+
+		if (cmp < 0) {
+			callback(wc_added, items[i].auction, items[i].title);
+			++i;
+		} else if (cmp > 0) {
+			callback(wc_removed, watchItems[j].auction, watchItems[j].title);
+			++j;
+		} else {
+			if (all || strcmp(items[i].title, watchItems[j].title))
+				callback(wc_changed, items[i].auction, items[i].title);
+			++i;
+			++j;
+		}
+	}
+	freeWatchItems(watchItems, numWatchItems);
+	watchItems = items;
+	numWatchItems = numItems;
+	log(("watchListScan(): %d auctions on %d page(s), %d page(s) parsed\n",
+	     numItems, numWatchPages, reparsed));
+	return numItems;
+}
+
+/* results of the tokenizer benchmark, see benchPage() */
+#define MAX_BENCH 4
+typedef struct {
+	double cpu;	/* seconds to tokenize and walk the pages */
+	unsigned long tags;
+	unsigned long texts;
+	size_t arena;	/* bytes kept with the pages */
+	size_t heapPeak;/* largest of the pages, 0 if not known */
+	int otherTags;	/* pages with tags other than the first tokenizer */
+	int otherText;	/* pages with text other than the first */
+	int otherResult;/* pages with bid history other than the first */
+} benchStat_t;
+
+static benchStat_t benchStats[MAX_BENCH];
+
+/*
+ * FNV-1a hash of a token, for comparing the tokenizers.
+ */
+static unsigned long
+benchHash(unsigned long hash, const char *s)
+{
+	for (; *s; ++s)
+		hash = (hash ^ (unsigned char)*s) * 16777619UL;
+	return (hash ^ '\n') * 16777619UL;
+}
+
+/*
+ * Bid history parser result, for comparing the tokenizers.
+ */
+static void
+benchResult(char *buf, size_t size, memBuf_t *mp, time_t start)
+{
+	auctionInfo *aip;
+	pageInfo_t *pp;
+	time_t end;
+	int ret;
+
+	memReset(mp);
+	if (!(pp = getPageInfo(mp))) {
+		/* not an eBay page, would write a bug report */
+		snprintf(buf, size, "no page name");
+		return;
+	}
+	aip = newAuctionInfo("1", "2");
+	ret = parseBidHistory(mp, aip, start, &end, 1);
+	snprintf(buf, size, "page=%s ret=%d error=%d title=\"%s\" quantity=%d bids=%d price=%.2f currency=%s shipping=%s reserve=%d winning=%d won=%d end=%ld/%lld",
+		 nullStr(pp->pageName), ret, (int)aip->auctionError,
+		 nullStr(aip->title),
+		 aip->quantity, aip->bids, aip->price, nullStr(aip->currency),
+		 nullStr(aip->shipping), aip->reserve, aip->winning, aip->won,
+		 (long)aip->endTime, (long long)aip->endTimeMs);
+	freeAuction(aip);
+}
+
+/*
+ * Run a page through every tokenizer.  Each one gets the page from
+ * scratch, reads all tags and then all text, and then runs the bid
+ * history parser.  Tags, text and parser result are compared with the
+ * first tokenizer, the hand-written scanner.
+ */
+static void
+benchPage(memBuf_t *mp)
+{
+	const char *saved = htmlTokenizerName();
+	char first[1024], result[1024];
+	unsigned long firstTags = 0, firstText = 0;
+	time_t start = time(NULL);
+	int i;
+
+	for (i = 0; htmlTokenizers[i] && i < MAX_BENCH; ++i) {
+		const htmlTokenizer_t *tp = htmlTokenizers[i];
+		benchStat_t *bp = &benchStats[i];
+		unsigned long tags = 0, texts = 0;
+		unsigned long tagHash = 2166136261UL, textHash = 2166136261UL;
+		size_t arena = mp->arena ? mp->arena->allocated : 0, peak = 0;
+		const char *cp;
+		clock_t cpu;
+
+		htmlSetTokenizer(tp->name);
+		mp->tokens = NULL;
+		if (tp->heapPeak)
+			(void)tp->heapPeak();
+		memReset(mp);
+		cpu = clock();
+		while ((cp = getTag(mp))) {
+			++tags;
+			tagHash = benchHash(tagHash, cp);
+		}
+		memReset(mp);
+		while ((cp = getNonTag(mp))) {
+			++texts;
+			textHash = benchHash(textHash, cp);
+		}
+		cpu = clock() - cpu;
+		arena = (mp->arena ? mp->arena->allocated : 0) - arena;
+		if (tp->heapPeak)
+			peak = tp->heapPeak();
+
+		bp->cpu += (double)cpu / CLOCKS_PER_SEC;
+		bp->tags += tags;
+		bp->texts += texts;
+		bp->arena += arena;
+		if (peak > bp->heapPeak)
+			bp->heapPeak = peak;
+		printf("%s: %lu tags, %lu texts, %.3f ms, %lu arena bytes, %lu heap bytes\n",
+		       tp->name, tags, texts, (double)cpu * 1000 / CLOCKS_PER_SEC,
+		       (unsigned long)arena, (unsigned long)peak);
+
+		benchResult(i ? result : first, sizeof(first), mp, start);
+		if (i == 0) {
+			firstTags = tagHash;
+			firstText = textHash;
+			continue;
+		}
+		if (tagHash != firstTags) {
+			++bp->otherTags;
+			printf("%s: tags differ from %s\n", tp->name,
+			       htmlTokenizers[0]->name);
+		}
+		if (textHash != firstText) {
+			++bp->otherText;
+			printf("%s: text differs from %s\n", tp->name,
+			       htmlTokenizers[0]->name);
+		}
+		if (strcmp(result, first)) {
+			++bp->otherResult;
+			printf("%s: bid history differs from %s:\n\t%s\n\t%s\n",
+			       tp->name, htmlTokenizers[0]->name, first, result);
+		}
+	}
+	htmlSetTokenizer(saved);
+}
+
+/*
+ * Summary of the tokenizer benchmark.
+ */
+static void
+benchSummary(int pages, size_t bytes)
+{
+	int i;
+
+	for (i = 0; htmlTokenizers[i] && i < MAX_BENCH; ++i) {
+		const benchStat_t *bp = &benchStats[i];
+
+		printLog(stderr, "%s: %.1f MB/s, %lu tags, %lu texts, %lu arena bytes, %lu heap bytes peak, %d of %d pages with other tags, %d with other text, %d with other bid history\n",
+			 htmlTokenizers[i]->name,
+			 bp->cpu > 0 ? (double)bytes / bp->cpu / 1e6 : 0.0,
+			 bp->tags, bp->texts, (unsigned long)bp->arena,
+			 (unsigned long)bp->heapPeak, bp->otherTags, pages,
+			 bp->otherText, bp->otherResult);
+	}
+}
+
+/*
+ * Run a page through the test parser selected by flag.
+ * returns: 0 = OK, 1 = parser failed
+ */
+static int
+testPage(int flag, memBuf_t *mp)
+{
+	int failed = 0;
 
 	switch (flag) {
 	case 1:
@@ -1313,6 +2155,8 @@ testParser(int flag)
 
 		printf("ret = %d\n", ret);
 		printAuctionError(aip, stdout);
+		freeAuction(aip);
+		failed = ret != 0;
 		break;
 	    }
 	case 3:
@@ -1323,6 +2167,8 @@ testParser(int flag)
 
 		printf("ret = %d\n", ret);
 		printAuctionError(aip, stdout);
+		freeAuction(aip);
+		failed = ret != 0;
 		break;
 	    }
 	case 4:
@@ -1341,12 +2187,14 @@ testParser(int flag)
 		}
 		if (!cp) {
 			printf("time left not found!\n");
+			failed = 1;
 			break;
 		}
 		(void)getTableStart(mp); /* skip one table */
 		table = getTableStart(mp);
 		if (!table) {
 			printf("no table found!\n");
+			failed = 1;
 			break;
 		}
 
@@ -1359,8 +2207,7 @@ testParser(int flag)
 				memBuf_t buf;
 
 				strToMemBuf(row[columnNum], &buf);
-				printf("\t\tcolumn %d: %s\n", columnNum, getNonTag(mp));
-				free(row[columnNum]);
+				printf("\t\tcolumn %d: %s\n", columnNum, getNonTag(&buf));
 			}
 		}
 		break;
@@ -1374,7 +2221,152 @@ testParser(int flag)
 		printf("ret = %d\n", ret);
 		printf("uiid = %s\n", aip->biduiid);
 		printAuctionError(aip, stdout);
+		freeAuction(aip);
+		failed = ret != 0;
 		break;
 		}
+	case 6:
+		/* compare HTML tokenizers */
+		benchPage(mp);
+		break;
+	}
+	return failed;
+}
+
+typedef struct {
+	int flag;
+	int *pages;
+	size_t *bytes;
+} testArg_t;
+
+/*
+ * Run a page of a capture file through the test parser.
+ */
+static int
+testCaptured(memBuf_t *mp, const char *url, void *arg)
+{
+	testArg_t *ap = (testArg_t *)arg;
+
+	printf("==> %s <==\n", url);
+	++*ap->pages;
+	*ap->bytes += mp->size;
+	return testPage(ap->flag, mp);
+}
+
+/*
+ * Run a file through the test parser.  All pages of a capture file
+ * written with -w are run through the parser.
+ * returns: number of pages failed, 1 if file not readable
+ */
+static int
+testFile(int flag, const char *path, int *pages, size_t *bytes)
+{
+	FILE *fp = fopen(path, "rb");
+	memBuf_t *mp;
+	testArg_t arg;
+	int failed;
+
+	if (!fp) {
+		printLog(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	mp = readFile(fp);
+	fclose(fp);
+	arg.flag = flag;
+	arg.pages = pages;
+	arg.bytes = bytes;
+	if ((failed = captureEach(mp, testCaptured, &arg)) >= 0)
+		return failed;
+	printf("==> %s <==\n", path);
+	++*pages;
+	*bytes += mp->size;
+	return testPage(flag, mp);
+}
+
+#if !defined(WIN32)
+static int
+compareNames(const void *p1, const void *p2)
+{
+	return strcmp(*(char *const *)p1, *(char *const *)p2);
+}
+
+/*
+ * Run all files in a directory through the test parser, in name order.
+ * returns: number of failed files
+ */
+static int
+testDirectory(int flag, const char *path, int *pages, size_t *bytes)
+{
+	DIR *dir = opendir(path);
+	struct dirent *dp;
+	char **names = NULL;
+	size_t count = 0, size = 0, i;
+	int failed = 0;
+
+	if (!dir) {
+		printLog(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	while ((dp = readdir(dir))) {
+		if (dp->d_name[0] == '.')
+			continue;
+		if (count == size) {
+			size = size ? size * 2 : 256;
+			names = (char **)myRealloc(names, size * sizeof(char *));
+		}
+		names[count++] = myStrdup3(path, "/", dp->d_name);
+	}
+	closedir(dir);
+	if (count)
+		qsort(names, count, sizeof(char *), compareNames);
+	for (i = 0; i < count; ++i) {
+		struct stat st;
+
+		if (!stat(names[i], &st) && S_ISREG(st.st_mode))
+			failed += testFile(flag, names[i], pages, bytes);
+		free(names[i]);
+	}
+	free(names);
+	return failed;
+}
+#endif
+
+/*
+ * secret option - test parser
+ *
+ * Without arguments, the page is read from stdin.  Otherwise all files
+ * given, and all files in directories given, are run through the parser
+ * in one go.  Capture files are read page by page.  Flag 6 compares the
+ * HTML tokenizers, the summary goes to stderr.
+ *
+ * returns: 0 = OK, 1 = a parser failed
+ */
+int
+testParser(int flag, int argc, char *const *argv)
+{
+	int i, failed = 0, pages = 0;
+	size_t bytes = 0;
+	clock_t start;
+
+	if (argc == 0)
+		return testPage(flag, readFile(stdin));
+
+	start = clock();
+	for (i = 0; i < argc; ++i) {
+#if !defined(WIN32)
+		struct stat st;
+
+		if (!stat(argv[i], &st) && S_ISDIR(st.st_mode)) {
+			failed += testDirectory(flag, argv[i], &pages, &bytes);
+			continue;
+		}
+#endif
+		failed += testFile(flag, argv[i], &pages, &bytes);
 	}
+	printLog(stderr, "%d pages, %lu bytes, %d failed, %.2f CPU seconds\n",
+		 pages, (unsigned long)bytes, failed,
+		 (double)(clock() - start) / CLOCKS_PER_SEC);
+	if (flag == 6)
+		benchSummary(pages, bytes);
+	return failed != 0;
 }
@@ -34,7 +34,17 @@
 extern int getInfo(auctionInfo *aip);
 extern int snipeAuction(auctionInfo *aip);
 extern int checkWonAuction(auctionInfo *aip);
+extern int checkWonAuctions(auctionInfo **aips, int num, time_t before);
 extern int printMyItems(void);
+extern int bulkRefresh(auctionInfo **aips, int num, int *refreshed);
+
+enum watchChange {
+	wc_added,
+	wc_changed,	/* title changed, or all items were asked for */
+	wc_removed	/* no longer listed, or ended */
+};
+typedef void (*watchListCallback)(enum watchChange change, const char *auction, const char *title);
+extern int watchListScan(watchListCallback callback, int all);
 
 typedef struct {
 	char *pageName;
@@ -43,9 +53,8 @@ typedef struct {
 } pageInfo_t;
 
 extern pageInfo_t *getPageInfo(memBuf_t *mp);
-extern void freePageInfo(pageInfo_t *pp);
 
 /* secret option */
-extern void testParser(int flag);
+extern int testParser(int flag, int argc, char *const *argv);
 
 #endif /* AUCTION_H_INCLUDED */
@@ -27,6 +27,11 @@
 #include "auctioninfo.h"
 #include "esniper.h"
 #include "auction.h"
+#include "daemon.h"
+#include "governor.h"
+#include "journal.h"
+#include "metrics.h"
+#include "retry.h"
 #include "util.h"
 #include <stdlib.h>
 #include <string.h>
@@ -261,6 +266,7 @@ newAuctionInfo(const char *auction, const char *bidPriceStr)
 {
 	auctionInfo *aip = (auctionInfo *)myMalloc(sizeof(auctionInfo));
 
+	aip->arena = arenaNew(1024);
 	aip->auction = myStrdup(auction);
 	aip->title = NULL;
 	aip->bidPriceStr = priceFixup(myStrdup(bidPriceStr), NULL);
@@ -268,6 +274,7 @@ newAuctionInfo(const char *auction, const char *bidPriceStr)
 	aip->remain = 0;
 	aip->remainRaw = NULL;
 	aip->endTime = 0;
+	aip->endTimeMs = 0;
 	aip->latency = 0;
 	aip->query = NULL;
 	aip->biduiid = NULL;
@@ -283,6 +290,9 @@ newAuctionInfo(const char *auction, const char *bidPriceStr)
 	aip->reserve = 0;
 	aip->won = -1;
 	aip->winning = 0;
+	aip->onWatchList = 0;
+	aip->historyCache = NULL;
+	aip->bidLog = NULL;
 	aip->auctionError = ae_none;
 	aip->auctionErrorDetail = NULL;
 	return aip;
@@ -294,17 +304,61 @@ freeAuction(auctionInfo *aip)
 	if (!aip)
 		return;
 	free(aip->auction);
-	free(aip->title);
 	free(aip->bidPriceStr);
 	free(aip->remainRaw);
-	free(aip->query);
-	free(aip->biduiid);
-	free(aip->shipping);
-	free(aip->currency);
 	free(aip->auctionErrorDetail);
+	arenaFree(aip->arena);
 	free(aip);
 }
 
+/*
+ * auctionString(): keep a string for the lifetime of an auction.  Page
+ *		fields are stored again on every poll, but hardly ever
+ *		change, so an unchanged value is not copied.
+ *
+ * returns: old if it equals s, else a copy of s in the arena of the auction
+ */
+char *
+auctionString(auctionInfo *aip, char *old, const char *s)
+{
+	if (!s)
+		return NULL;
+	if (old && !strcmp(old, s))
+		return old;
+	return myStrdupIn(aip->arena, s);
+}
+
+/*
+ * updateBidPrice(): change bid price of an auction, e.g. after the auction
+ *		file has been edited.  Once the bid key has been fetched it
+ *		is tied to the old price, so the price cannot change anymore.
+ *
+ * returns: 0 = OK (or unchanged), 1 = too late to change
+ */
+int
+updateBidPrice(auctionInfo *aip, const char *bidPriceStr)
+{
+	char *newPriceStr = priceFixup(myStrdup(bidPriceStr), NULL);
+
+	if (aip->bidPriceStr && newPriceStr &&
+	    !strcmp(aip->bidPriceStr, newPriceStr)) {
+		free(newPriceStr);
+		return 0;
+	}
+	if (aip->biduiid) {
+		printLog(stderr, "Auction %s: bid key already fetched, cannot change price to %s\n",
+			 aip->auction, nullStr(newPriceStr));
+		free(newPriceStr);
+		return 1;
+	}
+	printLog(stdout, "Auction %s: price changed from %s to %s\n",
+		 aip->auction, nullStr(aip->bidPriceStr), nullStr(newPriceStr));
+	free(aip->bidPriceStr);
+	aip->bidPriceStr = newPriceStr;
+	aip->bidPrice = aip->bidPriceStr ? atof(aip->bidPriceStr) : -1;
+	return 0;
+}
+
 /*
  * compareAuctionInfo(): used to sort auctionInfo table
  *
@@ -371,6 +425,9 @@ auctionError(auctionInfo *aip, enum auctionErrorCode pe, const char *details)
 {
 	resetAuctionError(aip);
 	aip->auctionError = pe;
+	metricsAuctionError(pe);
+	if (pe == ae_captcha)
+		governorBackoff();
 	if (details)
 		aip->auctionErrorDetail = myStrdup(details);
     printAuctionError(aip, stderr);
@@ -470,26 +527,29 @@ sortAuctions(auctionInfo **auctions, int numAuctions, int *quantity)
 	int i, sawError = 0;
 
 	for (i = 0; i < numAuctions; ++i) {
-		int j;
+		retry_t retry;
 
 		if (options.debug)
 			logOpen(auctions[i], options.logdir);
-		for (j = 0; j < 3; ++j) {
-			if (j > 0)
-				printLog(stderr, "Retrying...\n");
-			/* delay to avoid ebay's "security measure" */
-			if(options.delay > 0)
-				sleep(options.delay);
-			if (!getInfo(auctions[i]))
-				break;
+		if (journalRestore(auctions[i])) {
+			printLog(stdout, "Auction %s: state restored from journal\n",
+				 auctions[i]->auction);
+			continue;
+		}
+		/* delay to avoid ebay's "security measure" */
+		if(options.delay > 0)
+			daemonSleep((unsigned int)options.delay);
+		retryInit(&retry, rr_startup);
+		while (getInfo(auctions[i])) {
 			printAuctionError(auctions[i], stderr);
-			if (auctions[i]->auctionError == ae_unavailable) {
-				--j;	/* doesn't count as an attempt */
-				printLog(stderr, "%s: Will retry, sleeping for an hour\n", timestamp());
-				sleep(3600);
-			} else if (auctions[i]->auctionError == ae_login ||
-				   auctions[i]->auctionError == ae_captcha)
-				return 0;
+			/* on ae_captcha, the governor pauses the next try */
+			if (retryNext(&retry, auctions[i]) != ra_retry) {
+				if (auctions[i]->auctionError == ae_login)
+					return 0;
+				break;
+			}
+			retryWait(&retry);
+			printLog(stderr, "Retrying...\n");
 		}
 		printLog(stdout, "\n");
 	}
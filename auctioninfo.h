@@ -27,6 +27,8 @@
 #ifndef AUCTIONINFO_H_INCLUDED
 #define AUCTIONINFO_H_INCLUDED
 
+#include "arena.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <time.h>
 
@@ -73,38 +75,51 @@ enum auctionErrorCode {
 	ae_unknown
 };
 
+/* parse results of unchanged page sections, see history.c */
+struct historyCache;
+/* bids seen in the bid history, see bidlog.c */
+struct bidLog;
+
 /*
- * All information associated with an auction
+ * All information associated with an auction.  Strings that rarely change
+ * are kept in the arena of the auction, see auctionString().
  */
 typedef struct {
+	arena_t *arena;	/* memory freed with the auction */
 	char *auction;	/* auction number */
-	char *title;	/* auction title */
+	char *title;	/* auction title (arena) */
 	char *bidPriceStr;/* price you want to bid */
 	double bidPrice;/* price you want to bid (converted to double) */
 	time_t remain;	/* remaining seconds */
 	char *remainRaw;/* remaining time string, from ebay */
 	time_t endTime;	/* end time as calculated from remaining seconds */
+	int64_t endTimeMs;/* end time from page, ms since epoch (0 = from remaining seconds) */
 	time_t latency; /* latency from HTTP request to first page data */
-	char *query;	/* bid history query */
-	char *biduiid;	/* bid uiid */
-	char *bidstok;	/* bid stok */
-	char *bidsrt;	/* bid srt */
+	char *query;	/* bid history query (arena) */
+	char *biduiid;	/* bid uiid (arena) */
+	char *bidstok;	/* bid stok (arena) */
+	char *bidsrt;	/* bid srt (arena) */
 	int quantity;	/* number of items available */
 	int quantityBid;/* number of items currently bid on */
 	int bids;	/* number of bids made */
 	double price;	/* current price */
-	char *shipping;	/* shipping cost */
-	char *currency;	/* currency used in auction */
+	char *shipping;	/* shipping cost (arena) */
+	char *currency;	/* currency used in auction (arena) */
 	int bidResult;	/* result code from bid (-1=no bid yet, 0=success, 1 = error) */
 	int reserve;	/* auction has reserve and it hasn't been met. */
 	int won;	/* number won (-1 = no clue, 0 or greater = actual #) */
 	int winning;	/* number currently winning (-1 = no clue, 0 or greater = actual #) */
+	int onWatchList;/* on My eBay watch list (1 = yes, 0 = not yet known, -1 = cannot add) */
+	struct historyCache *historyCache;/* unchanged page sections, see history.c (arena) */
+	struct bidLog *bidLog;/* bids seen in the bid history, see bidlog.c (arena) */
 	enum auctionErrorCode auctionError;/* error encountered while parsing */
 	char *auctionErrorDetail;/* details of error */
 } auctionInfo;
 
 extern auctionInfo *newAuctionInfo(const char *auction, const char *bidPriceStr);
 extern void freeAuction(auctionInfo *aip);
+extern char *auctionString(auctionInfo *aip, char *old, const char *s);
+extern int updateBidPrice(auctionInfo *aip, const char *bidPriceStr);
 extern int compareAuctionInfo(const void *p1, const void *p2);
 extern void printAuctionError(auctionInfo *aip, FILE *fp);
 extern void resetAuctionError(auctionInfo *aip);
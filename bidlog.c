@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Bid log: the bids of an auction, kept in columns.
+ *
+ * The bid history table is read on every poll.  Only rows newer than the
+ * newest bid already logged are added, the rest of the table need not be
+ * read.  The log answers questions like "how many bids per minute" and
+ * "how much do the other bidders raise" without parsing the history again.
+ */
+
+/* for strptime prototype in time.h */
+#define _GNU_SOURCE
+
+#include "bidlog.h"
+#include "esniper.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct bidLog {
+	int count;		/* bids logged, oldest first */
+	int size;		/* allocated entries */
+	int pending;		/* rows of current parse, after count */
+	int matched;		/* current parse reached newest logged bid */
+	const char **bidder;	/* one copy per bidder */
+	double *amount;
+	time_t *when;		/* time of bid, or when first seen */
+};
+
+static struct bidLog *getBidLog(auctionInfo *aip);
+static const char *bidderName(struct bidLog *lp, auctionInfo *aip, const char *bidder);
+static time_t bidTime(const char *when);
+
+/*
+ * Start reading a bid history table.
+ */
+void
+bidLogBegin(auctionInfo *aip)
+{
+	struct bidLog *lp = getBidLog(aip);
+
+	lp->pending = 0;
+	lp->matched = 0;
+}
+
+/*
+ * A row of the bid history table, newest first.
+ *
+ * returns: 1 = new bid, 0 = newest bid already logged, no need to read
+ *	    further rows
+ */
+int
+bidLogRow(auctionInfo *aip, const char *bidder, double amount, const char *when)
+{
+	struct bidLog *lp = getBidLog(aip);
+	int i;
+
+	if (lp->matched)
+		return 0;
+	/* Bid times are not always readable, so bidder and amount identify
+	 * a bid.  A bidder never bids the same amount twice.
+	 */
+	if (lp->count > 0 && amount == lp->amount[lp->count - 1] &&
+	    !strcasecmp(bidder, lp->bidder[lp->count - 1])) {
+		lp->matched = 1;
+		return 0;
+	}
+	if (lp->count + lp->pending >= lp->size) {
+		int size = lp->size ? lp->size * 2 : 16;
+		const char **bidders = (const char **)arenaAlloc(aip->arena, size * sizeof(char *));
+		double *amounts = (double *)arenaAlloc(aip->arena, size * sizeof(double));
+		time_t *whens = (time_t *)arenaAlloc(aip->arena, size * sizeof(time_t));
+
+		i = lp->count + lp->pending;
+		if (i) {
+			memcpy(bidders, lp->bidder, i * sizeof(char *));
+			memcpy(amounts, lp->amount, i * sizeof(double));
+			memcpy(whens, lp->when, i * sizeof(time_t));
+		}
+		lp->bidder = bidders;
+		lp->amount = amounts;
+		lp->when = whens;
+		lp->size = size;
+	}
+	bidder = bidderName(lp, aip, bidder);
+	i = lp->count + lp->pending++;
+	lp->bidder[i] = bidder;
+	lp->amount[i] = amount;
+	lp->when[i] = bidTime(when);
+	return 1;
+}
+
+/*
+ * Done reading the table, log the new bids.  If the newest logged bid
+ * was not found (retracted bid, or a different table), the log is
+ * replaced by the table.
+ */
+void
+bidLogEnd(auctionInfo *aip)
+{
+	struct bidLog *lp = getBidLog(aip);
+	int i, j;
+
+	if (!lp->matched && lp->count > 0) {
+		memmove(lp->bidder, lp->bidder + lp->count, lp->pending * sizeof(char *));
+		memmove(lp->amount, lp->amount + lp->count, lp->pending * sizeof(double));
+		memmove(lp->when, lp->when + lp->count, lp->pending * sizeof(time_t));
+		lp->count = 0;
+	}
+	/* newest first to oldest first */
+	for (i = lp->count, j = lp->count + lp->pending - 1; i < j; ++i, --j) {
+		const char *bidder = lp->bidder[i];
+		double amount = lp->amount[i];
+		time_t when = lp->when[i];
+
+		lp->bidder[i] = lp->bidder[j];
+		lp->amount[i] = lp->amount[j];
+		lp->when[i] = lp->when[j];
+		lp->bidder[j] = bidder;
+		lp->amount[j] = amount;
+		lp->when[j] = when;
+	}
+	if (lp->pending) {
+		log(("bidLogEnd(): %d new bids, %d bids logged", lp->pending, lp->count + lp->pending));
+	}
+	lp->count += lp->pending;
+	lp->pending = 0;
+}
+
+int
+bidLogCount(const auctionInfo *aip)
+{
+	return aip->bidLog ? aip->bidLog->count : 0;
+}
+
+/*
+ * Bids per minute in the window seconds up to the newest bid.  Bid times
+ * are eBay's, in eBay's time zone, so the window ends at the newest bid
+ * rather than now.
+ */
+double
+bidLogRate(const auctionInfo *aip, long window)
+{
+	const struct bidLog *lp = aip->bidLog;
+	time_t since;
+	int i, n = 0;
+
+	if (!lp || lp->count == 0 || window <= 0)
+		return 0.0;
+	since = lp->when[lp->count - 1] - window;
+	for (i = lp->count - 1; i >= 0 && lp->when[i] > since; --i)
+		++n;
+	return n * 60.0 / window;
+}
+
+/*
+ * Largest raise over the previous bid by a bidder other than self.
+ */
+double
+bidLogMaxIncrement(const auctionInfo *aip, const char *self)
+{
+	const struct bidLog *lp = aip->bidLog;
+	double max = 0.0;
+	int i;
+
+	if (!lp)
+		return 0.0;
+	for (i = 1; i < lp->count; ++i) {
+		double increment = lp->amount[i] - lp->amount[i - 1];
+
+		if (increment > max && strcasecmp(lp->bidder[i], self))
+			max = increment;
+	}
+	return max;
+}
+
+/*
+ * Bid log of the auction, kept in its arena.
+ */
+static struct bidLog *
+getBidLog(auctionInfo *aip)
+{
+	if (!aip->bidLog) {
+		aip->bidLog = (struct bidLog *)arenaAlloc(aip->arena, sizeof(struct bidLog));
+		memset(aip->bidLog, 0, sizeof(struct bidLog));
+	}
+	return aip->bidLog;
+}
+
+/*
+ * Most auctions have few bidders, so each name is stored once.
+ */
+static const char *
+bidderName(struct bidLog *lp, auctionInfo *aip, const char *bidder)
+{
+	int i;
+
+	for (i = lp->count + lp->pending - 1; i >= 0; --i) {
+		if (!strcmp(lp->bidder[i], bidder))
+			return lp->bidder[i];
+	}
+	return myStrdupIn(aip->arena, bidder);
+}
+
+/*
+ * Bid time, e.g. "Oct-19-26 10:15:23 PDT" or "19 Oct 2026 at 10:15:23PM".
+ * The time zone is ignored.
+ *
+ * returns: time of bid, or now if it cannot be read
+ */
+static time_t
+bidTime(const char *when)
+{
+#if !defined(WIN32)
+	static const char *const formats[] = {
+		"%b-%d-%y %H:%M:%S",
+		"%d %b %Y at %I:%M:%S%p",
+		"%d %b %Y at %H:%M:%S",
+		NULL
+	};
+	const char *const *fp;
+
+	for (fp = formats; when && *fp; ++fp) {
+		struct tm tm;
+
+		memset(&tm, 0, sizeof(tm));
+		if (strptime(when, *fp, &tm)) {
+			tm.tm_isdst = -1;
+			return mktime(&tm);
+		}
+	}
+#endif
+	return time(NULL);
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BIDLOG_H_INCLUDED
+#define BIDLOG_H_INCLUDED
+
+#include "auctioninfo.h"
+
+/*
+ * Bids seen in the bid history table of an auction.  Rows are passed in
+ * table order, newest first, between bidLogBegin() and bidLogEnd().
+ */
+extern void bidLogBegin(auctionInfo *aip);
+extern int bidLogRow(auctionInfo *aip, const char *bidder, double amount, const char *when);
+extern void bidLogEnd(auctionInfo *aip);
+
+extern int bidLogCount(const auctionInfo *aip);
+extern double bidLogRate(const auctionInfo *aip, long window);
+extern double bidLogMaxIncrement(const auctionInfo *aip, const char *self);
+
+#endif /* BIDLOG_H_INCLUDED */
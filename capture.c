@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * HTTP capture and replay.
+ *
+ * The archive starts with an 8 byte magic string and a 32 bit byte order
+ * mark, followed by one record per request: a fixed size header, then the
+ * URL, the POST data and the response body.  URL and data are stored the
+ * way they are logged, so the password never makes it into the archive.
+ * Failed requests are recorded too, with their curl error.
+ *
+ * On replay, a request is answered by the next unused record with the
+ * same method and URL, so an identical session gets identical answers
+ * while a session that polls less or more often still finds its pages.
+ */
+
+#include "capture.h"
+#include "esniper.h"
+#include "util.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(WIN32)
+#	include <sys/timeb.h>
+#else
+#	include <sys/time.h>
+#endif
+
+#define CAPTURE_MAGIC "ESNCAP1\n"
+#define CAPTURE_BYTEORDER 0x01020304UL
+
+typedef struct {
+	uint64_t usec;		/* response complete, since capture start */
+	double timing[6];	/* namelookup .. total, as in httpTiming_t */
+	int64_t bytesSent;
+	int64_t bytesReceived;
+	int32_t curlCode;	/* CURLcode */
+	int32_t responseCode;
+	uint32_t urlLen;
+	uint32_t dataLen;
+	uint32_t bodyLen;
+	uint8_t post;
+	uint8_t notModified;
+	uint16_t pad;
+} captureRecord_t;
+
+typedef struct {
+	captureRecord_t rec;
+	const char *url;	/* not terminated, into replayImage */
+	const char *body;
+	int used;
+} replayEntry_t;
+
+static FILE *captureFp = NULL;
+static uint64_t captureStart = 0;
+static char *replayImage = NULL;	/* archive contents */
+static replayEntry_t *replayEntries = NULL;
+static size_t numReplayEntries = 0;
+static size_t replayCursor = 0;		/* after last record served */
+
+static int replayMatch(const replayEntry_t *ep, int post, const char *url,
+		       size_t urlLen);
+static int replayFailed(void);
+static uint64_t captureTime(void);
+
+/*
+ * captureOpen(): start recording requests.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+captureOpen(const char *filename)
+{
+	uint32_t byteorder = CAPTURE_BYTEORDER;
+
+	if (!(captureFp = fopen(filename, "wb"))) {
+		printLog(stderr, "Cannot create capture file %s: %s\n",
+			 filename, strerror(errno));
+		return 1;
+	}
+	fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC) - 1, captureFp);
+	fwrite(&byteorder, sizeof(byteorder), 1, captureFp);
+	captureStart = captureTime();
+	return 0;
+}
+
+/*
+ * replayOpen(): answer requests from a capture file.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+replayOpen(const char *filename)
+{
+	FILE *fp = fopen(filename, "rb");
+	long size;
+	size_t pos, allocated = 0;
+	uint32_t byteorder;
+
+	if (!fp) {
+		printLog(stderr, "Cannot open capture file %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+	if (fseek(fp, 0L, SEEK_END) || (size = ftell(fp)) < 0 ||
+	    fseek(fp, 0L, SEEK_SET)) {
+		printLog(stderr, "Cannot read capture file %s: %s\n", filename,
+			 strerror(errno));
+		fclose(fp);
+		return 1;
+	}
+	replayImage = (char *)myMalloc((size_t)size + 1);
+	if (fread(replayImage, 1, (size_t)size, fp) != (size_t)size) {
+		printLog(stderr, "Cannot read capture file %s: %s\n", filename,
+			 strerror(errno));
+		fclose(fp);
+		return replayFailed();
+	}
+	fclose(fp);
+
+	pos = sizeof(CAPTURE_MAGIC) - 1 + sizeof(byteorder);
+	if ((size_t)size < pos ||
+	    memcmp(replayImage, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC) - 1)) {
+		printLog(stderr, "%s is not an esniper capture file\n", filename);
+		return replayFailed();
+	}
+	memcpy(&byteorder, replayImage + sizeof(CAPTURE_MAGIC) - 1,
+	       sizeof(byteorder));
+	if (byteorder != CAPTURE_BYTEORDER) {
+		printLog(stderr, "Capture file %s was written on a machine with different byte order\n", filename);
+		return replayFailed();
+	}
+	while (pos + sizeof(captureRecord_t) <= (size_t)size) {
+		replayEntry_t *ep;
+		captureRecord_t rec;
+
+		memcpy(&rec, replayImage + pos, sizeof(rec));
+		pos += sizeof(rec);
+		if ((size_t)size - pos <
+		    (size_t)rec.urlLen + rec.dataLen + rec.bodyLen)
+			break;	/* truncated, esniper was killed */
+		if (numReplayEntries == allocated) {
+			allocated = allocated ? allocated * 2 : 64;
+			replayEntries = (replayEntry_t *)myRealloc(replayEntries,
+					allocated * sizeof(replayEntry_t));
+		}
+		ep = &replayEntries[numReplayEntries++];
+		ep->rec = rec;
+		ep->url = replayImage + pos;
+		ep->body = ep->url + rec.urlLen + rec.dataLen;
+		ep->used = 0;
+		pos += (size_t)rec.urlLen + rec.dataLen + rec.bodyLen;
+	}
+	log(("replayOpen(): %lu requests in %s\n",
+	     (unsigned long)numReplayEntries, filename));
+	return 0;
+}
+
+void
+captureClose(void)
+{
+	if (captureFp) {
+		fclose(captureFp);
+		captureFp = NULL;
+	}
+	free(replayEntries);
+	replayEntries = NULL;
+	numReplayEntries = replayCursor = 0;
+	free(replayImage);
+	replayImage = NULL;
+}
+
+int
+replayActive(void)
+{
+	return replayImage != NULL;
+}
+
+/*
+ * Record a request.  mp may be empty if the request failed.
+ */
+void
+captureWrite(int post, const char *url, const char *data, int curlCode,
+	     long responseCode, const httpTiming_t *tp, const memBuf_t *mp)
+{
+	captureRecord_t rec;
+
+	if (!captureFp)
+		return;
+	memset(&rec, 0, sizeof(rec));
+	rec.usec = captureTime() - captureStart;
+	rec.timing[0] = tp->namelookup;
+	rec.timing[1] = tp->connect;
+	rec.timing[2] = tp->appconnect;
+	rec.timing[3] = tp->pretransfer;
+	rec.timing[4] = tp->starttransfer;
+	rec.timing[5] = tp->total;
+	rec.bytesSent = tp->bytesSent;
+	rec.bytesReceived = tp->bytesReceived;
+	rec.curlCode = curlCode;
+	rec.responseCode = (int32_t)responseCode;
+	rec.urlLen = (uint32_t)strlen(url);
+	rec.dataLen = post && data ? (uint32_t)strlen(data) : 0;
+	rec.bodyLen = mp->memory ? (uint32_t)mp->size : 0;
+	rec.post = (uint8_t)post;
+	rec.notModified = (uint8_t)tp->notModified;
+	fwrite(&rec, sizeof(rec), 1, captureFp);
+	fwrite(url, 1, rec.urlLen, captureFp);
+	if (rec.dataLen)
+		fwrite(data, 1, rec.dataLen, captureFp);
+	if (rec.bodyLen)
+		fwrite(mp->memory, 1, rec.bodyLen, captureFp);
+	/* an esniper that gets killed should leave a usable archive */
+	fflush(captureFp);
+}
+
+/*
+ * Answer a request from the capture file.  On success, mp gets a copy of
+ * the recorded page.
+ *
+ * returns: 0 = OK, 1 = request not in capture file
+ */
+int
+replayNext(int post, const char *url, int *curlCode, long *responseCode,
+	   httpTiming_t *tp, memBuf_t *mp)
+{
+	size_t urlLen = strlen(url), i;
+	replayEntry_t *ep = NULL;
+
+	for (i = replayCursor; !ep && i < numReplayEntries; ++i) {
+		if (replayMatch(&replayEntries[i], post, url, urlLen))
+			ep = &replayEntries[i];
+	}
+	for (i = 0; !ep && i < replayCursor; ++i) {
+		if (replayMatch(&replayEntries[i], post, url, urlLen))
+			ep = &replayEntries[i];
+	}
+	if (!ep) {
+		log(("replayNext(): %s not in capture file\n", url));
+		return 1;
+	}
+	ep->used = 1;
+	replayCursor = (size_t)(ep - replayEntries) + 1;
+
+	*curlCode = ep->rec.curlCode;
+	*responseCode = ep->rec.responseCode;
+	tp->namelookup = ep->rec.timing[0];
+	tp->connect = ep->rec.timing[1];
+	tp->appconnect = ep->rec.timing[2];
+	tp->pretransfer = ep->rec.timing[3];
+	tp->starttransfer = ep->rec.timing[4];
+	tp->total = ep->rec.timing[5];
+	tp->bytesSent = (long)ep->rec.bytesSent;
+	tp->bytesReceived = (long)ep->rec.bytesReceived;
+	tp->bodySize = (long)ep->rec.bodyLen;
+	tp->notModified = ep->rec.notModified;
+	if (ep->rec.bodyLen) {
+		mp->memory = (char *)myMalloc(ep->rec.bodyLen + 1);
+		memcpy(mp->memory, ep->body, ep->rec.bodyLen);
+		mp->memory[ep->rec.bodyLen] = '\0';
+		mp->size = ep->rec.bodyLen;
+		mp->readptr = mp->memory;
+	}
+	log(("replayNext(): request %lu, captured at %.3f seconds\n",
+	     (unsigned long)replayCursor, (double)ep->rec.usec / 1e6));
+	return 0;
+}
+
+/*
+ * Run every response of a capture file, read into image, through fn.
+ * Each response gets a page of its own, which is freed when fn returns.
+ *
+ * returns: sum of results of fn, -1 if image is not a capture file
+ */
+int
+captureEach(const memBuf_t *image,
+	    int (*fn)(memBuf_t *mp, const char *url, void *arg), void *arg)
+{
+	size_t pos = sizeof(CAPTURE_MAGIC) - 1 + sizeof(uint32_t);
+	uint32_t byteorder;
+	int ret = 0;
+
+	if (image->size < pos ||
+	    memcmp(image->memory, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC) - 1))
+		return -1;
+	memcpy(&byteorder, image->memory + sizeof(CAPTURE_MAGIC) - 1,
+	       sizeof(byteorder));
+	if (byteorder != CAPTURE_BYTEORDER) {
+		printLog(stderr, "Capture file was written on a machine with different byte order\n");
+		return 1;
+	}
+	while (pos + sizeof(captureRecord_t) <= image->size) {
+		captureRecord_t rec;
+		memBuf_t *mp;
+		char *url;
+
+		memcpy(&rec, image->memory + pos, sizeof(rec));
+		pos += sizeof(rec);
+		if (image->size - pos <
+		    (size_t)rec.urlLen + rec.dataLen + rec.bodyLen)
+			break;	/* truncated, esniper was killed */
+		if (rec.bodyLen) {
+			url = (char *)myMalloc(rec.urlLen + 1);
+			memcpy(url, image->memory + pos, rec.urlLen);
+			url[rec.urlLen] = '\0';
+			mp = (memBuf_t *)myMalloc(sizeof(memBuf_t));
+			memset(mp, 0, sizeof(memBuf_t));
+			mp->memory = (char *)myMalloc(rec.bodyLen + 1);
+			memcpy(mp->memory, image->memory + pos + rec.urlLen +
+			       rec.dataLen, rec.bodyLen);
+			mp->memory[rec.bodyLen] = '\0';
+			mp->size = rec.bodyLen;
+			mp->readptr = mp->memory;
+			ret += fn(mp, url, arg);
+			freeMembuf(mp);
+			free(url);
+		}
+		pos += (size_t)rec.urlLen + rec.dataLen + rec.bodyLen;
+	}
+	return ret;
+}
+
+static int
+replayFailed(void)
+{
+	free(replayImage);
+	replayImage = NULL;
+	return 1;
+}
+
+static int
+replayMatch(const replayEntry_t *ep, int post, const char *url,
+	    size_t urlLen)
+{
+	return !ep->used && ep->rec.post == post &&
+	       ep->rec.urlLen == urlLen && !memcmp(ep->url, url, urlLen);
+}
+
+static uint64_t
+captureTime(void)
+{
+#if defined(WIN32)
+	struct timeb tb;
+
+	ftime(&tb);
+	return (uint64_t)tb.time * 1000000 + (uint64_t)tb.millitm * 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
+#endif
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CAPTURE_H_INCLUDED
+#define CAPTURE_H_INCLUDED
+
+#include "http.h"
+
+/*
+ * HTTP capture and replay.  When capturing, every request is written to
+ * an archive together with its response and timing.  When replaying, the
+ * responses are served from the archive instead of the network.
+ */
+extern int captureOpen(const char *filename);
+extern int replayOpen(const char *filename);
+extern void captureClose(void);
+extern int replayActive(void);
+extern void captureWrite(int post, const char *url, const char *data,
+			 int curlCode, long responseCode,
+			 const httpTiming_t *tp, const memBuf_t *mp);
+extern int replayNext(int post, const char *url, int *curlCode,
+		      long *responseCode, httpTiming_t *tp, memBuf_t *mp);
+/* test parser: run responses in capture file image through fn */
+extern int captureEach(const memBuf_t *image,
+		       int (*fn)(memBuf_t *mp, const char *url, void *arg),
+		       void *arg);
+
+#endif /* CAPTURE_H_INCLUDED */
@@ -0,0 +1,1063 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Daemon mode.
+ *
+ * One process keeps a single login and curl session alive and snipes all
+ * auctions in its queue, earliest end time first.  Commands are read from
+ * a unix domain socket, one command per line:
+ *
+ *	add <auction> <price>	add an auction to the queue
+ *	load <auction_file>	add all auctions listed in an auction file
+ *	remove <auction>	remove an auction from the queue
+ *	list			list all queued auctions
+ *	status [<auction>]	daemon status, or details of one auction
+ *	quit			stop after the current snipe
+ *
+ * Every reply ends with a line containing "OK" or "ERROR <reason>".
+ */
+
+#include "daemon.h"
+#include "auction.h"
+#include "auctionfile.h"
+#include "auctioninfo.h"
+#include "buffer.h"
+#include "esniper.h"
+#include "governor.h"
+#include "journal.h"
+#include "metrics.h"
+#include "reload.h"
+#include "resolve.h"
+#include "rules.h"
+#include "status.h"
+#include "trace.h"
+#include "util.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(WIN32)
+#	define sleep(t) _sleep((t) * 1000)
+#else
+#	include <sys/types.h>
+#	include <sys/select.h>
+#	include <sys/socket.h>
+#	include <sys/stat.h>
+#	include <sys/un.h>
+#	include <unistd.h>
+#endif
+
+/* hand an auction over to snipeAuction() this many seconds before bid time */
+#define WATCH_WINDOW 900
+/* refresh auctions which are not yet being watched once a day */
+#define REFRESH_INTERVAL 86400
+/* also when they are refreshed from the watch list, a page at a time */
+#define BULK_REFRESH_INTERVAL 86400
+/* compare watch list with queue every 15 minutes */
+#define WATCHSYNC_INTERVAL 900
+/* postpone won check if the next snipe starts within this many seconds,
+ * time for the lists of several pages, retries and bid history fallback */
+#define WONCHECK_SLACK 180
+#define MAX_CLIENTS 16
+/* longest command line, a client sending more is dropped */
+#define MAX_LINE 4096
+
+typedef struct {
+	auctionInfo *aip;
+	time_t polled;	/* time of last getInfo(), 0 = never */
+	int fromFile;	/* listed in auction file, removed when it is */
+	int fromWatchList;/* added by watch list sync, removed when gone */
+} queueEntry_t;
+
+typedef struct {
+	int fd;
+	char *buf;
+	size_t bufsize;
+	size_t count;
+} client_t;
+
+static queueEntry_t *queue = NULL;
+static int queueLen = 0;
+static size_t queueSize = 0;
+static auctionInfo **unchecked = NULL;	/* sniped, won check postponed */
+static int uncheckedLen = 0;
+static auctionInfo *current = NULL;	/* auction being polled or sniped */
+static const char *currentState = NULL;
+static auctionInfo **refreshing = NULL;	/* auctions in a bulk refresh */
+static int refreshingLen = 0;
+static int totalWon = 0;
+static int quitRequested = 0;
+static time_t startTime = 0;
+static time_t lastSync = 0;	/* of watch list */
+
+#if !defined(WIN32)
+static int listenFd = -1;
+static char *socketPath = NULL;
+static client_t clients[MAX_CLIENTS];
+
+static int daemonOpen(const char *path);
+static int daemonWait(long timeout);
+static void acceptClient(void);
+static void readClient(client_t *cp);
+static void closeClient(client_t *cp);
+static void doCommand(client_t *cp, char *line);
+static void reply(client_t *cp, const char *fmt, ...);
+#endif
+static int queueAdd(auctionInfo *aip);
+static int queueFind(const char *auction);
+static void queueRemove(int i);
+static void queueDrop(int i);
+static void queueSort(void);
+static int pollAuction(auctionInfo *aip, time_t *polled);
+static const char *busyWith(const auctionInfo *aip);
+static long refreshInterval(void);
+static void refreshQueue(void);
+static void watchSync(void);
+static void watchSyncChange(enum watchChange change, const char *auction, const char *title);
+static void checkUnchecked(int force);
+static long bidRemain(const auctionInfo *aip);
+static time_t nextBid(void);
+static long nextPoll(void);
+
+#if defined(WIN32)
+int
+daemonRun(const char *path, auctionInfo **auctions, int numAuctions)
+{
+	printLog(stderr, "Daemon mode is not supported on this platform.\n");
+	return 1;
+}
+
+void
+daemonClose(void)
+{
+}
+
+unsigned int
+daemonSleep(unsigned int seconds)
+{
+	resolveRefresh();
+	sleep(seconds);
+	return 0;
+}
+
+#else /* !WIN32 */
+
+/*
+ * daemonRun(): run as daemon, listening on control socket path.
+ * The given auctions are queued before the socket is opened.
+ *
+ * returns: 0 if any item has been won, else 1 (like main())
+ */
+int
+daemonRun(const char *path, auctionInfo **auctions, int numAuctions)
+{
+	int i, quantity;
+
+	startTime = time(NULL);
+	if (daemonOpen(path))
+		return 1;
+	for (i = 0; i < numAuctions; ++i) {
+		if (queueAdd(auctions[i]))
+			freeAuction(auctions[i]);
+		else if (options.auctfilename)
+			queue[queueLen - 1].fromFile = 1;
+	}
+	printLog(stdout, "%s: daemon listening on %s, %d auction(s) queued\n",
+		 timestamp(), path, queueLen);
+
+	while (!quitRequested) {
+		long remain;
+
+		/* a captcha pause must not hold up the next snipe */
+		governorDeadline(nextBid());
+		if (options.watchRules &&
+		    time(NULL) - lastSync >= WATCHSYNC_INTERVAL)
+			watchSync();
+		if (options.bulkRefresh)
+			refreshQueue();
+		/* refresh auctions that have never or not recently been seen */
+		for (i = 0; i < queueLen && !quitRequested; ++i) {
+			auctionInfo *aip = queue[i].aip;
+			time_t polled = queue[i].polled;
+			int drop;
+
+			if (queue[i].polled &&
+			    time(NULL) - queue[i].polled < refreshInterval())
+				continue;
+			/* commands may change the queue while we poll */
+			current = aip;
+			currentState = "polling";
+			drop = pollAuction(aip, &polled);
+			current = NULL;
+			i = queueFind(aip->auction);
+			if (drop) {
+				queueDrop(i--);
+			} else
+				queue[i].polled = polled;
+		}
+		if (quitRequested)
+			break;
+		queueSort();
+		resolveRefresh();
+
+		if (queueLen == 0) {
+			checkUnchecked(1);
+			/* nothing to do, wait for commands */
+			daemonWait(-1L);
+			continue;
+		}
+
+		/* no end time yet, eBay could not be reached */
+		if (queue[0].aip->endTime == 0) {
+			checkUnchecked(1);
+			daemonWait(nextPoll());
+			continue;
+		}
+
+		remain = bidRemain(queue[0].aip);
+		if (remain > WATCH_WINDOW) {
+			long timeout = remain - WATCH_WINDOW;
+
+			checkUnchecked(0);
+			if (timeout > nextPoll())
+				timeout = nextPoll();
+			daemonWait(timeout);
+			continue;
+		}
+
+		/* take auction off the queue, it is ours now */
+		current = queue[0].aip;
+		currentState = "sniping";
+		queueRemove(0);
+		printLog(stdout, "\n%s: daemon sniping auction %s\n",
+			 timestamp(), current->auction);
+		/* as configured, snipeAuction() reduces it by items won */
+		quantity = options.quantity;
+		snipeAuction(current);
+		options.quantity = quantity;
+		unchecked = (auctionInfo **)myRealloc(unchecked,
+			(size_t)(uncheckedLen + 1) * sizeof(auctionInfo *));
+		unchecked[uncheckedLen++] = current;
+		current = NULL;
+
+		/* check outcome, unless the next snipe starts soon */
+		queueSort();
+		checkUnchecked(0);
+	}
+	checkUnchecked(1);
+	printLog(stdout, "%s: daemon exiting, won %d item(s)\n",
+		 timestamp(), totalWon);
+	daemonClose();
+	return totalWon > 0 ? 0 : 1;
+}
+
+/*
+ * Close control socket and all client connections.
+ */
+void
+daemonClose(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_CLIENTS; ++i) {
+		if (clients[i].fd > 0)
+			closeClient(&clients[i]);
+	}
+	if (listenFd >= 0) {
+		close(listenFd);
+		listenFd = -1;
+	}
+	if (socketPath) {
+		unlink(socketPath);
+		free(socketPath);
+		socketPath = NULL;
+	}
+}
+
+/*
+ * Sleep, servicing the control socket and metrics endpoint if they are
+ * open, and reloading changed files.
+ */
+unsigned int
+daemonSleep(unsigned int seconds)
+{
+	time_t end = time(NULL) + (time_t)seconds;
+	time_t now;
+
+	journalSync();
+	resolveRefresh();
+	traceBegin(te_sleep, NULL);
+	if (listenFd < 0 && reloadFd() < 0 && metricsFd() < 0)
+		sleep(seconds);
+	else {
+		while ((now = time(NULL)) < end)
+			daemonWait((long)(end - now));
+	}
+	traceEnd(te_sleep);
+	return 0;
+}
+
+/*
+ * Open control socket.
+ *
+ * returns: 0 = OK, else error
+ */
+static int
+daemonOpen(const char *path)
+{
+	struct sockaddr_un addr;
+	mode_t mask;
+	int ret;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printLog(stderr, "Control socket path %s is too long\n", path);
+		return 1;
+	}
+	if ((listenFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		printLog(stderr, "Cannot create control socket: %s\n",
+			 strerror(errno));
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	/* remove stale socket left behind by a killed daemon */
+	unlink(path);
+	/* only the user may send commands, the socket is created 0600 */
+	mask = umask(0177);
+	ret = bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (ret || listen(listenFd, 5)) {
+		printLog(stderr, "Cannot listen on control socket %s: %s\n",
+			 path, strerror(errno));
+		close(listenFd);
+		listenFd = -1;
+		return 1;
+	}
+	socketPath = myStrdup(path);
+	log(("daemonOpen(): listening on %s\n", path));
+	return 0;
+}
+
+/*
+ * Wait for activity on control socket, metrics scrapes or changes of
+ * watched files for up to timeout seconds (forever if timeout is negative), and handle it.
+ *
+ * returns: number of commands executed and files reloaded
+ */
+static int
+daemonWait(long timeout)
+{
+	fd_set readfds;
+	struct timeval tv;
+	int i, maxfd = -1, n, before = quitRequested;
+	int watchFd = reloadFd();
+	static int commands = 0;
+	int start = commands;
+
+	FD_ZERO(&readfds);
+	if (listenFd >= 0) {
+		FD_SET(listenFd, &readfds);
+		maxfd = listenFd;
+	}
+	if (watchFd >= 0) {
+		FD_SET(watchFd, &readfds);
+		if (watchFd > maxfd)
+			maxfd = watchFd;
+	}
+	maxfd = metricsSelect(&readfds, maxfd);
+	for (i = 0; i < MAX_CLIENTS; ++i) {
+		if (clients[i].fd > 0) {
+			FD_SET(clients[i].fd, &readfds);
+			if (clients[i].fd > maxfd)
+				maxfd = clients[i].fd;
+		}
+	}
+	tv.tv_sec = timeout;
+	tv.tv_usec = 0;
+	n = select(maxfd + 1, &readfds, NULL, NULL, timeout < 0 ? NULL : &tv);
+	if (n < 0) {
+		if (errno != EINTR) {
+			log(("daemonWait(): select failed: %s\n", strerror(errno)));
+		}
+		return 0;
+	}
+	if (n == 0)
+		return 0;
+	for (i = 0; i < MAX_CLIENTS; ++i) {
+		if (clients[i].fd > 0 && FD_ISSET(clients[i].fd, &readfds)) {
+			readClient(&clients[i]);
+			++commands;
+		}
+	}
+	if (listenFd >= 0 && FD_ISSET(listenFd, &readfds))
+		acceptClient();
+	if (watchFd >= 0 && FD_ISSET(watchFd, &readfds))
+		commands += reloadProcess();
+	metricsProcess(&readfds);
+	return commands - start + (quitRequested != before);
+}
+
+static void
+acceptClient(void)
+{
+	int i, fd = accept(listenFd, NULL, NULL);
+
+	if (fd < 0) {
+		log(("acceptClient(): accept failed: %s\n", strerror(errno)));
+		return;
+	}
+	for (i = 0; i < MAX_CLIENTS; ++i) {
+		if (clients[i].fd <= 0) {
+			clients[i].fd = fd;
+			clients[i].count = 0;
+			log(("acceptClient(): client %d connected\n", i));
+			return;
+		}
+	}
+	log(("acceptClient(): too many clients\n"));
+	close(fd);
+}
+
+static void
+closeClient(client_t *cp)
+{
+	close(cp->fd);
+	cp->fd = 0;
+	free(cp->buf);
+	cp->buf = NULL;
+	cp->bufsize = cp->count = 0;
+}
+
+/*
+ * Read available data from client, execute all complete lines.
+ */
+static void
+readClient(client_t *cp)
+{
+	char data[512];
+	ssize_t len = read(cp->fd, data, sizeof(data));
+	ssize_t i;
+
+	if (len <= 0) {
+		closeClient(cp);
+		return;
+	}
+	for (i = 0; i < len && cp->fd > 0; ++i) {
+		if (data[i] == '\n') {
+			if (cp->count && cp->buf[cp->count - 1] == '\r')
+				--cp->count;
+			term(cp->buf, cp->bufsize, cp->count);
+			doCommand(cp, cp->buf);
+			cp->count = 0;
+		} else if (cp->count >= MAX_LINE) {
+			reply(cp, "ERROR line too long\n");
+			closeClient(cp);
+		} else
+			addchar(cp->buf, cp->bufsize, cp->count, data[i]);
+	}
+}
+
+/*
+ * Send formatted reply to client.
+ */
+static void
+reply(client_t *cp, const char *fmt, ...)
+{
+	char buf[1024];
+	va_list arglist;
+	int len;
+	const char *p;
+
+	va_start(arglist, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, arglist);
+	va_end(arglist);
+	if (len < 0)
+		return;
+	if ((size_t)len >= sizeof(buf))
+		len = (int)sizeof(buf) - 1;
+	for (p = buf; len > 0; ) {
+		ssize_t n = write(cp->fd, p, (size_t)len);
+
+		if (n <= 0)
+			break;
+		p += n;
+		len -= (int)n;
+	}
+}
+
+static void
+replyAuction(client_t *cp, const auctionInfo *aip, const char *state)
+{
+	char timestr[20] = "--";
+
+	if (aip->endTime) {
+		struct tm *tmPtr = localtime(&(aip->endTime));
+
+		strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", tmPtr);
+	}
+	reply(cp, "%s\t%s\t%s\t%.2f\t%s\t%s\n", aip->auction, state, timestr,
+	      aip->price, nullStr(aip->bidPriceStr), nullEmptyStr(aip->title));
+}
+
+/*
+ * Execute one command line.
+ */
+static void
+doCommand(client_t *cp, char *line)
+{
+	char *cmd, *arg1, *arg2;
+	int i;
+
+	log(("doCommand(): %s\n", line));
+	cmd = strtok(line, " \t");
+	arg1 = strtok(NULL, " \t");
+	arg2 = strtok(NULL, " \t");
+	if (!cmd) {
+		reply(cp, "ERROR empty command\n");
+	} else if (!strcmp(cmd, "add")) {
+		auctionInfo *aip;
+
+		if (!arg1 || !arg2 || !isdigit((int)*arg1) ||
+		    (!isdigit((int)*arg2) && *arg2 != '.')) {
+			reply(cp, "ERROR usage: add <auction> <price>\n");
+			return;
+		}
+		aip = newAuctionInfo(arg1, arg2);
+		if (queueAdd(aip)) {
+			freeAuction(aip);
+			reply(cp, "ERROR auction %s already queued\n", arg1);
+		} else {
+			printLog(stdout, "%s: daemon queued auction %s, price %s\n", timestamp(), arg1, aip->bidPriceStr);
+			reply(cp, "OK\n");
+		}
+	} else if (!strcmp(cmd, "load")) {
+		auctionInfo **auctions = NULL;
+		int n, added = 0;
+
+		if (!arg1) {
+			reply(cp, "ERROR usage: load <auction_file>\n");
+			return;
+		}
+		if ((n = readAuctionFile(arg1, &auctions)) <= 0) {
+			reply(cp, "ERROR cannot read auctions from %s\n", arg1);
+			return;
+		}
+		for (i = 0; i < n; ++i) {
+			if (queueAdd(auctions[i]))
+				freeAuction(auctions[i]);
+			else
+				++added;
+		}
+		free(auctions);
+		printLog(stdout, "%s: daemon queued %d auction(s) from %s\n", timestamp(), added, arg1);
+		reply(cp, "%d of %d auction(s) queued\nOK\n", added, n);
+	} else if (!strcmp(cmd, "remove")) {
+		if (!arg1) {
+			reply(cp, "ERROR usage: remove <auction>\n");
+		} else if (current && !strcmp(current->auction, arg1)) {
+			reply(cp, "ERROR auction %s is being %s\n", arg1,
+			      busyWith(current));
+		} else if ((i = queueFind(arg1)) < 0) {
+			reply(cp, "ERROR auction %s not queued\n", arg1);
+		} else if (busyWith(queue[i].aip)) {
+			reply(cp, "ERROR auction %s is being %s\n", arg1,
+			      busyWith(queue[i].aip));
+		} else {
+			queueDrop(i);
+			printLog(stdout, "%s: daemon removed auction %s\n", timestamp(), arg1);
+			reply(cp, "OK\n");
+		}
+	} else if (!strcmp(cmd, "list")) {
+		if (current)
+			replyAuction(cp, current, currentState);
+		for (i = 0; i < queueLen; ++i)
+			replyAuction(cp, queue[i].aip,
+				     queue[i].polled ? "queued" : "new");
+		for (i = 0; i < uncheckedLen; ++i)
+			replyAuction(cp, unchecked[i], "ended");
+		reply(cp, "OK\n");
+	} else if (!strcmp(cmd, "status")) {
+		if (arg1) {
+			const auctionInfo *aip = NULL;
+
+			if (current && !strcmp(current->auction, arg1))
+				aip = current;
+			else if ((i = queueFind(arg1)) >= 0)
+				aip = queue[i].aip;
+			if (!aip) {
+				reply(cp, "ERROR auction %s not queued\n", arg1);
+				return;
+			}
+			reply(cp, "auction: %s\ntitle: %s\n"
+				  "price: %.2f %s\nbid price: %s\n"
+				  "bids: %d\nquantity: %d\nremain: %ld\n"
+				  "latency: %ld\nhigh bidder: %s\n"
+				  "error: %d %s\nOK\n",
+			      aip->auction, nullEmptyStr(aip->title),
+			      aip->price, nullEmptyStr(aip->currency),
+			      nullStr(aip->bidPriceStr), aip->bids,
+			      aip->quantity,
+			      aip->endTime ? (long)bidRemain(aip) : -1L,
+			      (long)aip->latency, aip->winning ? "yes" : "no",
+			      aip->auctionError,
+			      nullEmptyStr(aip->auctionErrorDetail));
+		} else {
+			char *dns = resolveStatus();
+
+			reply(cp, "pid: %d\nuptime: %ld\nuser: %s\n"
+				  "queued: %d\nsniping: %s\nwon: %d\n"
+				  "quantity: %d\nbid: %s\n%sOK\n",
+			      (int)getpid(), (long)(time(NULL) - startTime),
+			      nullStr(options.username), queueLen,
+			      current ? current->auction : "-", totalWon,
+			      options.quantity, options.bid ? "yes" : "no", dns);
+			free(dns);
+		}
+	} else if (!strcmp(cmd, "quit")) {
+		quitRequested = 1;
+		printLog(stdout, "%s: daemon quit requested\n", timestamp());
+		reply(cp, "OK\n");
+	} else {
+		reply(cp, "ERROR unknown command %s\n", cmd);
+	}
+}
+
+#endif /* !WIN32 */
+
+/*
+ * daemonReload(): apply auction file changes to the queue.  Auctions
+ * added through the control socket are not affected.  Unchanged auctions
+ * keep their state, new auctions are polled on the next pass.
+ * Takes ownership of auctions.
+ */
+void
+daemonReload(auctionInfo **auctions, int numAuctions)
+{
+	int i, j;
+
+	for (i = 0; i < queueLen; ++i) {
+		auctionInfo *aip = queue[i].aip;
+
+		if (!queue[i].fromFile)
+			continue;
+		for (j = 0; j < numAuctions; ++j) {
+			if (!strcmp(aip->auction, auctions[j]->auction))
+				break;
+		}
+		if (j < numAuctions)
+			continue;
+		if (queue[i].fromWatchList) {
+			/* still wanted by watch list */
+			queue[i].fromFile = 0;
+			continue;
+		}
+		if (busyWith(aip)) {
+			printLog(stderr, "Auction %s: is being %s, not removed\n",
+				 aip->auction, busyWith(aip));
+			continue;
+		}
+		printLog(stdout, "Auction %s: removed\n", aip->auction);
+		queueDrop(i--);
+	}
+	if (current && !strcmp(currentState, "sniping")) {
+		for (j = 0; j < numAuctions; ++j) {
+			if (!strcmp(current->auction, auctions[j]->auction))
+				break;
+		}
+		if (j == numAuctions)
+			printLog(stderr, "Auction %s: is being sniped, not removed\n",
+				 current->auction);
+	}
+
+	for (j = 0; j < numAuctions; ++j) {
+		auctionInfo *aip = auctions[j];
+
+		if ((i = queueFind(aip->auction)) >= 0) {
+			queue[i].fromFile = 1;
+			(void)updateBidPrice(queue[i].aip, aip->bidPriceStr);
+			freeAuction(aip);
+		} else if (current && !strcmp(current->auction, aip->auction)) {
+			(void)updateBidPrice(current, aip->bidPriceStr);
+			freeAuction(aip);
+		} else if (queueAdd(aip))
+			freeAuction(aip);
+		else {
+			queue[queueLen - 1].fromFile = 1;
+			printLog(stdout, "Auction %s: added\n", aip->auction);
+		}
+	}
+	free(auctions);
+}
+
+/*
+ * Add auction to queue.
+ *
+ * returns: 0 = OK, 1 = duplicate
+ */
+static int
+queueAdd(auctionInfo *aip)
+{
+	if (queueFind(aip->auction) >= 0 ||
+	    (current && !strcmp(current->auction, aip->auction)))
+		return 1;
+	if ((size_t)queueLen >= queueSize) {
+		queueSize += 16;
+		queue = (queueEntry_t *)myRealloc(queue,
+					queueSize * sizeof(queueEntry_t));
+	}
+	queue[queueLen].aip = aip;
+	queue[queueLen].polled = 0;
+	queue[queueLen].fromFile = 0;
+	queue[queueLen].fromWatchList = 0;
+	++queueLen;
+	metricsGauge(mg_auctions, queueLen);
+	return 0;
+}
+
+/*
+ * returns: index of auction in queue, or -1 if not found
+ */
+static int
+queueFind(const char *auction)
+{
+	int i;
+
+	for (i = 0; i < queueLen; ++i) {
+		if (!strcmp(queue[i].aip->auction, auction))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Remove entry from queue.  Does not free the auction.
+ */
+static void
+queueRemove(int i)
+{
+	if (i < 0 || i >= queueLen)
+		return;
+	--queueLen;
+	memmove(&queue[i], &queue[i + 1],
+		(size_t)(queueLen - i) * sizeof(queueEntry_t));
+	metricsGauge(mg_auctions, queueLen);
+}
+
+/*
+ * Remove entry from queue and free the auction, it is done with.
+ */
+static void
+queueDrop(int i)
+{
+	if (i < 0 || i >= queueLen)
+		return;
+	statusRemove(queue[i].aip);
+	freeAuction(queue[i].aip);
+	queueRemove(i);
+}
+
+static int
+compareQueueEntry(const void *p1, const void *p2)
+{
+	const queueEntry_t *q1 = (const queueEntry_t *)p1;
+	const queueEntry_t *q2 = (const queueEntry_t *)p2;
+
+	/* auctions with unknown end time go last */
+	if (!q1->aip->endTime != !q2->aip->endTime)
+		return q1->aip->endTime ? -1 : 1;
+	return compareAuctionInfo(&q1->aip, &q2->aip);
+}
+
+/*
+ * Sort queue by end time, auctions not successfully polled yet last.
+ */
+static void
+queueSort(void)
+{
+	if (queueLen > 1)
+		qsort(queue, (size_t)queueLen, sizeof(queueEntry_t),
+		      compareQueueEntry);
+}
+
+/*
+ * Get info on a queued auction, set time of last poll.  On the first
+ * poll (*polled is 0) the journal is tried before eBay.
+ *
+ * returns: 0 = keep auction, 1 = drop it (error, ended, or already won)
+ */
+static int
+pollAuction(auctionInfo *aip, time_t *polled)
+{
+	int restored = 0;
+
+	if (options.debug)
+		logOpen(aip, options.logdir);
+	if (*polled == 0 && (restored = journalRestore(aip)))
+		printLog(stdout, "Auction %s: state restored from journal\n",
+			 aip->auction);
+	else if (options.delay > 0)
+		daemonSleep((unsigned int)options.delay);
+	if (!restored && getInfo(aip)) {
+		printAuctionError(aip, stderr);
+		/* eBay problem, try again in an hour */
+		if (aip->auctionError == ae_unavailable ||
+		    aip->auctionError == ae_curlerror) {
+			*polled = time(NULL) - refreshInterval() + 3600;
+			return 0;
+		}
+		return 1;
+	}
+	*polled = time(NULL);
+	if (aip->won > 0) {
+		printLog(stdout, "Auction %s: already won\n", aip->auction);
+		return 1;
+	}
+	if (aip->endTime <= time(NULL)) {
+		(void)auctionError(aip, ae_ended, NULL);
+		return 1;
+	}
+	if (!isValidBidPrice(aip)) {
+		(void)auctionError(aip, ae_bidprice, NULL);
+		return 1;
+	}
+	return 0;
+}
+
+static long
+refreshInterval(void)
+{
+	return options.bulkRefresh ? BULK_REFRESH_INTERVAL : REFRESH_INTERVAL;
+}
+
+/*
+ * Refresh auctions that are due from the watch list.  Auctions not seen
+ * yet are left to pollAuction(), which also fetches title, quantity and
+ * the other details not shown on the watch list.
+ */
+static void
+refreshQueue(void)
+{
+	auctionInfo **aips;
+	int *refreshed;
+	time_t now = time(NULL);
+	int i, num = 0;
+
+	aips = (auctionInfo **)myMalloc((size_t)(queueLen + 1) * sizeof(auctionInfo *));
+	for (i = 0; i < queueLen; ++i) {
+		if (queue[i].polled && now - queue[i].polled >= refreshInterval())
+			aips[num++] = queue[i].aip;
+	}
+	if (num == 0) {
+		free(aips);
+		return;
+	}
+	refreshed = (int *)myMalloc((size_t)num * sizeof(int));
+	current = aips[0];
+	currentState = "refreshing";
+	refreshing = aips;
+	refreshingLen = num;
+	if (bulkRefresh(aips, num, refreshed) > 0) {
+		now = time(NULL);
+		for (i = 0; i < num; ++i) {
+			int j;
+
+			if (refreshed[i] && (j = queueFind(aips[i]->auction)) >= 0)
+				queue[j].polled = now;
+		}
+	}
+	current = NULL;
+	refreshing = NULL;
+	refreshingLen = 0;
+	free(refreshed);
+	free(aips);
+}
+
+/*
+ * Add auctions on the watch list to the queue, with bid prices from the
+ * rules file.  Only changes since the last sync are applied; when the
+ * rules file changed, all auctions on the list are looked at again.
+ */
+static void
+watchSync(void)
+{
+	int reloaded = rulesLoad(options.watchRules);
+
+	lastSync = time(NULL);
+	if (reloaded < 0)
+		return;
+	if (watchListScan(watchSyncChange, reloaded) < 0)
+		printLog(stderr, "%s: cannot get watch list, will try again later\n",
+			 timestamp());
+}
+
+static void
+watchSyncChange(enum watchChange change, const char *auction, const char *title)
+{
+	const char *price = change == wc_removed ? NULL :
+		rulesPrice(auction, title);
+	int i = queueFind(auction);
+
+	if (price) {
+		auctionInfo *aip;
+
+		if (i >= 0) {
+			queue[i].fromWatchList = 1;
+			/* auction file has the last word */
+			if (!queue[i].fromFile)
+				(void)updateBidPrice(queue[i].aip, price);
+			return;
+		}
+		if (current && !strcmp(current->auction, auction))
+			return;
+		aip = newAuctionInfo(auction, price);
+		if (queueAdd(aip))
+			freeAuction(aip);
+		else {
+			queue[queueLen - 1].fromWatchList = 1;
+			printLog(stdout, "Auction %s: added from watch list, price %s\n",
+				 auction, aip->bidPriceStr);
+		}
+	} else if (i >= 0 && queue[i].fromWatchList) {
+		queue[i].fromWatchList = 0;
+		if (queue[i].fromFile)
+			return;
+		printLog(stdout, "Auction %s: removed, %s\n", auction,
+			 change == wc_removed ? "no longer on watch list" :
+			 "no bid price in rules");
+		queueDrop(i);
+	}
+}
+
+/*
+ * Check outcome of sniped auctions.  Unless force is set, not if the next
+ * auction is handed to snipeAuction() within WONCHECK_SLACK seconds, and
+ * the check does not retry beyond that.
+ */
+static void
+checkUnchecked(int force)
+{
+	int i, quantity = options.quantity;
+	time_t before = 0;
+
+	if (uncheckedLen == 0)
+		return;
+	if (queueLen > 0 && queue[0].aip->endTime) {
+		long handover = bidRemain(queue[0].aip) - WATCH_WINDOW;
+
+		if (!force && handover <= WONCHECK_SLACK)
+			return;
+		before = time(NULL) + handover;
+	}
+	/* all at once, from the My eBay won and didn't win lists */
+	totalWon += checkWonAuctions(unchecked, uncheckedLen, before);
+	options.quantity = quantity;
+	for (i = 0; i < uncheckedLen; ++i) {
+		statusRemove(unchecked[i]);
+		freeAuction(unchecked[i]);
+	}
+	uncheckedLen = 0;
+}
+
+/*
+ * What the daemon is doing with aip, for messages, NULL if nothing, so
+ * it may be removed.
+ */
+static const char *
+busyWith(const auctionInfo *aip)
+{
+	int i;
+
+	if (aip == current) {
+		if (!strcmp(currentState, "polling"))
+			return "polled";
+		if (!strcmp(currentState, "sniping"))
+			return "sniped";
+		if (!strcmp(currentState, "refreshing"))
+			return "refreshed";
+		return currentState;
+	}
+	for (i = 0; i < refreshingLen; ++i) {
+		if (refreshing[i] == aip)
+			return "refreshed";
+	}
+	return NULL;
+}
+
+/*
+ * Seconds until bid must be placed.
+ */
+static long
+bidRemain(const auctionInfo *aip)
+{
+	return (long)(aip->endTime - time(NULL) - aip->latency - options.bidtime);
+}
+
+/*
+ * Time the first bid on a queued auction is due, 0 if none.
+ */
+static time_t
+nextBid(void)
+{
+	time_t next = 0;
+	int i;
+
+	for (i = 0; i < queueLen; ++i) {
+		const auctionInfo *aip = queue[i].aip;
+		time_t t = aip->endTime - aip->latency - options.bidtime;
+
+		if (aip->endTime && (!next || t < next))
+			next = t;
+	}
+	return next;
+}
+
+/*
+ * Seconds until the next queued auction is due to be polled again.
+ */
+static long
+nextPoll(void)
+{
+	long next = refreshInterval();
+	int i;
+
+	for (i = 0; i < queueLen; ++i) {
+		long t = (long)(queue[i].polled + refreshInterval() - time(NULL));
+
+		if (t < next)
+			next = t;
+	}
+	if (options.watchRules) {
+		long t = (long)(lastSync + WATCHSYNC_INTERVAL - time(NULL));
+
+		if (t < next)
+			next = t;
+	}
+	return next > 0 ? next : 0;
+}
@@ -35,7 +35,16 @@
 #include "auction.h"
 #include "auctionfile.h"
 #include "auctioninfo.h"
+#include "capture.h"
+#include "daemon.h"
+#include "governor.h"
+#include "html.h"
+#include "journal.h"
+#include "metrics.h"
 #include "options.h"
+#include "reload.h"
+#include "status.h"
+#include "trace.h"
 #include "util.h"
 
 static const char *progname = NULL;
@@ -69,6 +78,10 @@ static const char DEFAULT_CONF_FILE[] = ".esniper";
 #define DEFAULT_BID_HOST "offer.ebay.com"
 #define DEFAULT_LOGIN_HOST "signin.ebay.com"
 #define DEFAULT_MYEBAY_HOST "my.ebay.com"
+/* requests per minute */
+#define DEFAULT_RATE 30
+#define DEFAULT_RATE_FILE ".esniper.rate"
+#define DEFAULT_STATUS_TABLE ".esniper.status"
 
 option_t options = {
 	NULL,		/* username */
@@ -94,7 +107,21 @@ option_t options = {
 	NULL,		/* loginHost */
 	NULL,		/* bidHost */
 	0,		/* curldebug */
-	2      /* delay */
+	2,     /* delay */
+	NULL,		/* daemonSocket */
+	1,		/* reload */
+	NULL,		/* journal */
+	NULL,		/* trace */
+	NULL,		/* metrics */
+	DEFAULT_RATE,	/* rate */
+	NULL,		/* rateFile */
+	NULL,		/* capture */
+	NULL,		/* replay */
+	NULL,		/* status */
+	NULL,		/* statusTable */
+	0,		/* bulkRefresh */
+	NULL,		/* watchRules */
+	NULL		/* htmlParser */
 };
 
 /* used for option table */
@@ -120,6 +147,8 @@ static int CheckUser(const void *valueptr, const optionTable_t *tableptr,
 	  const char *filename, const char *line);
 static int CheckPass(const void *valueptr, const optionTable_t *tableptr,
 	  const char *filename, const char *line);
+static int CheckHtmlParser(const void *valueptr, const optionTable_t *tableptr,
+			   const char *filename, const char *line);
 
 /* this table describes options and config entries */
 optionTable_t optiontab[] = {
@@ -152,6 +181,20 @@ optionTable_t optiontab[] = {
    {"loginHost",NULL,(void*)&options.loginHost,    OPTION_STRING,  LOG_NORMAL, NULL, 0},
    {"myeBayHost",NULL,(void*)&options.myeBayHost,  OPTION_STRING,  LOG_NORMAL, NULL, 0},
    {"delay",    "D", (void*)&options.delay,        OPTION_INT,     LOG_NORMAL, NULL, 0},
+   {"daemonSocket","S",(void*)&options.daemonSocket,OPTION_STRING, LOG_NORMAL, NULL, 0},
+   {"reload",  NULL, (void*)&options.reload,       OPTION_BOOL,    LOG_NORMAL, NULL, 0},
+   {"journal",  "j", (void*)&options.journal,      OPTION_STRING,  LOG_NORMAL, NULL, 0},
+   {"trace",    "t", (void*)&options.trace,        OPTION_STRING,  LOG_NORMAL, NULL, 0},
+   {"metrics",  "M", (void*)&options.metrics,      OPTION_STRING,  LOG_NORMAL, NULL, 0},
+   {"rate",    NULL, (void*)&options.rate,         OPTION_INT,     LOG_NORMAL, NULL, 0},
+   {"rateFile",NULL, (void*)&options.rateFile,     OPTION_STRING,  LOG_NORMAL, NULL, 0},
+   {"capture",  "w", (void*)&options.capture,      OPTION_STRING,  LOG_NORMAL, NULL, 0},
+   {"replay",   "W", (void*)&options.replay,       OPTION_STRING,  LOG_NORMAL, NULL, 0},
+   {"status",  NULL, (void*)&options.status,       OPTION_STRING,  LOG_NORMAL, NULL, 0},
+   {"statusTable",NULL, (void*)&options.statusTable, OPTION_STRING, LOG_NORMAL, NULL, 0},
+   {"bulkRefresh",NULL, (void*)&options.bulkRefresh, OPTION_BOOL,  LOG_NORMAL, NULL, 0},
+   {"watchRules",NULL, (void*)&options.watchRules,  OPTION_STRING, LOG_NORMAL, NULL, 0},
+   {"htmlParser",NULL, (void*)&options.htmlParser,  OPTION_STRING, LOG_NORMAL, CheckHtmlParser, 0},
    {NULL,       "?", (void*)&options.usage,        OPTION_BOOL,    LOG_NORMAL, NULL, 0},
    {NULL,       "h", (void*)&options.usage,        OPTION_BOOL,    LOG_NORMAL, SetLongHelp, 0},
    {NULL,       "H", (void*)&options.usage,        OPTION_BOOL,    LOG_NORMAL, SetConfigHelp, 0},
@@ -167,11 +210,28 @@ static void cleanup(void);
 static int usage(int helptype);
 static void printRemain(int remain);
 static void printVersion(void);
+static int readConfig(const char *filename);
+static void watchFiles(void);
+static void reloadFile(const char *filename);
+static void reloadAuctions(auctionInfo **newAuctions, int numNew);
 #define USAGE_SUMMARY	0x01
 #define USAGE_LONG	0x02
 #define USAGE_CONFIG	0x04
 int main(int argc, char *argv[]);
 
+/*
+ * Auctions to snipe, sorted by end time.  Auctions after curAuction
+ * may be changed when the auction file is reloaded.
+ */
+static auctionInfo **auctions = NULL;
+static int numAuctions = 0;
+static int curAuction = -1;
+/* configuration files read at startup, in order */
+static char *confFiles[2];
+static int numConfFiles = 0;
+/* quantity as configured, options.quantity is reduced by items won */
+static int confQuantity = 0;
+
 /* called by CheckAuctionFile, CheckConfigFile */
 static int CheckFile(const void *valueptr, const optionTable_t *tableptr,
 		     const char *filename, const char *line,
@@ -211,6 +271,14 @@ sigTerm(int sig)
 static void
 cleanup()
 {
+	daemonClose();
+	reloadClose();
+	journalClose();
+	traceClose();
+	captureClose();
+	statusClose();
+	governorClose();
+	metricsClose();
 	logClose();
 }
 
@@ -227,7 +295,9 @@ CheckDebug(const void *valueptr, const optionTable_t *tableptr,
 {
 	int val = *((const int*)valueptr);
 
-	val ? logOpen(NULL, options.logdir) : logClose();
+	/* no change, e.g. on reload: keep current log file */
+	if (val != *(int*)(tableptr->value))
+		val ? logOpen(NULL, options.logdir) : logClose();
 	*(int*)(tableptr->value) = val;
 	log(("Debug mode is %s\n", val ? "on" : "off"));
 	return 0;
@@ -335,6 +405,34 @@ CheckQuantity(const void *valueptr, const optionTable_t *tableptr,
 	return 0;
 }
 
+/*
+ * CheckHtmlParser(): select HTML tokenizer
+ *
+ * returns: 0 = OK, else error
+ */
+static int
+CheckHtmlParser(const void *valueptr, const optionTable_t *tableptr,
+		const char *filename, const char *line)
+{
+	const char *name = (const char *)valueptr;
+
+	if (!name || htmlSetTokenizer(name)) {
+		int i;
+
+		if (filename)
+			printLog(stderr, "Unknown HTML parser at \"%s\" in file %s, available:", line, filename);
+		else
+			printLog(stderr, "Unknown HTML parser at option -%s, available:", line);
+		for (i = 0; htmlTokenizers[i]; ++i)
+			printLog(stderr, " %s", htmlTokenizers[i]->name);
+		printLog(stderr, "\n");
+		return 1;
+	}
+	free(*(char **)(tableptr->value));
+	*(char **)(tableptr->value) = myStrdup(name);
+	return 0;
+}
+
 /*
  * CheckUser(): set user
  *
@@ -471,6 +569,181 @@ static int SetConfigHelp(const void *valueptr, const optionTable_t *tableptr,
 	return 0;
 }
 
+/*
+ * readConfig(): read configuration file, remember it for reloading.
+ *
+ * returns: see readConfigFile()
+ */
+static int
+readConfig(const char *filename)
+{
+	int ret = readConfigFile(filename, optiontab);
+
+	if (ret == 0 && numConfFiles < (int)(sizeof(confFiles) / sizeof(confFiles[0])))
+		confFiles[numConfFiles++] = myStrdup(filename);
+	return ret;
+}
+
+/*
+ * Watch configuration and auction files, unless disabled.
+ */
+static void
+watchFiles(void)
+{
+	int i;
+
+	if (!options.reload)
+		return;
+	/* files and sockets opened at startup */
+	setStartupOnly(optiontab, &options.daemonSocket);
+	setStartupOnly(optiontab, &options.journal);
+	setStartupOnly(optiontab, &options.trace);
+	setStartupOnly(optiontab, &options.metrics);
+	setStartupOnly(optiontab, &options.rateFile);
+	setStartupOnly(optiontab, &options.capture);
+	setStartupOnly(optiontab, &options.replay);
+	setStartupOnly(optiontab, &options.status);
+	setStartupOnly(optiontab, &options.statusTable);
+	for (i = 0; i < numConfFiles; ++i)
+		(void)reloadWatch(confFiles[i], reloadFile);
+	if (options.auctfilename)
+		(void)reloadWatch(options.auctfilename, reloadFile);
+}
+
+/*
+ * reloadOptions(): read options again in startup order, so the auction
+ * file still overrides configuration files and the command line overrides
+ * both.  A changed quantity is applied less the items won so far.
+ */
+static void
+reloadOptions(void)
+{
+	int i, quantity = options.quantity;
+
+	options.quantity = confQuantity;
+
+	for (i = 0; i < numConfFiles; ++i)
+		(void)reloadConfigFile(confFiles[i], optiontab);
+	if (options.auctfilename)
+		(void)reloadConfigFile(options.auctfilename, optiontab);
+
+	if (options.quantity != confQuantity) {
+		quantity += options.quantity - confQuantity;
+		confQuantity = options.quantity;
+		printLog(stdout, "Quantity changed to %d item(s)\n",
+			 quantity > 0 ? quantity : 0);
+		metricsGauge(mg_quantity, quantity);
+	}
+	options.quantity = quantity;
+}
+
+/*
+ * reloadFile(): called when a watched file has changed.
+ */
+static void
+reloadFile(const char *filename)
+{
+	auctionInfo **newAuctions = NULL;
+	int numNew;
+
+	reloadOptions();
+	if (!options.auctfilename || strcmp(filename, options.auctfilename))
+		return;
+
+	if ((numNew = readAuctionFile(options.auctfilename, &newAuctions)) < 0) {
+		printLog(stderr, "Auction file %s not reloaded\n", filename);
+		return;
+	}
+	if (options.daemonSocket)
+		daemonReload(newAuctions, numNew);
+	else
+		reloadAuctions(newAuctions, numNew);
+}
+
+/*
+ * reloadAuctions(): apply auction file changes to auctions which have not
+ * been sniped yet.  Unchanged auctions keep their state, prices are
+ * updated in place, and only new auctions are fetched from eBay.
+ * Takes ownership of newAuctions.
+ */
+static void
+reloadAuctions(auctionInfo **newAuctions, int numNew)
+{
+	int i, j, first = curAuction + 1;
+
+	/* drop auctions no longer listed */
+	for (i = curAuction; i < numAuctions; ++i) {
+		for (j = 0; j < numNew; ++j) {
+			if (!strcmp(auctions[i]->auction, newAuctions[j]->auction))
+				break;
+		}
+		if (j < numNew)
+			continue;
+		if (i == curAuction) {
+			printLog(stderr, "Auction %s: is being sniped, not removed\n",
+				 auctions[i]->auction);
+			continue;
+		}
+		printLog(stdout, "Auction %s: removed\n", auctions[i]->auction);
+		freeAuction(auctions[i]);
+		memmove(&auctions[i], &auctions[i + 1],
+			(size_t)(numAuctions - i - 1) * sizeof(auctionInfo *));
+		--numAuctions;
+		--i;
+	}
+
+	for (j = 0; j < numNew; ++j) {
+		auctionInfo *aip = newAuctions[j];
+
+		for (i = 0; i < numAuctions; ++i) {
+			if (!strcmp(auctions[i]->auction, aip->auction))
+				break;
+		}
+		if (i < numAuctions) {
+			/* already sniped auctions are left alone */
+			if (i >= curAuction)
+				(void)updateBidPrice(auctions[i], aip->bidPriceStr);
+			freeAuction(aip);
+			continue;
+		}
+
+		if (options.debug)
+			logOpen(aip, options.logdir);
+		/* delay to avoid ebay's "security measure" */
+		if (options.delay > 0)
+			sleep(options.delay);
+		if (getInfo(aip))
+			;
+		else if (aip->won > 0) {
+			printLog(stdout, "Auction %s: already won %d item(s)\n",
+				 aip->auction, aip->won);
+			if (options.reduce)
+				options.quantity -= aip->won;
+			freeAuction(aip);
+			continue;
+		} else if (aip->endTime <= time(NULL))
+			(void)auctionError(aip, ae_ended, NULL);
+		else if (!isValidBidPrice(aip))
+			(void)auctionError(aip, ae_bidprice, NULL);
+		if (aip->auctionError != ae_none) {
+			printAuctionError(aip, stderr);
+			freeAuction(aip);
+			continue;
+		}
+		auctions = (auctionInfo **)myRealloc(auctions,
+			(size_t)(numAuctions + 1) * sizeof(auctionInfo *));
+		auctions[numAuctions++] = aip;
+		printLog(stdout, "Auction %s: added\n", aip->auction);
+	}
+	free(newAuctions);
+
+	if (numAuctions - first > 1)
+		qsort(&auctions[first], (size_t)(numAuctions - first),
+		      sizeof(auctionInfo *), compareAuctionInfo);
+	if (curAuction >= 0 && options.debug)
+		logOpen(auctions[curAuction], options.logdir);
+}
+
 /*
  * Print number of auctions remaining.
  */
@@ -498,7 +771,10 @@ printVersion(void)
 
 static const char usageSummary[] =
  "usage: %s [-bdhHnmPrUv] [-c conf_file] [-l logdir] [-p proxy] [-q quantity]\n"
- "       [-s secs|now] [-u user] [-D delay] (auction_file | [auction price ...])\n"
+ "       [-s secs|now] [-u user] [-D delay] [-j journal] [-S socket]\n"
+ "       [-t trace_file] [-T trace_file] [-L status_table]\n"
+ "       [-M [host:]port|path] [-w capture_file | -W capture_file]\n"
+ "       (auction_file | [auction price ...])\n"
  "\n";
 
 /* split in two to prevent gcc portability warning.  maximum length is 509 */
@@ -516,8 +792,11 @@ static const char usageLong1[] =
  "-h: command line options help\n"
  "-H: configuration and auction file help\n"
  "-i: get info on auctions and exit\n"
+ "-j: journal file, keeps auction state across restarts\n"
  "-l: log directory (default: ., or directory of auction file, if specified)\n"
+ "-L: list running auctions in status table and exit\n"
  "-m: get my ebay watched items and exit\n"
+ "-M: serve Prometheus metrics on [host:]port or unix socket path\n"
  "-n: do not place bid\n";
 static const char usageLong2[] =
  "-p: http proxy (default: http_proxy environment variable, format is\n"
@@ -527,13 +806,19 @@ static const char usageLong2[] =
  "-r: do not reduce quantity on startup if already won item(s)\n"
  "-s: time to place bid which may be \"now\" or seconds before end of auction\n"
  "    (default is %d seconds before end of auction)\n"
+ "-S: run as daemon, accepting commands on unix domain socket\n"
  "-u: ebay username\n"
  "-U: prompt for ebay username\n";
 static const char usageLong3[] =
+ "-t: write a binary event trace to file\n"
+ "-T: convert a trace file to Chrome trace JSON on stdout and exit\n"
  "-v: print version and exit\n"
+ "-w: record all requests and responses to capture file\n"
+ "-W: replay responses from capture file instead of going online\n"
  "\n"
- "You must specify an auction file or <auction> <price> pair[s].  Options\n"
- "on the command line override settings in auction and configuration files.\n";
+ "You must specify an auction file or <auction> <price> pair[s], unless\n"
+ "you use -S.  Options on the command line override settings in auction\n"
+ "and configuration files.\n";
 
 /* split in two to prevent gcc portability warning.  maximum length is 509 */
 static const char usageConfig1[] =
@@ -541,8 +826,10 @@ static const char usageConfig1[] =
  "  Boolean: (valid values: true,y,yes,on,1,enabled  false,n,no,off,0,disabled)\n"
  "    batch = false\n"
  "    bid = true\n"
+ "    bulkRefresh = false\n"
  "    debug = false\n"
  "    reduce = true\n"
+ "    reload = true\n"
  "  String:\n"
  "    logdir = .\n"
  "    password =\n"
@@ -553,9 +840,21 @@ static const char usageConfig1[] =
  "    bidHost = %s\n"
  "    loginHost = %s\n"
  "    myeBayHost = %s\n"
+ "    daemonSocket =\n"
+ "    htmlParser = builtin\n"
+ "    journal =\n"
+ "    trace =\n"
+ "    metrics =\n"
+ "    capture =\n"
+ "    replay =\n"
+ "    status =\n"
+ "    statusTable = $HOME/" DEFAULT_STATUS_TABLE "\n"
+ "    watchRules =\n"
+ "    rateFile = $HOME/" DEFAULT_RATE_FILE "\n"
  "  Numeric: (seconds may also be \"now\")\n"
  "    delay = 2\n"
  "    quantity = 1\n"
+ "    rate = 30\n"
  "    seconds = %d\n"
  "\n";
 static const char usageConfig2[] =
@@ -565,7 +864,10 @@ static const char usageConfig2[] =
  "An auction file is similar to a configuration file, but it also has one or\n"
  "more auction lines.  An auction line contains an auction number, optionally\n"
  "followed by a bid price.  If no bid price is given, the auction number uses\n"
- "the bid price of the first prior auction line that contains a bid price.\n";
+ "the bid price of the first prior auction line that contains a bid price.\n"
+ "\n"
+ "Changes to configuration and auction files are picked up while esniper\n"
+ "is running, unless reload is false.\n";
 
 static int
 usage(int helplevel)
@@ -591,12 +893,11 @@ int
 main(int argc, char *argv[])
 {
 	int won = 0;	/* number of items won */
-	auctionInfo **auctions = NULL;
-	int c, i, numAuctions = 0, numAuctionsOrig = 0;
+	int c, i, numAuctionsOrig = 0;
 	int XFlag = 0;
 
 	/* all known options */
-	static const char optionstring[]="bc:dhHil:mnp:Pq:rs:u:UvX";
+	static const char optionstring[]="bc:dhHij:l:L:mM:np:Pq:rs:S:t:T:u:Uvw:W:X";
 
 	atexit(cleanup);
 	progname = basename(argv[0]);
@@ -607,6 +908,18 @@ main(int argc, char *argv[])
 	options.bidHost = myStrdup(DEFAULT_BID_HOST);
 	options.loginHost = myStrdup(DEFAULT_LOGIN_HOST);
 	options.myeBayHost = myStrdup(DEFAULT_MYEBAY_HOST);
+#if !defined(WIN32)
+	{
+		char *homedir = getenv("HOME");
+
+		if (homedir && *homedir) {
+			options.rateFile = myStrdup3(homedir, "/",
+						     DEFAULT_RATE_FILE);
+			options.statusTable = myStrdup3(homedir, "/",
+							DEFAULT_STATUS_TABLE);
+		}
+	}
+#endif
 
 	/* first, check for debug, configuration file and auction file
 	 * options but accept all other options to avoid error messages
@@ -638,6 +951,12 @@ main(int argc, char *argv[])
 			printVersion();
 			exit(0);
 			break;
+		case 'T': /* convert trace file */
+			exit(traceConvert(optarg, stdout));
+			break;
+		case 'L': /* list status table */
+			exit(statusList(optarg, stdout));
+			break;
 		default:
 			/* ignore other options, these will be parsed
 			 * after configuration and auction files.
@@ -649,8 +968,11 @@ main(int argc, char *argv[])
 	if (options.usage)
 		exit(usage(options.usage));
 
-	/* One argument after options?  Must be an auction file. */
-	if ((argc - optind) == 1) {
+	/*
+	 * One argument after options?  Must be an auction file, unless
+	 * testing the parser on a batch of pages.
+	 */
+	if ((argc - optind) == 1 && !XFlag) {
 		if (parseGetoptValue('f', argv[optind], optiontab)) {
 			options.usage |= USAGE_SUMMARY;
 			exit(usage(options.usage));
@@ -662,7 +984,7 @@ main(int argc, char *argv[])
 	 * configuration file (i.e. $HOME/.esniper, etc).
 	 */
 	if (options.conffilename) {
-		if (readConfigFile(options.conffilename, optiontab) > 1)
+		if (readConfig(options.conffilename) > 1)
 			options.usage |= USAGE_SUMMARY;
 	} else {
 		/* TODO: on UNIX use getpwuid() to find the home dir? */
@@ -676,14 +998,14 @@ main(int argc, char *argv[])
 						 "\\My Documents\\",
 						 DEFAULT_CONF_FILE);
 
-			switch (readConfigFile(cfname, optiontab)) {
+			switch (readConfig(cfname)) {
 			case 1: /* file not found */
 				if (homedir && *homedir) {
 					/* parse $HOME/.esniper */
 					free(cfname);
 					cfname = myStrdup3(homedir, "/",
 							   DEFAULT_CONF_FILE);
-					if (readConfigFile(cfname, optiontab) > 1)
+					if (readConfig(cfname) > 1)
 						options.usage |= USAGE_SUMMARY;
 				}
 				break;
@@ -699,7 +1021,7 @@ main(int argc, char *argv[])
 		if (homedir && *homedir) {
 			/* parse $HOME/.esniper */
 			char *cfname = myStrdup3(homedir,"/",DEFAULT_CONF_FILE);
-			if (readConfigFile(cfname, optiontab) > 1)
+			if (readConfig(cfname) > 1)
 				options.usage |= USAGE_SUMMARY;
 			free(cfname);
 		} else
@@ -711,7 +1033,7 @@ main(int argc, char *argv[])
 			char *auctfilename = myStrdup(options.auctfilename);
 			char *cfname = myStrdup3(dirname(auctfilename), "/", DEFAULT_CONF_FILE);
 
-			if (readConfigFile(cfname, optiontab) > 1)
+			if (readConfig(cfname) > 1)
 				options.usage |= USAGE_SUMMARY;
 			free(auctfilename);
 			free(cfname);
@@ -738,11 +1060,17 @@ main(int argc, char *argv[])
 	 */
 	while ((c = getopt(argc, argv, optionstring)) != EOF) {
 		switch (c) {
+		case 'j': /* journal */
 		case 'l': /* log directory */
 		case 'p': /* proxy */
 		case 'q': /* quantity */
 		case 's': /* seconds */
+		case 'M': /* metrics address */
+		case 'S': /* daemon control socket */
+		case 't': /* trace file */
 		case 'u': /* user */
+		case 'w': /* capture file */
+		case 'W': /* replay file */
 			if (parseGetoptValue(c, optarg, optiontab))
 				options.usage |= USAGE_SUMMARY;
 			break;
@@ -786,6 +1114,20 @@ main(int argc, char *argv[])
 	log(("options.usage=%d\n", options.usage));
 	log(("options.info=%d\n", options.info));
 	log(("options.myitems=%d\n", options.myitems));
+	log(("options.daemonSocket=%s\n", nullStr(options.daemonSocket)));
+	log(("options.journal=%s\n", nullStr(options.journal)));
+	log(("options.trace=%s\n", nullStr(options.trace)));
+	log(("options.metrics=%s\n", nullStr(options.metrics)));
+	log(("options.rate=%d\n", options.rate));
+	log(("options.rateFile=%s\n", nullStr(options.rateFile)));
+	log(("options.capture=%s\n", nullStr(options.capture)));
+	log(("options.replay=%s\n", nullStr(options.replay)));
+	log(("options.status=%s\n", nullStr(options.status)));
+	log(("options.statusTable=%s\n", nullStr(options.statusTable)));
+	log(("options.bulkRefresh=%d\n", options.bulkRefresh));
+	log(("options.watchRules=%s\n", nullStr(options.watchRules)));
+	log(("options.htmlParser=%s\n", nullStr(options.htmlParser)));
+	confQuantity = options.quantity;
 
 	if (!options.usage) {
 		if (!XFlag) {
@@ -800,6 +1142,8 @@ main(int argc, char *argv[])
 					printLog(stderr, "Error: auctions specified with -m option.\n");
 					options.usage |= USAGE_SUMMARY;
 				}
+			} else if (options.daemonSocket && argc == 0) {
+				/* daemon may start with empty queue */
 			} else if (argc < 2) {
 				printLog(stderr, "Error: no auctions specified.\n");
 				options.usage |= USAGE_SUMMARY;
@@ -828,14 +1172,15 @@ main(int argc, char *argv[])
 		}
 	}
 
-	if (XFlag) {
-		testParser(XFlag);
-		exit(0);
-	}
+	if (XFlag)
+		exit(testParser(XFlag, argc, argv));
 
 	if (options.usage)
 		exit(usage(options.usage));
 
+	if (governorOpen(options.rateFile))
+		exit(1);
+
 	/* init variables */
 	if (options.auctfilename) {
 		numAuctions = readAuctionFile(options.auctfilename, &auctions);
@@ -846,10 +1191,23 @@ main(int argc, char *argv[])
 			auctions[i] = newAuctionInfo(argv[2*i], argv[2*i+1]);
 	}
 
+	if (options.replay ? replayOpen(options.replay) :
+	    options.capture && captureOpen(options.capture))
+		exit(1);
  	if (options.myitems)
 		exit(printMyItems());
-	if (numAuctions <= 0)
+	if (numAuctions < 0 || (numAuctions == 0 && !options.daemonSocket))
 		exit(usage(USAGE_SUMMARY));
+	if (options.journal && journalOpen(options.journal))
+		exit(1);
+	if (options.trace && traceOpen(options.trace))
+		exit(1);
+	if (options.metrics && metricsOpen(options.metrics))
+		exit(1);
+	if (options.status && statusOpen(options.status))
+		exit(1);
+	if (statusTableOpen(options.statusTable))
+		exit(1);
 
 #if !defined(WIN32)
 	signal(SIGALRM, sigAlarm);
@@ -858,6 +1216,11 @@ main(int argc, char *argv[])
 #endif
 	signal(SIGTERM, sigTerm);
 
+	if (options.daemonSocket) {
+		watchFiles();
+		exit(daemonRun(options.daemonSocket, auctions, numAuctions));
+	}
+
 	numAuctionsOrig = numAuctions;
 	{
 		int quantity = options.quantity;
@@ -882,22 +1245,23 @@ main(int argc, char *argv[])
 	}
 
     int idx_unprocessed = 0;
-    int j = 0;
+	watchFiles();
 	for (i = 0; i < numAuctions && options.quantity > 0; i ++) {
+		curAuction = i;
+		metricsGauge(mg_auctions, numAuctions - i);
+		metricsGauge(mg_quantity, options.quantity);
 		if (numAuctionsOrig > 1)
 			printRemain(numAuctions - i);
 		snipeAuction(auctions[i]);
         /* check the current time and postpone the won checking if there's no enough time to bid others! */
         /* There's around 4 seconds to finish bid for an item. */
-        for (j = idx_unprocessed;
-              (j <= i)
-              && ((options.quantity < 1)
-                  || (i + 1 >= numAuctions)
-                  || ((i + 1 < numAuctions)
-                      && (auctions[i+1]->endTime - options.bidtime > time(NULL) + 20 )));
-            j ++) {
-            won += checkWonAuction(auctions[j]);
-            idx_unprocessed ++;
+        /* All postponed auctions are checked in one go. */
+        if ((options.quantity < 1)
+            || (i + 1 >= numAuctions)
+            || (auctions[i+1]->endTime - options.bidtime > time(NULL) + 20 )) {
+            won += checkWonAuctions(&auctions[idx_unprocessed], i + 1 - idx_unprocessed,
+                                    i + 1 < numAuctions ? auctions[i+1]->endTime - options.bidtime : 0);
+            idx_unprocessed = i + 1;
         }
 	}
 	for (i = 0; i < numAuctions && options.quantity > 0; ++i)
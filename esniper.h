@@ -56,6 +56,20 @@ typedef struct {
 	char *myeBayHost;
 	int curldebug;
 	int delay;
+	char *daemonSocket;
+	int reload;
+	char *journal;
+	char *trace;
+	char *metrics;
+	int rate;
+	char *rateFile;
+	char *capture;
+	char *replay;
+	char *status;
+	char *statusTable;
+	int bulkRefresh;
+	char *watchRules;
+	char *htmlParser;
 } option_t;
 
 extern option_t options;
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Request rate governor.
+ *
+ * The bucket holds up to GOV_BURST tokens and is refilled at options.rate
+ * tokens per minute.  A request takes one token.  Requests of priority p
+ * are only sent while at least 1 + govReserve[p] tokens are left, so a
+ * burst of info requests can't starve a bid key request.  Bids take their
+ * token even if there is none (the bucket may go negative), which slows
+ * down everybody else instead of the bid.
+ *
+ * When eBay shows a captcha or "security measure" page, requests below
+ * preBid priority are paused for GOV_BACKOFF seconds, doubling with each
+ * repeat up to GOV_BACKOFF_MAX.  The pause never delays a request past
+ * the deadline set by governorDeadline(), the time the next bid is due,
+ * and a pause set by another process is ignored if it would last beyond
+ * the deadline: that process' captcha is no reason to miss our snipe.
+ * Waits of a second or more are spent in daemonSleep(), which serves the
+ * control socket and reloads changed files meanwhile.
+ *
+ * The state lives in a memory mapped file, locked with flock() while it is
+ * updated, so all esniper processes of a user share one bucket.  Without
+ * the file (or on WIN32) the state is private to the process.
+ */
+
+#include "governor.h"
+#include "capture.h"
+#include "daemon.h"
+#include "esniper.h"
+#include "util.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(WIN32)
+#	include <sys/timeb.h>
+#	define sleepMsec(ms) _sleep(ms)
+#else
+#	include <fcntl.h>
+#	include <sys/file.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <sys/time.h>
+#	include <unistd.h>
+#endif
+
+#define GOV_BURST 10.0
+#define GOV_BACKOFF 60
+#define GOV_BACKOFF_MAX 3600
+/* longest single sleep while waiting for a token */
+#define GOV_MAXWAIT 5.0
+#define GOV_MAGIC 0x45534e47UL	/* "ESNG" */
+
+typedef struct {
+	unsigned long magic;
+	double tokens;
+	double updated;		/* time of last refill */
+	double pausedUntil;	/* backoff after captcha */
+	double lastBackoff;
+	int backoffLevel;
+} govState_t;
+
+/* tokens to leave for higher priorities */
+static const double govReserve[] = {
+	0.0,	/* bid, not used */
+	0.0,	/* preBid */
+	3.0,	/* getInfo */
+	6.0,	/* myItems */
+};
+
+static govState_t localState = { GOV_MAGIC, GOV_BURST, 0.0, 0.0, 0.0, 0 };
+static govState_t *state = &localState;
+/* pause set by this process, and time the next bid is due */
+static double ownPause = 0.0;
+static time_t govDeadline = 0;
+#if !defined(WIN32)
+static int govFd = -1;
+#endif
+
+static double govTime(void);
+static void govLock(void);
+static void govUnlock(void);
+static void govRefill(double now);
+static double govPause(double now);
+
+static double
+govTime(void)
+{
+#if defined(WIN32)
+	struct timeb tb;
+
+	ftime(&tb);
+	return (double)tb.time + (double)tb.millitm / 1000.0;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+#endif
+}
+
+#if defined(WIN32)
+int
+governorOpen(const char *filename)
+{
+	return 0;
+}
+
+void
+governorClose(void)
+{
+}
+
+static void
+govLock(void)
+{
+}
+
+static void
+govUnlock(void)
+{
+}
+
+#else /* !WIN32 */
+
+static void
+sleepMsec(long msec)
+{
+	struct timespec ts;
+
+	ts.tv_sec = msec / 1000;
+	ts.tv_nsec = (msec % 1000) * 1000000L;
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+/*
+ * governorOpen(): share governor state through filename.  An empty
+ * filename keeps the state private.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+governorOpen(const char *filename)
+{
+	struct stat sb;
+	void *p;
+
+	if (!filename || !*filename)
+		return 0;
+	if ((govFd = open(filename, O_RDWR | O_CREAT, 0600)) < 0) {
+		printLog(stderr, "Cannot open rate file %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+	govLock();
+	if (fstat(govFd, &sb) || ((size_t)sb.st_size < sizeof(govState_t) &&
+	    ftruncate(govFd, (off_t)sizeof(govState_t)))) {
+		printLog(stderr, "Cannot set up rate file %s: %s\n", filename,
+			 strerror(errno));
+		govUnlock();
+		close(govFd);
+		govFd = -1;
+		return 1;
+	}
+	p = mmap(NULL, sizeof(govState_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+		 govFd, 0);
+	if (p == MAP_FAILED) {
+		printLog(stderr, "Cannot map rate file %s: %s\n", filename,
+			 strerror(errno));
+		govUnlock();
+		close(govFd);
+		govFd = -1;
+		return 1;
+	}
+	state = (govState_t *)p;
+	/* new file, or written by an incompatible version */
+	if (state->magic != GOV_MAGIC)
+		*state = localState;
+	govUnlock();
+	log(("governorOpen(): sharing request rate through %s\n", filename));
+	return 0;
+}
+
+void
+governorClose(void)
+{
+	if (govFd < 0)
+		return;
+	munmap((void *)state, sizeof(govState_t));
+	state = &localState;
+	close(govFd);
+	govFd = -1;
+}
+
+static void
+govLock(void)
+{
+	if (govFd >= 0)
+		while (flock(govFd, LOCK_EX) && errno == EINTR)
+			;
+}
+
+static void
+govUnlock(void)
+{
+	if (govFd >= 0)
+		flock(govFd, LOCK_UN);
+}
+
+#endif /* !WIN32 */
+
+/*
+ * Add tokens for the time since the last refill.  Caller holds lock.
+ */
+static void
+govRefill(double now)
+{
+	if (options.rate > 0 && now > state->updated) {
+		state->tokens += (now - state->updated) * options.rate / 60.0;
+		if (state->tokens > GOV_BURST)
+			state->tokens = GOV_BURST;
+	}
+	state->updated = now;
+}
+
+/*
+ * Seconds left of a captcha pause, up to the deadline.  Caller holds lock.
+ */
+static double
+govPause(double now)
+{
+	double until = state->pausedUntil;
+
+	if (until <= now)
+		return 0.0;
+	if (govDeadline) {
+		/* another process' pause, lasting beyond our bid */
+		if (until > ownPause && until > (double)govDeadline)
+			return 0.0;
+		if (until > (double)govDeadline)
+			until = (double)govDeadline;
+	}
+	return until > now ? until - now : 0.0;
+}
+
+void
+governorAcquire(enum govPriority prio)
+{
+	int logged = 0;
+
+	/* replayed requests don't go to eBay */
+	if (replayActive())
+		return;
+	for (;;) {
+		double now = govTime();
+		double wait;
+
+		govLock();
+		govRefill(now);
+		if (prio > gp_preBid && (wait = govPause(now)) > 0.0)
+			;
+		else if (prio == gp_bid || options.rate <= 0 ||
+			 state->tokens >= 1.0 + govReserve[prio]) {
+			state->tokens -= 1.0;
+			if (state->tokens < -GOV_BURST)
+				state->tokens = -GOV_BURST;
+			govUnlock();
+			return;
+		} else
+			wait = (1.0 + govReserve[prio] - state->tokens) *
+				60.0 / options.rate;
+		govUnlock();
+
+		if (!logged && wait >= 1.0) {
+			log(("governorAcquire(): priority %d waits %.1f seconds\n",
+			     prio, wait));
+			logged = 1;
+		}
+		if (wait > GOV_MAXWAIT)
+			wait = GOV_MAXWAIT;
+		if (wait >= 1.0)
+			daemonSleep((unsigned int)wait);
+		else
+			sleepMsec((long)(wait * 1000.0) + 1);
+	}
+}
+
+time_t
+governorDeadline(time_t when)
+{
+	time_t prev = govDeadline;
+
+	govDeadline = when;
+	return prev;
+}
+
+void
+governorBackoff(void)
+{
+	double now = govTime();
+	int seconds;
+
+	govLock();
+	seconds = GOV_BACKOFF << state->backoffLevel;
+	/* a quiet period twice as long as the last pause resets backoff */
+	if (now - state->lastBackoff > 2.0 * seconds)
+		state->backoffLevel = 0;
+	else if (seconds < GOV_BACKOFF_MAX)
+		++state->backoffLevel;
+	seconds = GOV_BACKOFF << state->backoffLevel;
+	if (seconds > GOV_BACKOFF_MAX)
+		seconds = GOV_BACKOFF_MAX;
+	state->lastBackoff = now;
+	if (state->pausedUntil < now + seconds)
+		state->pausedUntil = now + seconds;
+	ownPause = state->pausedUntil;
+	state->tokens = 0.0;
+	govUnlock();
+	printLog(stderr, "%s: eBay security check, pausing requests for %d seconds\n",
+		 timestamp(), seconds);
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GOVERNOR_H_INCLUDED
+#define GOVERNOR_H_INCLUDED
+
+#include <time.h>
+
+/*
+ * Request rate governor: a token bucket for all requests to eBay, shared
+ * by all esniper processes of a user through a small memory mapped file.
+ * Higher priority requests may use tokens that lower priority ones must
+ * leave alone; bids are never delayed.
+ */
+enum govPriority {
+	gp_bid,
+	gp_preBid,	/* bid key and login */
+	gp_getInfo,
+	gp_myItems,	/* watch list, version check */
+	/* gp_last must be last */
+	gp_last
+};
+
+extern int governorOpen(const char *filename);
+extern void governorClose(void);
+/* wait until a request of the given priority may be sent */
+extern void governorAcquire(enum govPriority prio);
+/* requests don't wait for a pause beyond when, the time the next bid
+ * is due; 0 if no bid is due.  Returns the previous deadline. */
+extern time_t governorDeadline(time_t when);
+/* eBay showed a captcha or "security measure" page */
+extern void governorBackoff(void);
+
+#endif /* GOVERNOR_H_INCLUDED */
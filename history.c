@@ -26,20 +26,138 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "html.h"
 #include "auction.h"
 #include "auctioninfo.h"
+#include "bidlog.h"
 #include "history.h"
 #include "esniper.h"
+#include "json.h"
+#include "metrics.h"
+
+typedef enum phtype { phclassic, ph201702, phunknown } phtype;
+
+/*
+ * Sections of the bid history page.  A section is not parsed again if its
+ * bytes are the same as on the last parse of the auction.
+ */
+enum historySection {
+	hs_header,	/* item number and title */
+	hs_details,	/* price, quantity, shipping */
+	hs_table,	/* bid history table */
+	/* hs_last must be last */
+	hs_last
+};
+
+static const char *const historySectionName[] = {
+	"header",
+	"details",
+	"bid table",
+};
+
+/*
+ * Results of the last full parse of each section, kept in the arena of
+ * the auction.  The bid table also depends on the state of the auction,
+ * see tableKey().
+ */
+struct historyCache {
+	unsigned long hash[hs_last];	/* 0 = nothing cached */
+	clock_t cpu[hs_last];		/* cost of the last full parse */
+	size_t bytes[hs_last];
+	/* details */
+	int got;
+	double price;
+	int reserve;
+	int quantity;
+	/* bid table */
+	unsigned long key;
+	int bids;
+	int quantityBid;
+	double tablePrice;
+	int tableQuantity;
+	int won;
+	int winning;
+	char report[512];	/* output of the bid table parse */
+};
+
+typedef struct {
+	clock_t cpu;
+	size_t bytes;
+} sectionCost_t;
+
+/*
+ * Item state in JSON embedded in the page, see json.c.  Only scripts that
+ * mention the auction number are read, the page also has JSON of other
+ * items (similar items, adverts).  JSON wins if the two disagree, the HTML
+ * fills in what the JSON lacks.
+ */
+enum jsonItem {
+	ji_price,
+	ji_currency,
+	ji_endTime,
+	ji_bids,
+	ji_quantity,
+	/* ji_last must be last */
+	ji_last
+};
+
+static const char *const jsonPaths[] = {
+	/* not just "price", that is in every advert too */
+	"currentPrice.value|currentBidPrice.value",
+	"currentPrice.currency|currentBidPrice.currency",
+	"endTime.value|endTime|endDate.value|endDate",
+	"bidCount|numBids|totalBids",
+	"quantityAvailable|availableQuantity|remainingQuantity",
+	NULL
+};
 
-static long getSeconds(char *timestr);
 static int checkPageType(auctionInfo *aip, int pageType, int auctionState, int auctionResult);
 static int parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t start, int debugMode);
+static int parseHeader(memBuf_t *mp, auctionInfo *aip, int debugMode);
+static int parseDetails(memBuf_t *mp, auctionInfo *aip, int have, int *got);
+static void pageJson(const char *page, const char *auction, jsonValue_t *json);
+static const char *findNumber(const char *start, const char *end, const char *number);
+static int jsonDetails(arena_t *ap, auctionInfo *aip, const jsonValue_t *json, double *price, int *quantity);
+static void mergeDetails(auctionInfo *aip, int have, double price, int quantity, int *got);
+static int hasTimeLeft(memBuf_t *mp);
+static int parseTimeLeft(memBuf_t *mp, auctionInfo *aip);
+static int64_t pageEndTime(const char *page, time_t start, const jsonValue_t *vp, int *scoped);
+static int64_t endTimeValue(const char *s, time_t start);
+static int64_t isoTime(const char *s);
+static int endTimeAgrees(int64_t endTimeMs, time_t start, time_t remain);
+static void setEndTime(auctionInfo *aip, int64_t endTimeMs, time_t start);
+static int parseBidTable(memBuf_t *mp, auctionInfo *aip, phtype pagetype, int pageType, int auctionState, int auctionResult, const char **tablePos);
+static int logBidRow(arena_t *ap, auctionInfo *aip, phtype pagetype, char **row, const char *bidder);
+static void tablePrint(const char *fmt, ...);
+static struct historyCache *getHistoryCache(auctionInfo *aip);
+static unsigned long hashBytes(unsigned long h, const char *s, const char *end);
+static unsigned long hashValue(unsigned long h, const jsonValue_t *vp);
+static const char *skipTexts(const char *s, int n);
+static const char *findMarker(const char *page, const char *const *markers);
+static unsigned long headerHash(const char *page);
+static unsigned long detailsHash(const char *page);
+static unsigned long tableHash(const char *page, phtype pagetype, const char **tablePos);
+static unsigned long tableKey(auctionInfo *aip, phtype pagetype, int pageType, int auctionState, int auctionResult);
+static int sectionSame(struct historyCache *hc, enum historySection s, unsigned long hash);
+static void sectionStart(sectionCost_t *cp, arena_t *ap, auctionInfo *aip);
+static void sectionDone(struct historyCache *hc, enum historySection s, unsigned long hash, sectionCost_t *cp, arena_t *ap, auctionInfo *aip);
 
 static const char PRIVATE[] = "private auction - bidders' identities protected";
 
+/* output of the bid table parse, see tablePrint() */
+static char *tableReport = NULL;
+static size_t tableReportLen = 0;
+
+/* parse cost saved by skipping sections, for the log */
+static clock_t savedCpu = 0;
+static size_t savedBytes = 0;
+
 /* pageType */
 #define VIEWBIDS 1
 #define VIEWTRANSACTIONS 2
@@ -77,10 +195,9 @@ parseBidHistory(memBuf_t *mp, auctionInfo *aip, time_t start, time_t *timeToFirs
 	if (timeToFirstByte)
 		*timeToFirstByte = getTimeToFirstByte(mp);
 
-	if ((pp = getPageInfo(mp))) {
+	if ((pp = getPageInfo(mp)))
 		ret = parseBidHistoryInternal(pp, mp, aip, start, debugMode);
-		freePageInfo(pp);
-	} else {
+	else {
 		log(("parseBidHistory(): pageinfo is NULL\n"));
 		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "pageInfo is NULL");
 		ret = auctionError(aip, ae_notitle, NULL);
@@ -91,24 +208,30 @@ parseBidHistory(memBuf_t *mp, auctionInfo *aip, time_t start, time_t *timeToFirs
 int
 parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t start, int debugMode)
 {
+	arena_t *ap = memArena(mp);
 	char *line;
-	char **row = NULL;
 	int ret = 0;		/* 0 = OK, 1 = failed */
-	int foundHeader = 0;	/* found bid history table header */
 	int pageType = 0;
 	int auctionState = 0;
 	int auctionResult = 0;
 	int got;
 	const char *delim = "_";
-	typedef enum phtype { phclassic, ph201702, phunknown } phtype;
 	phtype pagetype = phunknown;
+	struct historyCache *hc = debugMode ? NULL : getHistoryCache(aip);
+	sectionCost_t cost;
+	unsigned long hash, key;
+	const char *tableStart = NULL, *tablePos = NULL;
+	char report[sizeof(hc->report)];
+	int64_t endTimeMs;
+	int scoped = 0;
+	jsonValue_t json[ji_last];
 
 	if ((pp->srcId && !strcmp(pp->srcId, "Captcha.xsl")) ||
 		(pp->pageName && !strncmp(pp->pageName, "Security Measure", 16)))
 		return auctionError(aip, ae_captcha, NULL);
 	if (pp->pageName && ( !strncmp(pp->pageName, "PageViewBids", 12) ||
 			      !strncasecmp(pp->pageName, "Bid History", 11) )) {
-		char *tmpPagename = myStrdup(pp->pageName);
+		char *tmpPagename = myStrdupIn(ap, pp->pageName);
 		char *token;
 
 		if (!strncasecmp(pp->pageName, "Bid History", 11))
@@ -131,7 +254,6 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 				else if(!strcmp(token, "Outbid")) auctionResult = RESULT_OUTBID;
 			}
 		}
-		free(tmpPagename);
 
 		/* bid history or expired/bad auction number */
 		while ((line = getNonTag(mp))) {
@@ -154,162 +276,198 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 		return auctionError(aip, ae_notitle, NULL);
 	}
 
-	/* Auction number */
-	memReset(mp);
-	if (memStr(mp, "\"BHCtBidLabel\"") ||
-		memStr(mp, "\"vizItemNum\"") ||
-		memStr(mp, "\"BHitemNo\"")) { /* obsolete as of 2.22 */
-		memChr(mp, '>');
-		memSkip(mp, 1);
-		line = getNonTag(mp);	/* Item number: */
-		line = getNonTag(mp);	/* number */
-		if (!line) {
-			log(("parseBidHistory(): No item number"));
-			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "no item number");
-			return auctionError(aip, ae_baditem, NULL);
-		}
-	} else if (memStr(mp, ">Item number:<")) {
-                line = getNonTag(mp);   /* Item number: */
-                line = getNonTag(mp);   /* number */
-		if (!line) {
-                        log(("parseBidHistory(): No item number"));
-                        bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "no item number");
-                        return auctionError(aip, ae_baditem, NULL);
-		}
-	} else {
-		log(("parseBidHistory(): BHitemNo not found"));
-		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "no item number");
-		return auctionError(aip, ae_baditem, NULL);
-	}
-	if (debugMode) {
-		free(aip->auction);
-		aip->auction = myStrdup(line);
-	} else {
-		if (strcmp(aip->auction, line)) {
-			log(("parseBidHistory(): auction number %s does not match given number %s", line, aip->auction));
-			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "mismatched item number");
-			return auctionError(aip, ae_baditem, NULL);
-		}
-	}
+	/* item state embedded in scripts */
+	pageJson(mp->memory, aip->auction, json);
 
-	/* Auction title */
-	memReset(mp);
-	if (memStr(mp, "\"itemTitle\"") ||
-		memStr(mp, "\"BHitemTitle\"") || /* obsolete as of 2.22 */
-		memStr(mp, "\"BHitemDesc\"")) {	/* obsolete before 2.22 */
-		memChr(mp, '>');
-		memSkip(mp, 1);
-		line = getNonTag(mp);	/* Item title: */
-		line = getNonTag(mp);	/* title */
-		if (!line) {
-			log(("parseBidHistory(): No item title"));
-			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title not found");
-			return auctionError(aip, ae_baditem, NULL);
-		}
-	/* Active auction */
-        } else if (memStr(mp, ">Item info<")) {
-                line = getNonTag(mp);   /* Item title: */
-                line = getNonTag(mp);   /* title */
-                if (!line) {
-                        log(("parseBidHistory(): No item title"));
-                        bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title not found");
-        	}
-	/* Post bid */
-        } else if (memStr(mp, "\"offer-title-top_panel_main\"")) {
-		memChr(mp, '>');
-		memSkip(mp, 1);
-                line = getNonTag(mp);   /* title */
-                if (!line) {
-                        log(("parseBidHistory(): No item title"));
-                        bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title not found");
-                }
-	} else {
-		log(("parseBidHistory(): BHitemTitle not found"));
-		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title or description not found");
-		return auctionError(aip, ae_baditem, NULL);
+	/* Auction number and title */
+	hash = headerHash(mp->memory);
+	if (!sectionSame(hc, hs_header, hash)) {
+		sectionStart(&cost, ap, aip);
+		if (parseHeader(mp, aip, debugMode))
+			return 1;
+		sectionDone(hc, hs_header, hash, &cost, ap, aip);
 	}
-	free(aip->title);
-	aip->title = myStrdup(line);
 	printLog(stdout, "Auction %s: %s\n", aip->auction, aip->title);
 	printLog(stdout, "Auction URL: http://www.ebay.com/itm/%s\n", aip->auction);
 
 	/* price, shipping, quantity */
-	memReset(mp);
-	aip->quantity = 1;	/* If quantity not found, assume 1 */
-	got = NOTHING;
-	while (got != EVERYTHING && memStr(mp, "\"BHCtBid\"")) {
-		memChr(mp, '>');
-		memSkip(mp, 1);
-		line = getNonTag(mp);
-
-		/* Can sometimes get starting bid, but that's not the price
-		 * we are looking for.
-		 */
-		if (!strcasecmp(line, "Current bid:") ||
-		    !strcasecmp(line, "Winning bid:") ||
-		    !strcasecmp(line, "Your maximum bid:") ||
-		    !strcasecmp(line, "price:")) {
-			char *saveptr;
-			const char *priceStr;
-
-			line = getNonTag(mp);
-			if (!line) {
-				bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item price not found");
-				return auctionError(aip, ae_noprice, NULL);
-			}
-			log(("Currently: %s\n", line));
-			priceStr = priceFixup(line, aip);
-			aip->price = priceStr ? atof(priceStr) : -1.0;
-			if (aip->price < 0.01) {
-				bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item price could not be converted");
-				return auctionError(aip, ae_convprice, line);
-			}
-			got |= PRICE;
+	hash = detailsHash(mp->memory);
+	if (hash) {
+		/* values used by jsonDetails() */
+		hash = hashValue(hash, &json[ji_price]);
+		hash = hashValue(hash, &json[ji_currency]);
+		hash = hashValue(hash, &json[ji_quantity]);
+	}
+	if (sectionSame(hc, hs_details, hash)) {
+		if (hc->got & PRICE) {
+			aip->price = hc->price;
+			aip->reserve = hc->reserve;
+		}
+		aip->quantity = hc->quantity;
+	} else {
+		sectionStart(&cost, ap, aip);
+		double jsonPrice;
+		int jsonQuantity;
+		int have = jsonDetails(ap, aip, json, &jsonPrice, &jsonQuantity);
 
-			/* reserve not met? */
-			saveptr = mp->readptr;
-			line = getNonTag(mp);
-			aip->reserve = !strcasecmp(line, "Reserve not met");
-			if (!aip->reserve)
-				mp->readptr = saveptr;
-		} else if (!strcasecmp(line, "Quantity:")) {
-			line = getNonTag(mp);
-			if (!line) {
-				bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item quantity not found");
-				return auctionError(aip, ae_noquantity, NULL);
-			}
-			errno = 0;
-			if (isdigit(*line)) {
-				aip->quantity = (int)strtol(line, NULL, 10);
-				if (aip->quantity < 0 || (aip->quantity == 0 && errno == EINVAL)) {
-					bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item quantity could not be converted");
-					return auctionError(aip, ae_noquantity, NULL);
-				}
-			} else
-				aip->quantity = 1;
-			log(("quantity: %d", aip->quantity));
-			got |= QUANTITY;
-		} else if (!strcasecmp(line, "Shipping:")) {
-			line = getNonTag(mp);
-			if (line) {
-				free(aip->shipping);
-				aip->shipping = myStrdup(line);
-			}
-			got |= SHIPPING;
+		if (parseDetails(mp, aip, have, &got))
+			return 1;
+		mergeDetails(aip, have, jsonPrice, jsonQuantity, &got);
+		if (hc) {
+			hc->got = got;
+			hc->price = aip->price;
+			hc->reserve = aip->reserve;
+			hc->quantity = aip->quantity;
 		}
+		sectionDone(hc, hs_details, hash, &cost, ap, aip);
 	}
 
 	/* Time Left */
+	aip->endTimeMs = 0;
+	endTimeMs = debugMode ? 0 : pageEndTime(mp->memory, start, &json[ji_endTime], &scoped);
 	memReset(mp);
 	if (aip->quantity == 0 || memCaseStr(mp, "Time Ended:")) {
 		free(aip->remainRaw);
 		aip->remainRaw = myStrdup("--");
 		aip->remain = 0;
-	} else if (memStr(mp, ">Time left:<")) {
-		char* days = myMalloc(12);
-		char* hours = myMalloc(12);
-		char* minutes = myMalloc(12);
-		char* seconds = myMalloc(12);	
+	} else if (endTimeMs && scoped && !hasTimeLeft(mp)) {
+		/* no countdown to check against, trust this item's end time */
+		printLog(stderr, "Auction %s: no countdown on page, using end time %ld\n",
+			 aip->auction, (long)(endTimeMs / 1000));
+		setEndTime(aip, endTimeMs, start);
+	} else if (parseTimeLeft(mp, aip))
+		return 1;
+	else if (endTimeMs) {
+		if (endTimeAgrees(endTimeMs, start, aip->remain)) {
+			log(("Auction %s: end time is %+.3f seconds off countdown %s\n",
+			     aip->auction, endTimeMs / 1000.0 - (double)(start + aip->remain),
+			     aip->remainRaw));
+			setEndTime(aip, endTimeMs, start);
+		} else
+			printLog(stderr, "Auction %s: end time %ld.%03d is %+.3f seconds off countdown %s, using countdown\n",
+				 aip->auction, (long)(endTimeMs / 1000), (int)(endTimeMs % 1000),
+				 endTimeMs / 1000.0 - (double)(start + aip->remain), aip->remainRaw);
+	}
+	printLog(stdout, "Time remaining: %s (%ld seconds)\n", aip->remainRaw, aip->remain);
+	if (aip->remain) {
+		struct tm *tmPtr;
+		char timestr[20];
+
+		aip->endTime = aip->endTimeMs ?
+			(time_t)(aip->endTimeMs / 1000) : start + aip->remain;
+		/* formated time/date output */
+		tmPtr = localtime(&(aip->endTime));
+		strftime(timestr , 20, "%Y-%m-%d %H:%M:%S", tmPtr);
+		if (!debugMode)
+			printLog(stdout, "End time: %s\n", timestr);
+	} else
+		aip->endTime = aip->remain;
+
+	/* bid history */
+	aip->bids = -1;
+	line = NULL;
+	memReset(mp);
+	if (memStr(mp, "ViewBids:")) {	/* Skip over 'ViewBids' */
+		line = 	getNonTag(mp);
+	} else {
+		memReset(mp);
+	}
+	line = NULL;
+	if (memStr(mp, "Bids:")) {
+		line = getNonTag(mp);	/* Bids: */
+		line = getNonTag(mp);	/* number */
+	}
+	if (json[ji_bids].value) {
+		char *jsonBids = jsonString(ap, &json[ji_bids]);
+
+		if (isdigit((int)*jsonBids)) {
+			if (line && strtol(line, NULL, 10) != strtol(jsonBids, NULL, 10))
+				printLog(stderr, "Auction %s: %s bids in JSON of page, %s in HTML, using JSON\n",
+					 aip->auction, jsonBids, line);
+			line = jsonBids;
+		}
+	}
+	log(("bids: %s", nullStr(line)));
+	if (line) {
+		errno = 0;
+		aip->bids = (int)strtol(line, NULL, 10);
+		if (aip->bids < 0 || (aip->bids == 0 && errno == EINVAL))
+			aip->bids = -1;
+		else if (aip->bids == 0) {
+			aip->quantityBid = 0;
+			aip->price = 0;
+			printf("# of bids: %d\n"
+				"Currently: --  (your maximum bid: %s)\n",
+				aip->bids, aip->bidPriceStr);
+			if (*options.username)
+				printf("High bidder: -- (NOT %s)\n", options.username);
+			else
+				printf("High bidder: --\n");
+			return 0;
+		}
+	}
+
+	/* bid history table */
+	hash = tableHash(mp->memory, pagetype, &tableStart);
+	key = hc ? tableKey(aip, pagetype, pageType, auctionState, auctionResult) : 0;
+	if (hc && hc->key == key && sectionSame(hc, hs_table, hash)) {
+		aip->bids = hc->bids;
+		aip->quantityBid = hc->quantityBid;
+		aip->price = hc->tablePrice;
+		aip->quantity = hc->tableQuantity;
+		aip->won = hc->won;
+		aip->winning = hc->winning;
+		printLog(stdout, "%s", hc->report);
+		return 0;
+	}
+	sectionStart(&cost, ap, aip);
+	tableReport = hc ? report : NULL;
+	tableReportLen = 0;
+	*report = '\0';
+	ret = parseBidTable(mp, aip, pagetype, pageType, auctionState, auctionResult, &tablePos);
+	tableReport = NULL;
+	/* cache only if parser used the hashed table, and output fit */
+	if (hc && !ret && tablePos && tablePos == tableStart &&
+	    tableReportLen < sizeof(report)) {
+		hc->key = key;
+		hc->bids = aip->bids;
+		hc->quantityBid = aip->quantityBid;
+		hc->tablePrice = aip->price;
+		hc->tableQuantity = aip->quantity;
+		hc->won = aip->won;
+		hc->winning = aip->winning;
+		strcpy(hc->report, report);
+		sectionDone(hc, hs_table, hash, &cost, ap, aip);
+	}
+	return ret;
+} /* parseBidHistory() */
+
+/*
+ * Is there a countdown on the page?
+ */
+static int
+hasTimeLeft(memBuf_t *mp)
+{
+	memReset(mp);
+	if (memStr(mp, ">Time left:<"))
+		return 1;
+	memReset(mp);
+	return memStr(mp, "timeLeft") != NULL;
+}
+
+/*
+ * Time left from the countdown on the page.
+ *
+ * returns:
+ *	0 OK
+ *	1 error - sets auctionError
+ */
+static int
+parseTimeLeft(memBuf_t *mp, auctionInfo *aip)
+{
+	memReset(mp);
+	if (memStr(mp, ">Time left:<")) {
+		char days[12], hours[12], minutes[12], seconds[12];
 		char tmpTimeLeft[255];
 		memset(days, '\0', sizeof(days));
 		memset(hours, '\0', sizeof(hours));
@@ -346,7 +504,7 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 		else
 			strcpy(seconds, "0");
 		sprintf(tmpTimeLeft, "%s days %s hours %s mins %s secs", days, hours, minutes, seconds);
-		free(days); free(hours); free(minutes); free(seconds);
+		free(aip->remainRaw);
 		aip->remainRaw = myStrdup(tmpTimeLeft);
  		aip->remain = getSeconds(tmpTimeLeft);
                 if (aip->remain < 0) {
@@ -389,110 +547,509 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "remaining time not found");
 		return auctionError(aip, ae_notime, NULL);
 	}
-	printLog(stdout, "Time remaining: %s (%ld seconds)\n", aip->remainRaw, aip->remain);
-	if (aip->remain) {
-		struct tm *tmPtr;
-		char timestr[20];
+	return 0;
+}
+
+/* accept end times up to a year away from the time of the request */
+#define END_TIME_RANGE (365 * 86400)
+
+/*
+ * eBay's absolute end time, from the embedded JSON or else the first of
+ *
+ *	<span class="timeMs" timems="1700000000000">
+ *	data-endtime="1700000000"
+ *
+ * The markers may belong to any item on the page, *scoped is set only for
+ * the JSON of this auction.
+ *
+ * returns: milliseconds since the epoch, 0 if not found
+ */
+static int64_t
+pageEndTime(const char *page, time_t start, const jsonValue_t *vp, int *scoped)
+{
+	static const char *const markers[] = {
+		"timems=\"", "data-endtime=\"", NULL
+	};
+	const char *const *mp;
+	int64_t ms;
+
+	*scoped = 0;
+	if (vp->value && (ms = endTimeValue(vp->value, start))) {
+		*scoped = 1;
+		log(("pageEndTime(): JSON gives %ld.%03d", (long)(ms / 1000), (int)(ms % 1000)));
+		return ms;
+	}
+	for (mp = markers; *mp; ++mp) {
+		const char *cp = strstr(page, *mp);
+
+		if (cp && (ms = endTimeValue(cp + strlen(*mp), start))) {
+			log(("pageEndTime(): %s gives %ld.%03d", *mp, (long)(ms / 1000), (int)(ms % 1000)));
+			return ms;
+		}
+	}
+	return 0;
+}
+
+/*
+ * End time in epoch seconds or milliseconds, or ISO 8601.
+ *
+ * returns: milliseconds since the epoch, 0 if not readable or too far
+ *	    from start
+ */
+static int64_t
+endTimeValue(const char *s, time_t start)
+{
+	const char *digits = s + strspn(s, "0123456789");
+	int64_t ms = 0;
+
+	if (digits > s && *digits != '-') {
+		for (; s < digits; ++s)
+			ms = ms * 10 + (*s - '0');
+		/* seconds or milliseconds */
+		if (ms < (int64_t)100000000000LL)
+			ms *= 1000;
+	} else
+		ms = isoTime(s);
+	if (ms > ((int64_t)start - END_TIME_RANGE) * 1000 &&
+	    ms < ((int64_t)start + END_TIME_RANGE) * 1000)
+		return ms;
+	return 0;
+}
+
+/*
+ * ISO 8601 time, e.g. "2023-11-14T22:13:20.000Z" or
+ * "2023-11-14T14:13:20-08:00".
+ *
+ * returns: milliseconds since the epoch, 0 if it cannot be read
+ */
+static int64_t
+isoTime(const char *s)
+{
+	int year, month, day, hour, minute, second, n = 0;
+	int ms = 0, offset = 0;
+	long days;
+
+	if (sscanf(s, "%4d-%2d-%2dT%2d:%2d:%2d%n", &year, &month, &day,
+		   &hour, &minute, &second, &n) != 6 || !n)
+		return 0;
+	s += n;
+	if (*s == '.') {
+		int scale = 100;
+
+		for (++s; isdigit((int)*s); ++s, scale /= 10)
+			ms += (*s - '0') * scale;
+	}
+	if (*s == '+' || *s == '-') {
+		int oh, om;
+
+		if (sscanf(s + 1, "%2d:%2d", &oh, &om) != 2)
+			return 0;
+		offset = (oh * 60 + om) * 60 * (*s == '-' ? -1 : 1);
+	} else if (*s != 'Z')
+		return 0;
+	if (month < 1 || month > 12 || day < 1 || day > 31)
+		return 0;
+	/* days since 1970-01-01, see "days_from_civil" by H. Hinnant */
+	year -= month <= 2;
+	{
+		long era = (year >= 0 ? year : year - 399) / 400;
+		long yoe = year - era * 400;
+		long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+		long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+		days = era * 146097 + doe - 719468;
+	}
+	return ((int64_t)days * 86400 + hour * 3600 + minute * 60 + second - offset) * 1000 + ms;
+}
+
+/* seconds the end time may be off the countdown, beyond its resolution */
+#define END_TIME_SKEW 2
+
+/*
+ * Does the absolute end time match the countdown?  The countdown is
+ * truncated to its last unit, seconds only show up near the end.
+ *
+ * returns: 1 if they agree, 0 if not
+ */
+static int
+endTimeAgrees(int64_t endTimeMs, time_t start, time_t remain)
+{
+	int64_t diff = endTimeMs - ((int64_t)start + remain) * 1000;
+	long resolution = remain <= 0 || remain % 60 ? 1 : remain % 3600 ? 60 :
+			  remain % 86400 ? 3600 : 86400;
+
+	return diff >= -END_TIME_SKEW * 1000 &&
+	       diff <= ((int64_t)resolution + END_TIME_SKEW) * 1000;
+}
+
+/*
+ * Remaining time from the absolute end time.  Rounded up, so that
+ * remain is 0 only if the auction has ended.
+ */
+static void
+setEndTime(auctionInfo *aip, int64_t endTimeMs, time_t start)
+{
+	int64_t remain = (endTimeMs - (int64_t)start * 1000 + 999) / 1000;
+	char buf[64];
+
+	aip->endTimeMs = endTimeMs;
+	aip->remain = remain > 0 ? (time_t)remain : 0;
+	sprintf(buf, "%ldd %02ldh %02ldm %02lds", (long)(aip->remain / 86400),
+		(long)(aip->remain / 3600 % 24), (long)(aip->remain / 60 % 60),
+		(long)(aip->remain % 60));
+	free(aip->remainRaw);
+	aip->remainRaw = myStrdup(buf);
+}
+
+/*
+ * Item number and title.
+ *
+ * returns:
+ *	0 OK
+ *	1 error - sets auctionError
+ */
+static int
+parseHeader(memBuf_t *mp, auctionInfo *aip, int debugMode)
+{
+	char *line;
+
+	/* item number */
+	memReset(mp);
+	if (memStr(mp, "\"BHCtBidLabel\"") ||
+		memStr(mp, "\"vizItemNum\"") ||
+		memStr(mp, "\"BHitemNo\"")) { /* obsolete as of 2.22 */
+		memChr(mp, '>');
+		memSkip(mp, 1);
+		line = getNonTag(mp);	/* Item number: */
+		line = getNonTag(mp);	/* number */
+		if (!line) {
+			log(("parseBidHistory(): No item number"));
+			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "no item number");
+			return auctionError(aip, ae_baditem, NULL);
+		}
+	} else if (memStr(mp, ">Item number:<")) {
+                line = getNonTag(mp);   /* Item number: */
+                line = getNonTag(mp);   /* number */
+		if (!line) {
+                        log(("parseBidHistory(): No item number"));
+                        bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "no item number");
+                        return auctionError(aip, ae_baditem, NULL);
+		}
+	} else {
+		log(("parseBidHistory(): BHitemNo not found"));
+		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "no item number");
+		return auctionError(aip, ae_baditem, NULL);
+	}
+	if (debugMode) {
+		free(aip->auction);
+		aip->auction = myStrdup(line);
+	} else {
+		if (strcmp(aip->auction, line)) {
+			log(("parseBidHistory(): auction number %s does not match given number %s", line, aip->auction));
+			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "mismatched item number");
+			return auctionError(aip, ae_baditem, NULL);
+		}
+	}
+
+	/* title */
+	memReset(mp);
+	if (memStr(mp, "\"itemTitle\"") ||
+		memStr(mp, "\"BHitemTitle\"") || /* obsolete as of 2.22 */
+		memStr(mp, "\"BHitemDesc\"")) {	/* obsolete before 2.22 */
+		memChr(mp, '>');
+		memSkip(mp, 1);
+		line = getNonTag(mp);	/* Item title: */
+		line = getNonTag(mp);	/* title */
+		if (!line) {
+			log(("parseBidHistory(): No item title"));
+			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title not found");
+			return auctionError(aip, ae_baditem, NULL);
+		}
+	/* Active auction */
+        } else if (memStr(mp, ">Item info<")) {
+                line = getNonTag(mp);   /* Item title: */
+                line = getNonTag(mp);   /* title */
+                if (!line) {
+                        log(("parseBidHistory(): No item title"));
+                        bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title not found");
+        	}
+	/* Post bid */
+        } else if (memStr(mp, "\"offer-title-top_panel_main\"")) {
+		memChr(mp, '>');
+		memSkip(mp, 1);
+                line = getNonTag(mp);   /* title */
+                if (!line) {
+                        log(("parseBidHistory(): No item title"));
+                        bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title not found");
+                }
+	} else {
+		log(("parseBidHistory(): BHitemTitle not found"));
+		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title or description not found");
+		return auctionError(aip, ae_baditem, NULL);
+	}
+	aip->title = auctionString(aip, aip->title, line);
+	return 0;
+}
 
-		aip->endTime = start + aip->remain;
-		/* formated time/date output */
-		tmPtr = localtime(&(aip->endTime));
-		strftime(timestr , 20, "%Y-%m-%d %H:%M:%S", tmPtr);
-		if (!debugMode)
-			printLog(stdout, "End time: %s\n", timestr);
-	} else
-		aip->endTime = aip->remain;
+/*
+ * Price, quantity and shipping from the HTML.  Values in have are in the
+ * JSON of the page, it is no error if the HTML lacks them or they can't be
+ * read.  Sets in got what was found.
+ *
+ * returns:
+ *	0 OK
+ *	1 error - sets auctionError
+ */
+static int
+parseDetails(memBuf_t *mp, auctionInfo *aip, int have, int *got)
+{
+	char *line;
 
-	/* bid history */
 	memReset(mp);
-	aip->bids = -1;
-	if (memStr(mp, "ViewBids:")) {	/* Skip over 'ViewBids' */
-		line = 	getNonTag(mp);
-	} else {
-		memReset(mp);
-	}
-	if (memStr(mp, "Bids:")) {
-		line = getNonTag(mp);	/* Bids: */
-		line = getNonTag(mp);	/* number */
-		log(("bids: %d", line));
-		if (line) {
+	aip->quantity = 1;	/* If quantity not found, assume 1 */
+	*got = NOTHING;
+	while (*got != EVERYTHING && memStr(mp, "\"BHCtBid\"")) {
+		memChr(mp, '>');
+		memSkip(mp, 1);
+		line = getNonTag(mp);
+
+		/* Can sometimes get starting bid, but that's not the price
+		 * we are looking for.
+		 */
+		if (!strcasecmp(line, "Current bid:") ||
+		    !strcasecmp(line, "Winning bid:") ||
+		    !strcasecmp(line, "Your maximum bid:") ||
+		    !strcasecmp(line, "price:")) {
+			char *saveptr;
+			const char *priceStr;
+
+			line = getNonTag(mp);
+			if (!line) {
+				if (have & PRICE)
+					break;
+				bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item price not found");
+				return auctionError(aip, ae_noprice, NULL);
+			}
+			log(("Currently: %s\n", line));
+			priceStr = priceFixup(line, aip);
+			aip->price = priceStr ? atof(priceStr) : -1.0;
+			if (aip->price < 0.01 && !(have & PRICE)) {
+				bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item price could not be converted");
+				return auctionError(aip, ae_convprice, line);
+			}
+			if (aip->price >= 0.01)
+				*got |= PRICE;
+
+			/* reserve not met? */
+			saveptr = mp->readptr;
+			line = getNonTag(mp);
+			aip->reserve = !strcasecmp(line, "Reserve not met");
+			if (!aip->reserve)
+				mp->readptr = saveptr;
+		} else if (!strcasecmp(line, "Quantity:")) {
+			line = getNonTag(mp);
+			if (!line) {
+				if (have & QUANTITY)
+					break;
+				bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item quantity not found");
+				return auctionError(aip, ae_noquantity, NULL);
+			}
 			errno = 0;
-			aip->bids = (int)strtol(line, NULL, 10);
-			if (aip->bids < 0 || (aip->bids == 0 && errno == EINVAL))
-				aip->bids = -1;
-			else if (aip->bids == 0) {
-				aip->quantityBid = 0;
-				aip->price = 0;
-				printf("# of bids: %d\n"
-					"Currently: --  (your maximum bid: %s)\n",
-					aip->bids, aip->bidPriceStr);
-				if (*options.username)
-					printf("High bidder: -- (NOT %s)\n", options.username);
-				else
-					printf("High bidder: --\n");
-				return 0;
+			if (isdigit(*line)) {
+				aip->quantity = (int)strtol(line, NULL, 10);
+				if (aip->quantity < 0 || (aip->quantity == 0 && errno == EINVAL)) {
+					bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item quantity could not be converted");
+					return auctionError(aip, ae_noquantity, NULL);
+				}
+			} else
+				aip->quantity = 1;
+			log(("quantity: %d", aip->quantity));
+			*got |= QUANTITY;
+		} else if (!strcasecmp(line, "Shipping:")) {
+			line = getNonTag(mp);
+			if (line) {
+				aip->shipping = auctionString(aip, aip->shipping, line);
 			}
+			*got |= SHIPPING;
 		}
 	}
+	return 0;
+}
 
-	/*
-	 * Determine high bidder
-	 *
-	 * Format of high bidder table is:
-	 *
-	 *	Single item auction:
-	 *	    Header line:
-	 *		""
-	 *		"Bidder"
-	 *		"Bid Amount"
-	 *		"Bid Time"
-	 *		"Action" (sometimes)
-	 *		""
-	 *	    For each bid:
-	 *			""
-	 *			<user>
-	 *			<amount>
-	 *			<date>
-	 *			[links for feedback and other actions] (sometimes)
-	 *			""
-	 *	    (plus multiple rows of 1 column between entries)
-	 *
-	 *	    If there are no bids:
-	 *			""
-	 *			"No bids have been placed."
-	 *
-	 *	    If the auction is private, the user names are:
-	 *		"private auction - bidders' identities protected"
-	 *
-	 *	Purchase (buy-it-now only):
-	 *	    Header line:
-	 *		""
-	 *		"User ID"
-	 *		"Price"
-	 *		"Qty"
-	 *		"Date"
-	 *		""
-	 *	    For each bid:
-	 *			""
-	 *			<user>
-	 *			<price>
-	 *			<quantity>
-	 *			<date>
-	 *			""
-	 *	    (plus multiple rows of 1 column between entries)
-	 *
-	 *	    If there are no bids:
-	 *			""
-	 *			"No purchases have been made."
-	 *
-	 *	    If the auction is private, the user names are:
-	 *		"private auction - bidders' identities protected"
-	 *
-	 *	If there are no bids, the text "No bids have been placed."
-	 *	will be the first entry in the table.  If there are bids,
-	 *	the last bidder might be "Starting Price", which should
-	 *	not be counted.
-	 */
+/*
+ * Item state in JSON in the scripts of the page that mention auction.
+ */
+static void
+pageJson(const char *page, const char *auction, jsonValue_t *json)
+{
+	const char *cp = page;
+
+	memset(json, 0, ji_last * sizeof(jsonValue_t));
+	while ((cp = strstr(cp, "<script"))) {
+		const char *start = strchr(cp, '>'), *end, *id;
+
+		if (!start)
+			break;
+		++start;
+		if (!(end = strstr(start, "</script")))
+			end = start + strlen(start);
+		id = findNumber(start, end, auction);
+		if (id && jsonScan(start, end, jsonPaths, json) == ji_last)
+			break;
+		cp = end;
+	}
+}
+
+/*
+ * First occurrence of number in [start, end) that is not part of a longer
+ * number.  start must not be the beginning of a string.
+ *
+ * returns: pointer to it, NULL if not found
+ */
+static const char *
+findNumber(const char *start, const char *end, const char *number)
+{
+	size_t len = strlen(number);
+	const char *cp;
+
+	for (cp = start; (size_t)(end - cp) >= len; ++cp) {
+		if (!(cp = memchr(cp, *number, (size_t)(end - cp))))
+			return NULL;
+		if ((size_t)(end - cp) >= len && !memcmp(cp, number, len) &&
+		    !isdigit((int)cp[-1]) && !isdigit((int)cp[len]))
+			return cp;
+	}
+	return NULL;
+}
+
+/*
+ * Price, currency and quantity from JSON.  A quantity of 0 is not taken,
+ * only the HTML may say that an auction has ended.
+ *
+ * returns: PRICE and QUANTITY if they were found
+ */
+static int
+jsonDetails(arena_t *ap, auctionInfo *aip, const jsonValue_t *json, double *price, int *quantity)
+{
+	int have = NOTHING;
+
+	*price = 0;
+	*quantity = 0;
+	if (json[ji_currency].value && !aip->currency)
+		aip->currency = auctionString(aip, NULL, jsonString(ap, &json[ji_currency]));
+	if (json[ji_price].value) {
+		const char *priceStr = priceFixup(jsonString(ap, &json[ji_price]), aip);
+
+		if (priceStr && (*price = atof(priceStr)) >= 0.01) {
+			log(("Currently: %s (JSON)\n", priceStr));
+			have |= PRICE;
+		}
+	}
+	if (json[ji_quantity].value && isdigit((int)*json[ji_quantity].value) &&
+	    (*quantity = (int)strtol(json[ji_quantity].value, NULL, 10)) > 0) {
+		log(("quantity: %d (JSON)", *quantity));
+		have |= QUANTITY;
+	}
+	return have;
+}
+
+/*
+ * JSON values replace the HTML ones, pageJson() read only the scripts of
+ * this auction.  Only the HTML may say that nothing is left, a quantity of
+ * 0 is kept.
+ */
+static void
+mergeDetails(auctionInfo *aip, int have, double price, int quantity, int *got)
+{
+	if (have & PRICE) {
+		if ((*got & PRICE) &&
+		    (aip->price - price >= 0.005 || price - aip->price >= 0.005))
+			printLog(stderr, "Auction %s: price %.2f in JSON of page, %.2f in HTML, using JSON\n",
+				 aip->auction, price, aip->price);
+		aip->price = price;
+		*got |= PRICE;
+	}
+	if ((have & QUANTITY) && !((*got & QUANTITY) && aip->quantity == 0)) {
+		if ((*got & QUANTITY) && aip->quantity != quantity)
+			printLog(stderr, "Auction %s: quantity %d in JSON of page, %d in HTML, using JSON\n",
+				 aip->auction, quantity, aip->quantity);
+		aip->quantity = quantity;
+		*got |= QUANTITY;
+	}
+}
+
+/*
+ * Determine high bidder
+ *
+ * Format of high bidder table is:
+ *
+ *	Single item auction:
+ *	    Header line:
+ *		""
+ *		"Bidder"
+ *		"Bid Amount"
+ *		"Bid Time"
+ *		"Action" (sometimes)
+ *		""
+ *	    For each bid:
+ *			""
+ *			<user>
+ *			<amount>
+ *			<date>
+ *			[links for feedback and other actions] (sometimes)
+ *			""
+ *	    (plus multiple rows of 1 column between entries)
+ *
+ *	    If there are no bids:
+ *			""
+ *			"No bids have been placed."
+ *
+ *	    If the auction is private, the user names are:
+ *		"private auction - bidders' identities protected"
+ *
+ *	Purchase (buy-it-now only):
+ *	    Header line:
+ *		""
+ *		"User ID"
+ *		"Price"
+ *		"Qty"
+ *		"Date"
+ *		""
+ *	    For each bid:
+ *			""
+ *			<user>
+ *			<price>
+ *			<quantity>
+ *			<date>
+ *			""
+ *	    (plus multiple rows of 1 column between entries)
+ *
+ *	    If there are no bids:
+ *			""
+ *			"No purchases have been made."
+ *
+ *	    If the auction is private, the user names are:
+ *		"private auction - bidders' identities protected"
+ *
+ *	If there are no bids, the text "No bids have been placed."
+ *	will be the first entry in the table.  If there are bids,
+ *	the last bidder might be "Starting Price", which should
+ *	not be counted.
+ *
+ * Sets tablePos to the start of the table that was used.
+ *
+ * returns:
+ *	0 OK
+ *	1 error - sets auctionError
+ */
+static int
+parseBidTable(memBuf_t *mp, auctionInfo *aip, phtype pagetype, int pageType, int auctionState, int auctionResult, const char **tablePos)
+{
+	arena_t *ap = memArena(mp);
+	char *line;
+	char **row = NULL;
+	int ret = 0;		/* 0 = OK, 1 = failed */
+	int foundHeader = 0;	/* found bid history table header */
 
 	/* find bid history table */
 	memReset(mp);
@@ -504,16 +1061,16 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 		ncolumns = numColumns(row);
 		if ( (pagetype == phclassic && ncolumns >= 5) || (pagetype == ph201702 && ncolumns >= 3) ) {
 			char *rawHeader = (pagetype == phclassic ? row[1] : row[0]);
-			char *header = getNonTagFromString(rawHeader);
+			char *header = getNonTagFromString(ap, rawHeader);
 
 			foundHeader = header &&
 					(!strncmp(header, "Bidder", 6) ||
 					 !strncmp(header, "User ID", 7));
-			free(header);
 		}
-		if (!foundHeader)
+		if (foundHeader)
+			*tablePos = saveptr;
+		else
 			mp->readptr = saveptr;
-		freeTableRow(row);
 	}
 	if (!foundHeader) {
 		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "Cannot find bid table header");
@@ -524,7 +1081,6 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 	while ((row = getTableRow(mp))) {
 		if (numColumns(row) != 1)
 			break;
-		freeTableRow(row);
 	}
 
 	log(("numColumns=%d", numColumns(row)));
@@ -532,20 +1088,20 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 	switch (numColumns(row)) {
 	case 2:	/* auction with no bids */
 	    {
-		char *s = getNonTagFromString(row[1]);
+		char *s = getNonTagFromString(ap, row[1]);
 
 		if (!strcmp("No bids have been placed.", s) ||
 		    !strcmp("No purchases have been made.", s)) {
 			aip->quantityBid = 0;
 			aip->bids = 0;
 			aip->price = 0;
-			printf("# of bids: %d\n"
+			tablePrint("# of bids: %d\n"
 				"Currently: --  (your maximum bid: %s)\n",
 				aip->bids, aip->bidPriceStr);
 			if (*options.username)
-				printf("High bidder: -- (NOT %s)\n", options.username);
+				tablePrint("High bidder: -- (NOT %s)\n", options.username);
 			else
-				printf("High bidder: --\n");
+				tablePrint("High bidder: --\n");
 		} else {
 			if (checkPageType(aip, pageType, auctionState, auctionResult) != 0)
 			{
@@ -553,8 +1109,6 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 				ret = auctionError(aip, ae_nohighbid, NULL);
 			}
 		}
-		freeTableRow(row);
-		free(s);
 		break;
 	    }
 
@@ -565,7 +1119,7 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 		 */
 	    if(pageType != VIEWBIDS)
 	    {
-			char *currently = getNonTagFromString((pagetype == phclassic ? row[2] : row[1]));
+			char *currently = getNonTagFromString(ap, (pagetype == phclassic ? row[2] : row[1]));
 			aip->bids = 0;
 			aip->quantityBid = 0;
 			aip->won = 0;
@@ -579,29 +1133,26 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 
 					++aip->bids;
 					aip->quantityBid += quantity;
-					bidder = getNonTagFromString((pagetype == phclassic ? row[1] : row[0]));
+					bidder = getNonTagFromString(ap, (pagetype == phclassic ? row[1] : row[0]));
 					if (!strcasecmp(bidder, options.username))
 						aip->won = aip->winning = quantity;
-					free(bidder);
 				}
-				freeTableRow(row);
 			}
-			printf("# of bids: %d\n", aip->bids);
-			printf("Currently: %s  (your maximum bid: %s)\n",
+			tablePrint("# of bids: %d\n", aip->bids);
+			tablePrint("Currently: %s  (your maximum bid: %s)\n",
 				currently, aip->bidPriceStr);
-			free(currently);
 			switch (aip->winning) {
 			case 0:
 				if (*options.username)
-					printLog(stdout, "High bidder: various purchasers (NOT %s)\n", options.username);
+					tablePrint("High bidder: various purchasers (NOT %s)\n", options.username);
 				else
-					printLog(stdout, "High bidder: various purchasers\n");
+					tablePrint("High bidder: various purchasers\n");
 				break;
 			case 1:
-				printLog(stdout, "High bidder: %s!!!\n", options.username);
+				tablePrint("High bidder: %s!!!\n", options.username);
 				break;
 			default:
-				printLog(stdout, "High bidder: %s!!! (%d items)\n", options.username, aip->winning);
+				tablePrint("High bidder: %s!!! (%d items)\n", options.username, aip->winning);
 				break;
 			}
 			break;
@@ -613,14 +1164,18 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 		/* blank, user, price, date, blank */
 		char *winner = NULL;
 		const char *priceStr;
+		int more;
 		if (pagetype == phclassic)
-			winner = getNonTagFromString(row[1]);
+			winner = getNonTagFromString(ap, row[1]);
 		else
-			winner = getNthNonTagFromString(row[0], 1);
-		char *currently = getNonTagFromString((pagetype == phclassic ? row[2] : row[1]));
+			winner = getNthNonTagFromString(ap, row[0], 1);
+		char *currently = getNonTagFromString(ap, (pagetype == phclassic ? row[2] : row[1]));
 
 		if (!strcasecmp(winner, "Member Id:"))
-		   winner = getNthNonTagFromString((pagetype == phclassic ? row[1] : row[0]), (pagetype == phclassic ? 2 : 1));
+		   winner = getNthNonTagFromString(ap, (pagetype == phclassic ? row[1] : row[0]), (pagetype == phclassic ? 2 : 1));
+
+		bidLogBegin(aip);
+		more = logBidRow(ap, aip, pagetype, row, winner);
 
 		aip->quantityBid = 1;
 
@@ -629,13 +1184,8 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 		aip->price = priceStr ? atof(priceStr) : -1.0;
 		if (aip->price < 0.01) {
 #if 0
-			free(winner);
-			free(currently);
 			if (checkPageType(aip, pageType, auctionState, auctionResult) == 0)
-			{
-				freeTableRow(row);
 				break;
-			}
 			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "bid price could not be converted");
 			return auctionError(aip, ae_convprice, currently);
 #else // 0
@@ -643,18 +1193,15 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 #endif // 0
 		}
 
-		printLog(stdout, "Currently: %s  (your maximum bid: %s)\n",
+		tablePrint("Currently: %s  (your maximum bid: %s)\n",
 			 currently, aip->bidPriceStr);
-		free(currently);
 
 		/* winning user */
 		if (!strcmp(winner, PRIVATE)) {
-			free(winner);
-			winner = myStrdup((aip->price <= aip->bidPrice &&
+			winner = myStrdupIn(ap, (aip->price <= aip->bidPrice &&
 					    (aip->bidResult == 0 ||
 					     (aip->bidResult == -1 && aip->endTime - time(NULL) < options.bidtime))) ?  options.username : "[private]");
 		}
-		freeTableRow(row);
 
 		/* count bids */
 		if (aip->bids < 0) {
@@ -663,21 +1210,33 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 				if ( (pagetype == phclassic && numColumns(row) == 5) || (pagetype == ph201702 && numColumns(row) == 3) ) {
 					char *bidder = NULL;
 					if (pagetype == phclassic)
-						bidder = getNonTagFromString(row[1]);
+						bidder = getNonTagFromString(ap, row[1]);
 					else
-						bidder = getNthNonTagFromString(row[0], 1);
+						bidder = getNthNonTagFromString(ap, row[0], 1);
 
 					foundStartPrice = !strcmp(bidder, "Starting Price");
-					if (!foundStartPrice)
+					if (!foundStartPrice) {
 						++aip->bids;
-					free(bidder);
+						logBidRow(ap, aip, pagetype, row, bidder);
+					}
+				}
+			}
+		} else {
+			/* only read up to the newest bid seen before */
+			while (more && (row = getTableRow(mp))) {
+				if ( (pagetype == phclassic && numColumns(row) == 5) || (pagetype == ph201702 && numColumns(row) == 3) ) {
+					char *bidder = (pagetype == phclassic ?
+						getNonTagFromString(ap, row[1]) :
+						getNthNonTagFromString(ap, row[0], 1));
+
+					more = logBidRow(ap, aip, pagetype, row, bidder);
 				}
-				freeTableRow(row);
 			}
 		}
+		bidLogEnd(aip);
 		if (pagetype == phclassic)
 		{
-			printLog(stdout, "# of bids: %d\n", aip->bids);
+			tablePrint("# of bids: %d\n", aip->bids);
 		}
 		else
 		{
@@ -687,36 +1246,35 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
                         	line = getNonTag(mp); /* Bids: */
                         	line = getNonTag(mp); /* Num. of bids */
 				aip->bids = (int)strtol(line, NULL, 10);
-				printLog(stdout, "# of bids: %d (%d incl. autom. bids)\n", aip->bids, bids2);
+				tablePrint("# of bids: %d (%d incl. autom. bids)\n", aip->bids, bids2);
 			}
 			else {
-				printLog(stdout, "# of bids: %d (autom. bids included)\n", aip->bids);
+				tablePrint("# of bids: %d (autom. bids included)\n", aip->bids);
 			}
 		}
 
 		/* print high bidder */
 		if (strcasecmp(winner, options.username)) {
 			if (*options.username)
-				printLog(stdout, "High bidder: %s (NOT %s)\n",
+				tablePrint("High bidder: %s (NOT %s)\n",
 					 winner, options.username);
 			else
-				printLog(stdout, "High bidder: %s\n", winner);
+				tablePrint("High bidder: %s\n", winner);
 			aip->winning = 0;
 			if (!aip->remain)
 				aip->won = 0;
 		} else if (aip->reserve) {
-			printLog(stdout, "High bidder: %s (reserve not met)\n",
+			tablePrint("High bidder: %s (reserve not met)\n",
 				 winner);
 			aip->winning = 0;
 			if (!aip->remain)
 				aip->won = 0;
 		} else {
-			printLog(stdout, "High bidder: %s!!!\n", winner);
+			tablePrint("High bidder: %s!!!\n", winner);
 			aip->winning = 1;
 			if (!aip->remain)
 				aip->won = 1;
 		}
-		free(winner);
 		break;
 	    }
 	default:
@@ -725,19 +1283,31 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "%d columns in bid table", numColumns(row));
 			ret = auctionError(aip, ae_nohighbid, NULL);
 		}
-		freeTableRow(row);
 	}
 
 	return ret;
-} /* parseBidHistory() */
+}
+
+/* units of time left on bid history and watch list pages */
+static const struct timeUnit {
+	const char *name;
+	long seconds;
+} timeUnits[] = {
+	{ "s", 1 }, { "sec", 1 }, { "secs", 1 }, { "second", 1 }, { "seconds", 1 },
+	{ "m", 60 }, { "min", 60 }, { "mins", 60 }, { "minute", 60 }, { "minutes", 60 },
+	{ "h", 3600 }, { "hr", 3600 }, { "hrs", 3600 }, { "hour", 3600 }, { "hours", 3600 },
+	{ "d", 86400 }, { "day", 86400 }, { "days", 86400 },
+	{ NULL, 0 }
+};
 
-static long
+/*
+ * Convert time left, e.g. "2 days 3 hours" or "2d 03h", to seconds.
+ *
+ * returns: seconds, -1 = cannot parse
+ */
+long
 getSeconds(char *timestr)
 {
-	static char second[] = "sec";
-	static char minute[] = "min";
-	static char hour[] = "hour";
-	static char day[] = "day";
 	static char ended[] = "ended";
 	long accum = 0;
 	long num;
@@ -756,22 +1326,30 @@ getSeconds(char *timestr)
 	 */
 	if (!*timestr || !strncmp(timestr, "--", 2))
 		return 1;
-	if (strstr(timestr, ended))
+	/* "auction has ended", or "Ended" on the watch list */
+	if (strstr(timestr, ended) || !strncmp(timestr, "Ended", 5))
 		return 0;
 	while (*timestr) {
+		const struct timeUnit *up;
+		size_t len;
+
 		num = strtol(timestr, &timestr, 10);
 		while (isspace((int)*timestr))
 			++timestr;
-		if (!strncmp(timestr, second, sizeof(second) - 1))
-			return(accum + num);
-		else if (!strncmp(timestr, minute, sizeof(minute) - 1))
-			accum += num * 60;
-		else if (!strncmp(timestr, hour, sizeof(hour) - 1))
-			accum += num * 3600;
-		else if (!strncmp(timestr, day, sizeof(day) - 1))
-			accum += num * 86400;
-		else
+		for (len = 0; isalpha((int)timestr[len]); ++len)
+			;
+		/* whole words only, "m" is minutes but "mo" is not */
+		for (up = timeUnits; up->name; ++up) {
+			if (strlen(up->name) == len &&
+			    !strncasecmp(timestr, up->name, len))
+				break;
+		}
+		if (!up->name)
 			return -1;
+		if (up->seconds == 1)
+			return(accum + num);
+		accum += num * up->seconds;
+		timestr += len;
 		while (*timestr && !isdigit((int)*timestr))
 			++timestr;
 	}
@@ -805,14 +1383,14 @@ static int checkPageType(auctionInfo *aip, int pageType, int auctionState, int a
 				aip->winning = 1;
 				aip->won = 0;
 				aip->quantity = 0;
-				printLog(stdout, "High bidder: %s!!!\n", options.username);
+				tablePrint("High bidder: %s!!!\n", options.username);
 				break;
 			case RESULT_NONE:
 				aip->quantityBid = 0;
 				aip->winning = 0;
 				aip->won = 0;
 				aip->quantity = 0;
-				printLog(stdout, "High bidder: (unknown) (NOT %s)\n",
+				tablePrint("High bidder: (unknown) (NOT %s)\n",
 						 options.username);
 			default:
 				return -1;
@@ -826,7 +1404,7 @@ static int checkPageType(auctionInfo *aip, int pageType, int auctionState, int a
 				aip->winning = 1;
 				aip->won = 1;
 				aip->quantity = 1;
-				printLog(stdout, "High bidder: %s!!!\n", options.username);
+				tablePrint("High bidder: %s!!!\n", options.username);
 				break;
 			case RESULT_NONE:
 			case RESULT_OUTBID:
@@ -834,7 +1412,7 @@ static int checkPageType(auctionInfo *aip, int pageType, int auctionState, int a
 				aip->winning = 0;
 				aip->won = 0;
 				aip->quantity = 0;
-				printLog(stdout, "High bidder: (unknown) (NOT %s)\n",
+				tablePrint("High bidder: (unknown) (NOT %s)\n",
 						 options.username);
 				break;
 			default:
@@ -855,3 +1433,261 @@ static int checkPageType(auctionInfo *aip, int pageType, int auctionState, int a
 	}
 	return 0;
 }
+
+/*
+ * Add a row of the bid table to the bid log of the auction.
+ *
+ * returns: 1 = read next row, 0 = bid was logged before
+ */
+static int
+logBidRow(arena_t *ap, auctionInfo *aip, phtype pagetype, char **row, const char *bidder)
+{
+	char *amount = getNonTagFromString(ap, (pagetype == phclassic ? row[2] : row[1]));
+	const char *when = getNonTagFromString(ap, (pagetype == phclassic ? row[3] : row[2]));
+
+	if (!strcmp(bidder, "Starting Price"))
+		return 1;
+	return bidLogRow(aip, bidder, atof(priceFixup(amount, NULL)), when);
+}
+
+/*
+ * Print a line of the bid table result, and keep it in tableReport so it
+ * can be printed again if the table is unchanged on the next parse.
+ */
+static void
+tablePrint(const char *fmt, ...)
+{
+	char buf[1024];
+	va_list arglist;
+	int n;
+
+	va_start(arglist, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, arglist);
+	va_end(arglist);
+	printLog(stdout, "%s", buf);
+	if (!tableReport)
+		return;
+	/* report too long: mark it, so it is not cached */
+	if (n < 0 || (size_t)n >= sizeof(buf) ||
+	    tableReportLen + n >= sizeof(((struct historyCache *)0)->report)) {
+		tableReportLen = sizeof(((struct historyCache *)0)->report);
+		return;
+	}
+	memcpy(tableReport + tableReportLen, buf, n + 1);
+	tableReportLen += n;
+}
+
+static struct historyCache *
+getHistoryCache(auctionInfo *aip)
+{
+	if (!aip->historyCache) {
+		aip->historyCache = (struct historyCache *)arenaAlloc(aip->arena, sizeof(struct historyCache));
+		memset(aip->historyCache, 0, sizeof(struct historyCache));
+	}
+	return aip->historyCache;
+}
+
+#define HASH_BASIS 2166136261UL
+#define HASH_PRIME 16777619UL
+
+/*
+ * FNV-1a hash of s up to end.  Never returns 0, that means "no hash".
+ */
+static unsigned long
+hashBytes(unsigned long h, const char *s, const char *end)
+{
+	for (; s < end; ++s) {
+		h ^= (unsigned char)*s;
+		h = (h * HASH_PRIME) & 0xffffffffUL;
+	}
+	return h ? h : 1;
+}
+
+static unsigned long
+hashValue(unsigned long h, const jsonValue_t *vp)
+{
+	return vp->value ? hashBytes(h, vp->value, vp->value + vp->len) : h;
+}
+
+/*
+ * Skip n runs of text that are not blank, and any tags between them.
+ * Generous on purpose: the hashed region must hold everything the parser
+ * reads after a marker.
+ */
+static const char *
+skipTexts(const char *s, int n)
+{
+	while (*s && n > 0) {
+		int blank = 1;
+
+		if (*s == '<') {
+			const char *cp = strchr(s, '>');
+
+			if (!cp)
+				return s + strlen(s);
+			s = cp + 1;
+			continue;
+		}
+		for (; *s && *s != '<'; ++s)
+			if (!isspace((int)*s))
+				blank = 0;
+		if (!blank)
+			--n;
+	}
+	return s;
+}
+
+/*
+ * First of markers, in order, found anywhere on the page.
+ */
+static const char *
+findMarker(const char *page, const char *const *markers)
+{
+	const char *cp;
+
+	for (; *markers; ++markers) {
+		if ((cp = strstr(page, *markers)))
+			return cp;
+	}
+	return NULL;
+}
+
+/*
+ * Hashes of the page sections, using the same markers as the parsers.
+ *
+ * returns: hash, 0 if section not found
+ */
+static unsigned long
+headerHash(const char *page)
+{
+	static const char *const numberMarkers[] = {
+		"\"BHCtBidLabel\"", "\"vizItemNum\"", "\"BHitemNo\"",
+		">Item number:<", NULL
+	};
+	static const char *const titleMarkers[] = {
+		"\"itemTitle\"", "\"BHitemTitle\"", "\"BHitemDesc\"",
+		">Item info<", "\"offer-title-top_panel_main\"", NULL
+	};
+	const char *number = findMarker(page, numberMarkers);
+	const char *title = findMarker(page, titleMarkers);
+
+	if (!number || !title)
+		return 0;
+	return hashBytes(hashBytes(HASH_BASIS, number, skipTexts(number, 4)),
+			 title, skipTexts(title, 4));
+}
+
+static unsigned long
+detailsHash(const char *page)
+{
+	static const char marker[] = "\"BHCtBid\"";
+	const char *first = strstr(page, marker), *last = first, *cp;
+
+	if (!first)
+		return 0;
+	while ((cp = strstr(last + 1, marker)))
+		last = cp;
+	return hashBytes(HASH_BASIS, first, skipTexts(last, 5));
+}
+
+/*
+ * The bid table is the table around the first "Bidder" or "User ID".
+ * tablePos is set to the end of its table tag, which is where
+ * parseBidTable() starts reading, so that the caller can check that the
+ * parser used the same table.
+ */
+static unsigned long
+tableHash(const char *page, phtype pagetype, const char **tablePos)
+{
+	static const char *const headerMarkers[] = { "Bidder", "User ID", NULL };
+	const char *header = findMarker(page, headerMarkers);
+	const char *start, *end, *cp;
+	unsigned long h;
+	int nesting = 1;
+
+	*tablePos = NULL;
+	if (!header)
+		return 0;
+	for (start = header; start > page; --start) {
+		if (!strncmp(start, "<table", 6) &&
+		    (isspace((int)start[6]) || start[6] == '>'))
+			break;
+	}
+	if (start == page || !(end = strchr(start, '>')))
+		return 0;
+	*tablePos = end + 1;
+	while (nesting) {
+		if (!(end = strstr(end + 1, "<")))
+			return 0;
+		if (!strncmp(end, "</table>", 8))
+			--nesting;
+		else if (!strncmp(end, "<table", 6) &&
+			 (isspace((int)end[6]) || end[6] == '>'))
+			++nesting;
+	}
+	h = hashBytes(HASH_BASIS, start, end + 8);
+	/* count of bids is outside of the table on newer pages */
+	if (pagetype == ph201702 && (cp = strstr(page, ">Bids:<")))
+		h = hashBytes(h, cp, skipTexts(cp, 3));
+	return h;
+}
+
+/*
+ * Hash of everything the bid table result depends on, besides the table.
+ */
+static unsigned long
+tableKey(auctionInfo *aip, phtype pagetype, int pageType, int auctionState, int auctionResult)
+{
+	char buf[512];
+	int nearEnd = aip->endTime - time(NULL) < options.bidtime;
+
+	snprintf(buf, sizeof(buf), "%d %d %d %d %d %d %d %d %d %d %d %d %d %f %s %s %s",
+		 pagetype, pageType, auctionState, auctionResult,
+		 aip->bids, aip->quantityBid, aip->quantity, aip->won,
+		 aip->winning, aip->remain == 0, aip->reserve, aip->bidResult,
+		 nearEnd, aip->bidPrice,
+		 aip->bidPriceStr ? aip->bidPriceStr : "",
+		 aip->currency ? aip->currency : "", options.username);
+	return hashBytes(HASH_BASIS, buf, buf + strlen(buf));
+}
+
+/*
+ * Is section s unchanged since it was last parsed?  If so, count what
+ * parsing it again would have cost.
+ */
+static int
+sectionSame(struct historyCache *hc, enum historySection s, unsigned long hash)
+{
+	if (!hc || !hash || hc->hash[s] != hash)
+		return 0;
+	savedCpu += hc->cpu[s];
+	savedBytes += hc->bytes[s];
+	metricsCount(mc_sectionSkipped, 1);
+	metricsCount(mc_parseCpuSaved, (int)(hc->cpu[s] * 1000000.0 / CLOCKS_PER_SEC));
+	metricsCount(mc_parseBytesSaved, (int)hc->bytes[s]);
+	log(("parseBidHistory(): %s unchanged, saved %.0f us and %lu bytes (%.0f us and %lu bytes so far)",
+	     historySectionName[s],
+	     hc->cpu[s] * 1000000.0 / CLOCKS_PER_SEC, (unsigned long)hc->bytes[s],
+	     savedCpu * 1000000.0 / CLOCKS_PER_SEC, (unsigned long)savedBytes));
+	return 1;
+}
+
+static void
+sectionStart(sectionCost_t *cp, arena_t *ap, auctionInfo *aip)
+{
+	cp->cpu = clock();
+	cp->bytes = ap->allocated + aip->arena->allocated;
+}
+
+/*
+ * Section s with the given hash was parsed successfully, remember it.
+ */
+static void
+sectionDone(struct historyCache *hc, enum historySection s, unsigned long hash, sectionCost_t *cp, arena_t *ap, auctionInfo *aip)
+{
+	if (!hc)
+		return;
+	hc->hash[s] = hash;
+	hc->cpu[s] = clock() - cp->cpu;
+	hc->bytes[s] = ap->allocated + aip->arena->allocated - cp->bytes;
+}
@@ -40,4 +40,12 @@
 extern int
 parseBidHistory(memBuf_t *mp, auctionInfo *aip, time_t start, time_t *timeToFirstByte, int debugMode);
 
+/*
+ * getSeconds(): converts time left string to seconds
+ *
+ * returns: seconds, -1 if string is not understood
+ */
+extern long
+getSeconds(char *timestr);
+
 #endif /*HISTORY_H_*/
@@ -30,11 +30,56 @@
 #include "http.h"
 #include "html.h"
 #include "esniper.h"
+#ifdef HAVE_LIBXML2
+#include "htmlxml.h"
+#endif
 
 /*
- * rudimentary HTML parser, maybe, we should use libxml2 instead?
+ * rudimentary HTML parser.  Tags and text are found by a tokenizer, either
+ * the hand-written scanner below or, if built with --with-libxml2, the
+ * libxml2 HTML parser.  The htmlParser option selects one at run time.
  */
 
+static const char *scanTag(memBuf_t *mp);
+static char *scanNonTag(memBuf_t *mp);
+
+const htmlTokenizer_t htmlScanner = { "builtin", scanTag, scanNonTag, NULL };
+
+const htmlTokenizer_t *const htmlTokenizers[] = {
+	&htmlScanner,
+#ifdef HAVE_LIBXML2
+	&htmlXmlTokenizer,
+#endif
+	NULL
+};
+
+static const htmlTokenizer_t *tokenizer = &htmlScanner;
+
+/*
+ * Select tokenizer by name.
+ *
+ * returns: 0 = OK, 1 = no such tokenizer in this build
+ */
+int
+htmlSetTokenizer(const char *name)
+{
+	int i;
+
+	for (i = 0; htmlTokenizers[i]; ++i) {
+		if (!strcmp(htmlTokenizers[i]->name, name)) {
+			tokenizer = htmlTokenizers[i];
+			log(("htmlSetTokenizer(): using %s\n", name));
+			return 0;
+		}
+	}
+	return 1;
+}
+
+const char *
+htmlTokenizerName(void)
+{
+	return tokenizer->name;
+}
 
 /*
  * Get next tag text, eliminating leading and trailing whitespace
@@ -42,6 +87,25 @@
  */
 const char *
 getTag(memBuf_t *mp)
+{
+	return tokenizer->getTag(mp);
+}
+
+/*
+ * Get next non-tag text, eliminating leading and trailing whitespace
+ * and leaving only a single space for all internal whitespace.
+ */
+char *
+getNonTag(memBuf_t *mp)
+{
+	return tokenizer->getNonTag(mp);
+}
+
+/*
+ * Hand-written scanner, reads the page one character at a time.
+ */
+static const char *
+scanTag(memBuf_t *mp)
 {
 	static char *buf = NULL;
 	static size_t bufsize = 0;
@@ -147,12 +211,8 @@ getTag(memBuf_t *mp)
 	return count ? buf : NULL;
 }
 
-/*
- * Get next non-tag text, eliminating leading and trailing whitespace
- * and leaving only a single space for all internal whitespace.
- */
-char *
-getNonTag(memBuf_t *mp)
+static char *
+scanNonTag(memBuf_t *mp)
 {
 	static char *buf = NULL;
 	static size_t bufsize = 0;
@@ -174,7 +234,7 @@ getNonTag(memBuf_t *mp)
 				log(("getNonTag(): returning %s\n", buf));
 				return buf;
 			} else
-				(void)getTag(mp);
+				(void)scanTag(mp);
 			break;
 		case ' ':
 		case '\n':
@@ -230,10 +290,10 @@ getNonTag(memBuf_t *mp)
 	term(buf, bufsize, count);
 	log(("getNonTag(): returning %s\n", count ? buf : "NULL"));
 	return count ? buf : NULL;
-} /* getNonTag() */
+} /* scanNonTag() */
 
 char *
-getNthNonTagFromString(const char *s, int n)
+getNthNonTagFromString(arena_t *ap, const char *s, int n)
 {
 	memBuf_t buf;
 	int i;
@@ -241,16 +301,16 @@ getNthNonTagFromString(const char *s, int n)
 	strToMemBuf(s, &buf);
 	for (i = 1; i < n; i++)
 		getNonTag(&buf);
-	return myStrdup(getNonTag(&buf));
+	return myStrdupIn(ap, getNonTag(&buf));
 }
 
 char *
-getNonTagFromString(const char *s)
+getNonTagFromString(arena_t *ap, const char *s)
 {
 	memBuf_t buf;
 
 	strToMemBuf(s, &buf);
-	return myStrdup(getNonTag(&buf));
+	return myStrdupIn(ap, getNonTag(&buf));
 }
 
 int
@@ -372,22 +432,27 @@ getTableCell(memBuf_t *mp)
 
 /*
  * Return NULL-terminated table row, or NULL at end of table.
- * All cells are malloc'ed and should be freed by the calling function.
+ * The row is allocated from the scratch arena of the page and goes away
+ * with it.
  */
 char **
 getTableRow(memBuf_t *mp)
 {
-	char **ret = NULL, *cp = NULL;
+	arena_t *ap = memArena(mp);
+	char **ret = NULL, **old, *cp = NULL;
 	size_t size = 0, i = 0;
 
 	do {
 		cp = getTableCell(mp);
 		if (cp || i) {
 			if (i >= size) {
+				old = ret;
 				size += 10;
-				ret = (char **)myRealloc(ret, size * sizeof(char *));
+				ret = (char **)arenaAlloc(ap, size * sizeof(char *));
+				if (i)
+					memcpy(ret, old, i * sizeof(char *));
 			}
-			ret[i++] = myStrdup(cp);
+			ret[i++] = myStrdupIn(ap, cp);
 		}
 	} while ((cp));
 	return ret;
@@ -408,21 +473,6 @@ numColumns(char **row)
 	return --ncols;
 }
 
-/*
- * Free a TableRow allocated by getTableRow
- */
-void
-freeTableRow(char **row)
-{
-	char **cpp;
-
-	if (row) {
-		for (cpp = row; *cpp; ++cpp)
-			free(*cpp);
-		free(row);
-	}
-}
-
 /*
  * Search for next table tag.
  */
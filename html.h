@@ -29,6 +29,30 @@
 
 #include "http.h"
 
+/*
+ * HTML tokenizer, finds the tags and the text in between for getTag()
+ * and getNonTag().
+ */
+typedef struct {
+	const char *name;
+	const char *(*getTag)(memBuf_t *mp);
+	char *(*getNonTag)(memBuf_t *mp);
+	/* peak heap use since last call, NULL if not known */
+	size_t (*heapPeak)(void);
+} htmlTokenizer_t;
+
+/* the hand-written scanner, always available */
+extern const htmlTokenizer_t htmlScanner;
+/* all tokenizers in this build, NULL-terminated, the scanner first */
+extern const htmlTokenizer_t *const htmlTokenizers[];
+
+/*
+ * Select tokenizer by name.
+ * returns: 0 = OK, 1 = no such tokenizer in this build
+ */
+extern int htmlSetTokenizer(const char *name);
+extern const char *htmlTokenizerName(void);
+
 /*
  * Get next tag text, eliminating leading and trailing whitespace
  * and leaving only a single space for all internal whitespace.
@@ -40,8 +64,9 @@ extern const char *getTag(memBuf_t *mp);
  * and leaving only a single space for all internal whitespace.
  */
 extern char *getNonTag(memBuf_t *mp);
-extern char *getNthNonTagFromString(const char *s, int n);
-extern char *getNonTagFromString(const char *s);
+/* result is allocated from arena ap, or the heap if ap is NULL */
+extern char *getNthNonTagFromString(arena_t *ap, const char *s, int n);
+extern char *getNonTagFromString(arena_t *ap, const char *s);
 extern int getIntFromString(const char *s);
 
 /*
@@ -59,15 +84,11 @@ extern const char *getTableStart(memBuf_t *mp);
 
 /*
  * Return NULL-terminated table row, or NULL at end of table.
- * All cells are malloc'ed and should be freed by the calling function.
+ * The row is allocated from the scratch arena of the page and goes away
+ * with it.
  */
 extern char **getTableRow(memBuf_t *mp);
 
-/*
- * Free a TableRow allocated by getTableRow
- */
-extern void freeTableRow(char **row);
-
 /*
  * Return number of columns in row, or -1 if null.
  */
@@ -0,0 +1,458 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Tokenizer using the libxml2 HTML parser.
+ *
+ * The page is fed to a push parser.  Its SAX callbacks only note where
+ * each tag and comment that is really in the page starts and ends, tags
+ * the parser implies are skipped.  The spans are kept in the arena of the
+ * page, and the text of a tag or of the text between tags is read by the
+ * hand-written scanner, so both tokenizers return the same strings.  What
+ * libxml2 adds is finding the tags: a '<' in text or scripts does not
+ * start a tag, and comments and CDATA end where HTML says they end.
+ *
+ * Membufs from strToMemBuf() are fragments of a page, they are always
+ * read by the scanner.
+ */
+
+#include "htmlxml.h"
+
+#ifdef HAVE_LIBXML2
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <libxml/HTMLparser.h>
+#include <libxml/xmlmemory.h>
+#include "esniper.h"
+
+/* page is fed to the parser in chunks of this size, as it comes in */
+#define CHUNK_SIZE (64 * 1024)
+/* room for size of block, keeps alignment of malloc() */
+#define HEAP_HEADER 16
+
+typedef struct {
+	size_t start;	/* offset of '<' */
+	size_t end;	/* offset after '>' */
+} span_t;
+
+typedef struct {
+	const char *memory;	/* page the spans belong to */
+	size_t size;
+	size_t count;
+	span_t *spans;	/* tags and comments in page order (arena) */
+} tokens_t;
+
+/* state of the SAX callbacks */
+typedef struct {
+	htmlParserCtxtPtr ctxt;
+	const char *memory;
+	size_t size;
+	size_t count, allocated;
+	span_t *spans;	/* heap, copied to arena when done */
+} parse_t;
+
+static const char *xmlGetTag(memBuf_t *mp);
+static char *xmlGetNonTag(memBuf_t *mp);
+static size_t xmlHeapPeak(void);
+static tokens_t *getTokens(memBuf_t *mp);
+static tokens_t *tokenize(memBuf_t *mp);
+static size_t firstEnd(const tokens_t *tp, size_t pos);
+static void addSpan(parse_t *pp, size_t start, size_t end);
+static size_t lastEnd(const parse_t *pp);
+static int nameAt(const char *s, const char *end, const xmlChar *name);
+static void saxStartElement(void *ctx, const xmlChar *name, const xmlChar **atts);
+static void saxEndElement(void *ctx, const xmlChar *name);
+static void saxComment(void *ctx, const xmlChar *value);
+static void saxInternalSubset(void *ctx, const xmlChar *name, const xmlChar *externalID, const xmlChar *systemID);
+static void *heapMalloc(size_t size);
+static void *heapRealloc(void *ptr, size_t size);
+static void heapFree(void *ptr);
+static char *heapStrdup(const char *s);
+
+const htmlTokenizer_t htmlXmlTokenizer = {
+	"libxml2", xmlGetTag, xmlGetNonTag, xmlHeapPeak
+};
+
+/* heap used by libxml2 */
+static size_t heapNow = 0, heapMax = 0;
+
+static const char *
+xmlGetTag(memBuf_t *mp)
+{
+	tokens_t *tp = getTokens(mp);
+	memBuf_t span;
+	size_t pos, i;
+	const char *ret;
+
+	if (!tp)
+		return htmlScanner.getTag(mp);
+	pos = (size_t)(mp->readptr - mp->memory);
+	/* inside a tag, the scanner would go on to the next one */
+	for (i = firstEnd(tp, pos); i < tp->count && tp->spans[i].start < pos; ++i)
+		;
+	if (i == tp->count) {
+		mp->readptr = mp->memory + mp->size;
+		log(("getTag(): returning NULL\n"));
+		return NULL;
+	}
+	memset(&span, 0, sizeof(span));
+	span.fragment = 1;
+	span.memory = span.readptr = mp->memory + tp->spans[i].start;
+	span.size = tp->spans[i].end - tp->spans[i].start;
+	ret = htmlScanner.getTag(&span);
+	mp->readptr = mp->memory + tp->spans[i].end;
+	return ret;
+}
+
+static char *
+xmlGetNonTag(memBuf_t *mp)
+{
+	tokens_t *tp = getTokens(mp);
+
+	if (!tp)
+		return htmlScanner.getNonTag(mp);
+	while (!memEof(mp)) {
+		size_t pos = (size_t)(mp->readptr - mp->memory);
+		size_t i = firstEnd(tp, pos), stop;
+		memBuf_t text;
+		char *ret;
+
+		if (i < tp->count && tp->spans[i].start <= pos) {
+			mp->readptr = mp->memory + tp->spans[i].end;
+			continue;
+		}
+		stop = i < tp->count ? tp->spans[i].start : mp->size;
+		memset(&text, 0, sizeof(text));
+		text.fragment = 1;
+		text.memory = text.readptr = mp->readptr;
+		text.size = stop - pos;
+		ret = htmlScanner.getNonTag(&text);
+		mp->readptr = memEof(&text) ? mp->memory + stop : text.readptr;
+		if (ret)
+			return ret;
+	}
+	log(("getNonTag(): returning NULL\n"));
+	return NULL;
+}
+
+/*
+ * Peak heap used by libxml2 since last call.
+ */
+static size_t
+xmlHeapPeak(void)
+{
+	size_t ret = heapMax;
+
+	heapMax = heapNow;
+	return ret;
+}
+
+/*
+ * Spans of page, parsed on first use.
+ * returns: spans, NULL if mp must be read by the scanner
+ */
+static tokens_t *
+getTokens(memBuf_t *mp)
+{
+	tokens_t *tp = (tokens_t *)mp->tokens;
+
+	if (mp->fragment || !mp->memory)
+		return NULL;
+	if (!tp || tp->memory != mp->memory || tp->size != mp->size)
+		tp = tokenize(mp);
+	return tp;
+}
+
+static tokens_t *
+tokenize(memBuf_t *mp)
+{
+	static int initDone = 0;
+	htmlSAXHandler sax;
+	parse_t parse;
+	arena_t *ap;
+	tokens_t *tp;
+	size_t pos;
+
+	if (!initDone) {
+		/* must come before anything else of libxml2 */
+		xmlMemSetup(heapFree, heapMalloc, heapRealloc, heapStrdup);
+		xmlInitParser();
+		initDone = 1;
+	}
+	memset(&sax, 0, sizeof(sax));
+	sax.startElement = saxStartElement;
+	sax.endElement = saxEndElement;
+	sax.comment = saxComment;
+	sax.internalSubset = saxInternalSubset;
+	memset(&parse, 0, sizeof(parse));
+	parse.memory = mp->memory;
+	parse.size = mp->size;
+	parse.ctxt = htmlCreatePushParserCtxt(&sax, &parse, NULL, 0, NULL,
+					      XML_CHAR_ENCODING_NONE);
+	if (!parse.ctxt) {
+		log(("tokenize(): cannot create libxml2 parser\n"));
+		return NULL;
+	}
+	htmlCtxtUseOptions(parse.ctxt, HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING |
+			   HTML_PARSE_NONET | HTML_PARSE_NOIMPLIED);
+	for (pos = 0; pos < mp->size; pos += CHUNK_SIZE) {
+		size_t n = mp->size - pos;
+
+		htmlParseChunk(parse.ctxt, mp->memory + pos,
+			       (int)(n < CHUNK_SIZE ? n : CHUNK_SIZE), 0);
+	}
+	htmlParseChunk(parse.ctxt, NULL, 0, 1);
+	htmlFreeParserCtxt(parse.ctxt);
+
+	ap = memArena(mp);
+	tp = (tokens_t *)arenaAlloc(ap, sizeof(tokens_t));
+	tp->memory = mp->memory;
+	tp->size = mp->size;
+	tp->count = parse.count;
+	tp->spans = (span_t *)arenaAlloc(ap, (parse.count ? parse.count : 1) *
+					  sizeof(span_t));
+	if (parse.count)
+		memcpy(tp->spans, parse.spans, parse.count * sizeof(span_t));
+	free(parse.spans);
+	mp->tokens = tp;
+	log(("tokenize(): %lu tags in %lu bytes\n",
+	     (unsigned long)tp->count, (unsigned long)tp->size));
+	return tp;
+}
+
+/*
+ * Index of first span that ends after pos, count if none.
+ */
+static size_t
+firstEnd(const tokens_t *tp, size_t pos)
+{
+	size_t lo = 0, hi = tp->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (tp->spans[mid].end <= pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void
+addSpan(parse_t *pp, size_t start, size_t end)
+{
+	if (start < lastEnd(pp))
+		return;
+	if (pp->count == pp->allocated) {
+		pp->allocated = pp->allocated ? pp->allocated * 2 : 1024;
+		pp->spans = (span_t *)myRealloc(pp->spans,
+					pp->allocated * sizeof(span_t));
+	}
+	pp->spans[pp->count].start = start;
+	pp->spans[pp->count].end = end;
+	++pp->count;
+}
+
+static size_t
+lastEnd(const parse_t *pp)
+{
+	return pp->count ? pp->spans[pp->count - 1].end : 0;
+}
+
+/*
+ * Is there tag name name at s?
+ */
+static int
+nameAt(const char *s, const char *end, const xmlChar *name)
+{
+	size_t len = strlen((const char *)name);
+
+	if ((size_t)(end - s) <= len ||
+	    strncasecmp(s, (const char *)name, len))
+		return 0;
+	s += len;
+	return *s == '>' || *s == '/' || *s == ' ' || *s == '\t' ||
+	       *s == '\n' || *s == '\r' || *s == '\f';
+}
+
+/*
+ * Start tag.  The parser stands on its '>'.
+ */
+static void
+saxStartElement(void *ctx, const xmlChar *name, const xmlChar **atts)
+{
+	parse_t *pp = (parse_t *)ctx;
+	long off = xmlByteConsumed(pp->ctxt);
+	const char *end = pp->memory + pp->size, *cp, *gt;
+
+	if (off < 0 || (size_t)off >= pp->size)
+		return;
+	gt = memchr(pp->memory + off, '>', pp->size - (size_t)off);
+	if (!gt)
+		return;
+	for (cp = pp->memory + off; cp >= pp->memory + lastEnd(pp); --cp) {
+		if (*cp == '<') {
+			if (nameAt(cp + 1, end, name))
+				addSpan(pp, (size_t)(cp - pp->memory),
+					(size_t)(gt + 1 - pp->memory));
+			return;
+		}
+	}
+}
+
+/*
+ * End tag.  The parser stands behind its '>', or anywhere if the end
+ * tag is implied.
+ */
+static void
+saxEndElement(void *ctx, const xmlChar *name)
+{
+	parse_t *pp = (parse_t *)ctx;
+	long off = xmlByteConsumed(pp->ctxt);
+	const char *cp;
+
+	if (off <= 0 || (size_t)off > pp->size || pp->memory[off - 1] != '>')
+		return;
+	for (cp = pp->memory + off - 1; cp >= pp->memory + lastEnd(pp); --cp) {
+		if (*cp == '<') {
+			if (cp[1] == '/' &&
+			    nameAt(cp + 2, pp->memory + off, name))
+				addSpan(pp, (size_t)(cp - pp->memory),
+					(size_t)off);
+			return;
+		}
+	}
+}
+
+/*
+ * Comment.  The parser stands behind "-->".
+ */
+static void
+saxComment(void *ctx, const xmlChar *value)
+{
+	parse_t *pp = (parse_t *)ctx;
+	long off = xmlByteConsumed(pp->ctxt);
+	const char *cp;
+
+	if (off < 4 || (size_t)off > pp->size || pp->memory[off - 1] != '>')
+		return;
+	for (cp = pp->memory + off - 4; cp >= pp->memory + lastEnd(pp); --cp) {
+		if (!strncmp(cp, "<!--", 4)) {
+			addSpan(pp, (size_t)(cp - pp->memory), (size_t)off);
+			return;
+		}
+	}
+}
+
+/*
+ * <!DOCTYPE ...>.  The parser stands behind its '>'.
+ */
+static void
+saxInternalSubset(void *ctx, const xmlChar *name, const xmlChar *externalID,
+		  const xmlChar *systemID)
+{
+	parse_t *pp = (parse_t *)ctx;
+	long off = xmlByteConsumed(pp->ctxt);
+	const char *cp;
+
+	if (off < 2 || (size_t)off > pp->size || pp->memory[off - 1] != '>')
+		return;
+	for (cp = pp->memory + off - 2; cp >= pp->memory + lastEnd(pp); --cp) {
+		if (*cp == '<') {
+			if (cp[1] == '!')
+				addSpan(pp, (size_t)(cp - pp->memory),
+					(size_t)off);
+			return;
+		}
+	}
+}
+
+/*
+ * Memory functions for libxml2, which keep track of its heap.
+ */
+static void *
+heapMalloc(size_t size)
+{
+	char *p = (char *)malloc(size + HEAP_HEADER);
+
+	if (!p)
+		return NULL;
+	*(size_t *)p = size;
+	heapNow += size;
+	if (heapNow > heapMax)
+		heapMax = heapNow;
+	return p + HEAP_HEADER;
+}
+
+static void *
+heapRealloc(void *ptr, size_t size)
+{
+	char *p, *q;
+	size_t old;
+
+	if (!ptr)
+		return heapMalloc(size);
+	p = (char *)ptr - HEAP_HEADER;
+	old = *(size_t *)p;
+	if (!(q = (char *)realloc(p, size + HEAP_HEADER)))
+		return NULL;
+	*(size_t *)q = size;
+	heapNow = heapNow - old + size;
+	if (heapNow > heapMax)
+		heapMax = heapNow;
+	return q + HEAP_HEADER;
+}
+
+static void
+heapFree(void *ptr)
+{
+	char *p;
+
+	if (!ptr)
+		return;
+	p = (char *)ptr - HEAP_HEADER;
+	heapNow -= *(size_t *)p;
+	free(p);
+}
+
+static char *
+heapStrdup(const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *p = (char *)heapMalloc(len);
+
+	if (p)
+		memcpy(p, s, len);
+	return p;
+}
+
+#else
+/* ISO C does not allow an empty source file */
+typedef int htmlXmlNotBuilt;
+#endif /* HAVE_LIBXML2 */
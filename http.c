@@ -26,7 +26,10 @@
 
 #define _GNU_SOURCE
 #include "http.h"
+#include "capture.h"
 #include "esniper.h"
+#include "resolve.h"
+#include "trace.h"
 #include <ctype.h>
 #include <curl/curl.h>
 #include <curl/easy.h>
@@ -34,22 +37,58 @@
 #include <string.h>
 #if defined(WIN32)
 #	define DEVNULL "nul"
+#	define strncasecmp(s1, s2, len) strnicmp((s1), (s2), (len))
 #else
 #	define DEVNULL "/dev/null"
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
 #endif
 
-enum requestType {GET, POST};
+/* GET_COND: conditional GET, answered from cache if page is unchanged */
+enum requestType {GET, GET_COND, POST};
+
+/* pages kept for conditional requests */
+#define COND_CACHE_SIZE 32
+
+typedef struct {
+	char *url;
+	char *etag;
+	char *lastModified;
+	char *body;
+	size_t size;
+	time_t fetched;	/* when body was sent by the server */
+	time_t used;
+} condEntry_t;
 
 static CURL *easyhandle = NULL;
+/* connection, DNS and SSL session caches, shared by all easy handles */
+static CURLSH *sharehandle = NULL;
 static CURLcode curlrc = CURLE_OK;
 static char *lastURL = NULL;
 static int curlInitDone = 0;
 static char globalErrorbuf[CURL_ERROR_SIZE];
+static httpTiming_t lastTiming;
+static unsigned int resolveGeneration = 0;	/* resolver cache applied */
+static struct curl_slist *headers = NULL;	/* default request headers */
+static condEntry_t condCache[COND_CACHE_SIZE];
+/* validators of current response */
+static char *respEtag = NULL;
+static char *respLastModified = NULL;
+static arena_t *spareArena = NULL;	/* of last page freed */
 
 static memBuf_t *httpRequest(const char *url, const char *logUrl, const char *data, const char *logData, enum requestType);
 static memBuf_t *httpRequestFailed(memBuf_t *mp);
+static void memArenaRelease(memBuf_t *mp);
+static memBuf_t *httpRequestDone(memBuf_t *mp);
+static memBuf_t *httpReplay(const char *logUrl, enum requestType rt, memBuf_t *mp);
 static size_t WriteMemoryCallback(void *ptr, size_t size, size_t nmemb, void *data);
+static size_t HeaderCallback(void *ptr, size_t size, size_t nmemb, void *data);
+static condEntry_t *condFind(const char *url);
+static void condStore(const char *url, const memBuf_t *mp);
+static int initCurlShare(void);
 static int initCurlStuffFailed(void);
+static void getTiming(httpTiming_t *tp);
 
 #ifdef NEED_CURL_EASY_STRERROR
 static const char *curl_easy_strerror(CURLcode error);
@@ -79,6 +118,19 @@ httpGet(const char *url, const char *logUrl)
 	return httpRequest(url, logUrl, "", NULL, GET);
 }
 
+/*
+ * Like httpGet(), but if the page has been fetched before, ask the server
+ * whether it changed (If-None-Match/If-Modified-Since), and return the
+ * cached copy if it did not.  Only for pages without side effects.
+ * A cached copy is as old as timing.fetched of the membuf, relative times
+ * on it (time left) count from then.
+ */
+memBuf_t *
+httpGetCond(const char *url, const char *logUrl)
+{
+	return httpRequest(url, logUrl, "", NULL, GET_COND);
+}
+
 /* returns open socket, or NULL on error */
 memBuf_t *
 httpPost(const char *url, const char *data, const char *logData)
@@ -87,13 +139,17 @@ httpPost(const char *url, const char *data, const char *logData)
 }
 
 /*
- * Create a membuf from a string.
+ * Create a membuf from a string.  The membuf refers to s, it is not copied.
  */
 memBuf_t *
 strToMemBuf(const char *s, memBuf_t *mp)
 {
 	mp->timeToFirstByte = time(NULL);
-	mp->memory = myStrdup(s);
+	memset(&mp->timing, 0, sizeof(mp->timing));
+	mp->arena = NULL;
+	mp->tokens = NULL;
+	mp->fragment = 1;
+	mp->memory = (char *)s;
 	mp->readptr = mp->memory;
 	mp->size = s ? strlen(s) : 0;
 	return mp;
@@ -107,34 +163,111 @@ freeMembuf(memBuf_t *mp)
 {
 	if (mp) {
 		free(mp->memory);
+		memArenaRelease(mp);
 		free(mp);
 	}
 }
 
 /*
- * Create a membuf from a file.
+ * Scratch arena of a page.  Everything the parsers allocate from it goes
+ * away with the page.  Not for membufs from strToMemBuf(), which are never
+ * freed.
+ */
+arena_t *
+memArena(memBuf_t *mp)
+{
+	if (!mp->arena) {
+		if (spareArena) {
+			mp->arena = spareArena;
+			spareArena = NULL;
+		} else
+			mp->arena = arenaNew(0);
+	}
+	return mp->arena;
+}
+
+/*
+ * Give back scratch arena of page.  One is kept for the next page, so
+ * a watch loop runs without any malloc() for the arena.
+ */
+static void
+memArenaRelease(memBuf_t *mp)
+{
+	if (!mp->arena)
+		return;
+	if (spareArena)
+		arenaFree(mp->arena);
+	else {
+		arenaReset(mp->arena);
+		spareArena = mp->arena;
+	}
+	mp->arena = NULL;
+	mp->tokens = NULL;
+}
+
+/*
+ * Create a membuf from a file.  The membuf is valid until the next call.
+ *
+ * Regular files are mapped into memory.  The rest of the last page is
+ * zero filled, which terminates the page as a string, so a file that
+ * ends on a page boundary is read like a pipe.
  */
 memBuf_t *
 readFile(FILE *fp)
 {
 	static memBuf_t membuf = { NULL, 0, NULL, 0 };
-	static const size_t BUFINC = 20 * 1024;
+	static size_t mapped = 0;	/* length of mapping, 0 if malloced */
+	static const size_t BUFINC = 64 * 1024;
 	size_t i = 0;
-	int c;
 
-	if (membuf.memory)
+	memArenaRelease(&membuf);
+
+#if !defined(WIN32)
+	if (mapped)
+		munmap(membuf.memory, mapped);
+	else
+#endif
 		free(membuf.memory);
-	membuf.size = BUFINC;
-	membuf.memory = (char *)myMalloc(membuf.size);
-	while ((c = getc(fp)) != EOF) {
-		if (i == membuf.size) {
-			membuf.size += BUFINC;
-			membuf.memory = (char *)myRealloc(membuf.memory, membuf.size);
+	membuf.memory = NULL;
+	mapped = 0;
+#if !defined(WIN32)
+	{
+		struct stat st;
+		long pagesize = sysconf(_SC_PAGESIZE);
+
+		if (!fstat(fileno(fp), &st) && S_ISREG(st.st_mode) &&
+		    st.st_size > 0 && pagesize > 0 &&
+		    st.st_size % pagesize) {
+			/* private, writable: parsers may change the page */
+			void *p = mmap(NULL, (size_t)st.st_size,
+				       PROT_READ|PROT_WRITE, MAP_PRIVATE,
+				       fileno(fp), 0);
+
+			if (p != MAP_FAILED) {
+				membuf.memory = (char *)p;
+				i = mapped = (size_t)st.st_size;
+			}
+		}
+	}
+#endif
+	if (!mapped) {
+		size_t n;
+
+		membuf.size = BUFINC;
+		membuf.memory = (char *)myMalloc(membuf.size);
+		while ((n = fread(membuf.memory + i, 1, membuf.size - i - 1, fp))) {
+			i += n;
+			if (i + 1 == membuf.size) {
+				membuf.size *= 2;
+				membuf.memory = (char *)myRealloc(membuf.memory, membuf.size);
+			}
 		}
-		membuf.memory[i++] = (char)c;
+		membuf.memory[i] = '\0';
 	}
 	membuf.size = i;
 	membuf.readptr = membuf.memory;
+	membuf.timeToFirstByte = 0;
+	memset(&membuf.timing, 0, sizeof(membuf.timing));
 	return &membuf;
 }
 
@@ -143,15 +276,26 @@ httpRequest(const char *url, const char *logUrl, const char *data, const char *l
 {
 	const char *nonNullData = data ? data : "";
 	memBuf_t *mp = (memBuf_t *)myMalloc(sizeof(memBuf_t));
-	char *metaRefresh;
+	struct curl_slist *list, *condHeaders = NULL;
+	condEntry_t *cp = NULL;
+	long responseCode = 0;
+	time_t requested = time(NULL);
 
 	mp->memory = mp->readptr = NULL;
 	mp->size = 0;
 	mp->timeToFirstByte = 0;
+	memset(&mp->timing, 0, sizeof(mp->timing));
+	mp->arena = NULL;
+	mp->tokens = NULL;
+	mp->fragment = 0;
+	memset(&lastTiming, 0, sizeof(lastTiming));
 
 	if(lastURL) free(lastURL);
 	lastURL = myStrdup(url);
 
+	if (replayActive())
+		return httpReplay(logUrl ? logUrl : url, rt, mp);
+
 	if (!curlInitDone && initCurlStuff())
 		return NULL;
 
@@ -160,8 +304,10 @@ httpRequest(const char *url, const char *logUrl, const char *data, const char *l
 	 */
 	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_FILE, (void *)mp)))
 		return httpRequestFailed(mp);
+	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_WRITEHEADER, (void *)mp)))
+		return httpRequestFailed(mp);
 
-	if (rt == GET) {
+	if (rt == GET || rt == GET_COND) {
 		if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_HTTPGET, 1)))
 			return httpRequestFailed(mp);
 	} else {
@@ -174,8 +320,106 @@ httpRequest(const char *url, const char *logUrl, const char *data, const char *l
 	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_URL, url)))
 		return httpRequestFailed(mp);
 
-	if ((curlrc = curl_easy_perform(easyhandle)))
+	/* pre-resolved addresses */
+	if ((list = resolveList(&resolveGeneration)) &&
+	    (curlrc = curl_easy_setopt(easyhandle, CURLOPT_RESOLVE, list)))
+		return httpRequestFailed(mp);
+
+	/* validators of cached copy */
+	if (rt == GET_COND && (cp = condFind(url))) {
+		struct curl_slist *sp;
+
+		for (sp = headers; sp; sp = sp->next)
+			condHeaders = curl_slist_append(condHeaders, sp->data);
+		if (cp->etag) {
+			char *h = myStrdup2("If-None-Match: ", cp->etag);
+
+			condHeaders = curl_slist_append(condHeaders, h);
+			free(h);
+		}
+		if (cp->lastModified) {
+			char *h = myStrdup2("If-Modified-Since: ",
+					    cp->lastModified);
+
+			condHeaders = curl_slist_append(condHeaders, h);
+			free(h);
+		}
+		if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_HTTPHEADER, condHeaders))) {
+			curl_slist_free_all(condHeaders);
+			return httpRequestFailed(mp);
+		}
+	}
+
+	free(respEtag);
+	free(respLastModified);
+	respEtag = respLastModified = NULL;
+	traceBegin(te_http, NULL);
+	curlrc = curl_easy_perform(easyhandle);
+	traceEnd(te_http);
+	if (condHeaders) {
+		curl_easy_setopt(easyhandle, CURLOPT_HTTPHEADER, headers);
+		curl_slist_free_all(condHeaders);
+	}
+	curl_easy_getinfo(easyhandle, CURLINFO_RESPONSE_CODE, &responseCode);
+	getTiming(&lastTiming);
+	lastTiming.fetched = requested;
+	if (!curlrc && cp && responseCode == 304) {
+		/* unchanged, use cached copy */
+		mp->memory = (char *)myMalloc(cp->size + 1);
+		memcpy(mp->memory, cp->body, cp->size);
+		mp->memory[cp->size] = '\0';
+		mp->readptr = mp->memory;
+		mp->size = cp->size;
+		cp->used = time(NULL);
+		lastTiming.notModified = 1;
+		/* times on the page are relative to the first fetch */
+		lastTiming.fetched = cp->fetched;
+	} else if (!curlrc && rt == GET_COND && responseCode == 200)
+		condStore(url, mp);
+	lastTiming.bodySize = (long)mp->size;
+	log(("timing: dns %.3f connect %.3f ssl %.3f pretransfer %.3f "
+	     "firstbyte %.3f total %.3f sent %ld received %ld body %ld%s",
+	     lastTiming.namelookup, lastTiming.connect, lastTiming.appconnect,
+	     lastTiming.pretransfer, lastTiming.starttransfer,
+	     lastTiming.total, lastTiming.bytesSent,
+	     lastTiming.bytesReceived, lastTiming.bodySize,
+	     lastTiming.notModified ? " (not modified)" : ""));
+	captureWrite(rt == POST, logUrl ? logUrl : url,
+		     logData ? logData : nonNullData, (int)curlrc,
+		     responseCode, &lastTiming, mp);
+	if (curlrc)
+		return httpRequestFailed(mp);
+	return httpRequestDone(mp);
+}
+
+/*
+ * Answer request from capture file, see capture.c.
+ */
+static memBuf_t *
+httpReplay(const char *logUrl, enum requestType rt, memBuf_t *mp)
+{
+	int code;
+	long responseCode;
+
+	log(("%s (replay)", logUrl));
+	if (replayNext(rt == POST, logUrl, &code, &responseCode, &lastTiming, mp)) {
+		curlrc = CURLE_COULDNT_CONNECT;
+		strcpy(globalErrorbuf, "request not in capture file");
+		return httpRequestFailed(mp);
+	}
+	if ((curlrc = (CURLcode)code)) {
+		strcpy(globalErrorbuf, "replayed error");
 		return httpRequestFailed(mp);
+	}
+	return httpRequestDone(mp);
+}
+
+static memBuf_t *
+httpRequestDone(memBuf_t *mp)
+{
+	char *metaRefresh;
+
+	mp->timing = lastTiming;
 
 	log(("checking for META Refresh"));
 	if ((metaRefresh = memGetMetaRefresh(mp)) != NULL) {
@@ -196,21 +440,82 @@ httpRequestFailed(memBuf_t *mp)
 	return NULL;
 }
 
+const httpTiming_t *
+httpLastTiming(void)
+{
+	return &lastTiming;
+}
+
+/*
+ * Fill in timing of last transfer.  The curl_off_t variants are used
+ * where available, the double ones are deprecated.
+ */
+static void
+getTiming(httpTiming_t *tp)
+{
+#if LIBCURL_VERSION_NUM >= 0x073d00
+	static const CURLINFO info[] = {
+		CURLINFO_NAMELOOKUP_TIME_T, CURLINFO_CONNECT_TIME_T,
+		CURLINFO_APPCONNECT_TIME_T, CURLINFO_PRETRANSFER_TIME_T,
+		CURLINFO_STARTTRANSFER_TIME_T, CURLINFO_TOTAL_TIME_T
+	};
+	curl_off_t value[6], size = 0;
+#else
+	static const CURLINFO info[] = {
+		CURLINFO_NAMELOOKUP_TIME, CURLINFO_CONNECT_TIME,
+		CURLINFO_APPCONNECT_TIME, CURLINFO_PRETRANSFER_TIME,
+		CURLINFO_STARTTRANSFER_TIME, CURLINFO_TOTAL_TIME
+	};
+	double value[6], size = 0;
+#endif
+	long headerSize = 0, requestSize = 0;
+	int i;
+
+	for (i = 0; i < 6; ++i) {
+		value[i] = 0;
+		curl_easy_getinfo(easyhandle, info[i], &value[i]);
+	}
+#if LIBCURL_VERSION_NUM >= 0x073d00
+	curl_easy_getinfo(easyhandle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+	tp->namelookup = (double)value[0] / 1e6;
+	tp->connect = (double)value[1] / 1e6;
+	tp->appconnect = (double)value[2] / 1e6;
+	tp->pretransfer = (double)value[3] / 1e6;
+	tp->starttransfer = (double)value[4] / 1e6;
+	tp->total = (double)value[5] / 1e6;
+#else
+	curl_easy_getinfo(easyhandle, CURLINFO_SIZE_DOWNLOAD, &size);
+	tp->namelookup = value[0];
+	tp->connect = value[1];
+	tp->appconnect = value[2];
+	tp->pretransfer = value[3];
+	tp->starttransfer = value[4];
+	tp->total = value[5];
+#endif
+	curl_easy_getinfo(easyhandle, CURLINFO_HEADER_SIZE, &headerSize);
+	curl_easy_getinfo(easyhandle, CURLINFO_REQUEST_SIZE, &requestSize);
+	tp->bytesSent = requestSize;
+	tp->bytesReceived = (long)size + headerSize;
+}
+
 /*
  * Returns 0 on success, non-0 otherwise.
  */
 int
 initCurlStuff(void)
 {
-	/* list for custom headers */
-	struct curl_slist *slist=NULL;
-
 	curl_global_init(CURL_GLOBAL_ALL);
 
+	if (!sharehandle && initCurlShare())
+		return -1;
+
 	/* init the curl session */
 	if (!(easyhandle = curl_easy_init()))
 		return -1;
 
+	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_SHARE, sharehandle)))
+		return initCurlStuffFailed();
+
 	/* buffer for error messages */
 	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_ERRORBUFFER, globalErrorbuf)))
 		return initCurlStuffFailed();
@@ -250,20 +555,87 @@ initCurlStuff(void)
 	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_COOKIEFILE, "")))
 		return initCurlStuffFailed();
 
-	slist = curl_slist_append(slist, "Accept: text/*");
-	slist = curl_slist_append(slist, "Accept-Language: en");
-	slist = curl_slist_append(slist, "Accept-Charset: iso-8859-1,*,utf-8");
-	slist = curl_slist_append(slist, "Cache-Control: no-cache");
-	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_HTTPHEADER, slist)))
+	/* collect response validators, see httpGetCond() */
+	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_HEADERFUNCTION, HeaderCallback)))
+		return initCurlStuffFailed();
+
+	/* ask for compressed pages, libcurl decompresses them on the fly.
+	 * "" means all encodings libcurl was built with (gzip, br, ...)
+	 */
+#if LIBCURL_VERSION_NUM >= 0x071506
+	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_ACCEPT_ENCODING, "")))
+#else
+	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_ENCODING, "")))
+#endif
+		return initCurlStuffFailed();
+
+	if (!headers) {
+		headers = curl_slist_append(headers, "Accept: text/*");
+		headers = curl_slist_append(headers, "Accept-Language: en");
+		headers = curl_slist_append(headers, "Accept-Charset: iso-8859-1,*,utf-8");
+		headers = curl_slist_append(headers, "Cache-Control: no-cache");
+	}
+	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_HTTPHEADER, headers)))
 		return initCurlStuffFailed();
 
 	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_COOKIEFILE, DEVNULL)))
 		return initCurlStuffFailed();
 
+	/* new handle does not know the resolver cache yet */
+	resolveGeneration = 0;
+
 	curlInitDone = 1;
 	return 0;
 }
 
+/*
+ * Create share handle.  Cookies are not shared, they belong to the
+ * login session of each easy handle.
+ *
+ * Returns 0 on success, non-0 otherwise.
+ */
+static int
+initCurlShare(void)
+{
+	CURLSHcode rc;
+
+	if (!(sharehandle = curl_share_init()))
+		return -1;
+	rc = curl_share_setopt(sharehandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	if (!rc)
+		rc = curl_share_setopt(sharehandle, CURLSHOPT_SHARE,
+				       CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+	/* connection pool can be shared since libcurl 7.57.0 */
+	if (!rc)
+		rc = curl_share_setopt(sharehandle, CURLSHOPT_SHARE,
+				       CURL_LOCK_DATA_CONNECT);
+#endif
+	if (rc) {
+		log(("initCurlShare(): %s", curl_share_strerror(rc)));
+		curl_share_cleanup(sharehandle);
+		sharehandle = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Start a new login session: forget all cookies, but keep connections
+ * and caches.
+ *
+ * Returns 0 on success, non-0 otherwise.
+ */
+int
+httpResetSession(void)
+{
+	if (!curlInitDone)
+		return initCurlStuff();
+	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_COOKIELIST, "ALL")))
+		return initCurlStuffFailed();
+	return 0;
+}
+
 static int
 initCurlStuffFailed(void)
 {
@@ -279,6 +651,12 @@ cleanupCurlStuff(void)
 		curl_easy_cleanup(easyhandle);
 		easyhandle = NULL;
 	}
+	if (sharehandle) {
+		curl_share_cleanup(sharehandle);
+		sharehandle = NULL;
+	}
+	curl_slist_free_all(headers);
+	headers = NULL;
 	curl_global_cleanup();
 	curlInitDone = 0;
 }
@@ -300,6 +678,100 @@ WriteMemoryCallback(void *ptr, size_t size, size_t nmemb, void *data)
 	return realsize;
 }
 
+/*
+ * Note response validators.  Headers of redirects are forgotten when the
+ * next status line arrives.
+ */
+static size_t
+HeaderCallback(void *ptr, size_t size, size_t nmemb, void *data)
+{
+	size_t realsize = size * nmemb;
+	memBuf_t *mp = (memBuf_t *)data;
+	const char *line = (const char *)ptr;
+	char **valuep = NULL;
+	size_t skip = 0;
+
+	if (!mp->timeToFirstByte)
+		mp->timeToFirstByte = time(NULL);
+
+	if (realsize >= 5 && !strncmp(line, "HTTP/", 5)) {
+		free(respEtag);
+		free(respLastModified);
+		respEtag = respLastModified = NULL;
+	} else if (realsize > 5 && !strncasecmp(line, "ETag:", 5)) {
+		valuep = &respEtag;
+		skip = 5;
+	} else if (realsize > 14 && !strncasecmp(line, "Last-Modified:", 14)) {
+		valuep = &respLastModified;
+		skip = 14;
+	}
+	if (valuep) {
+		size_t len = realsize;
+
+		while (skip < len && isspace((unsigned char)line[skip]))
+			++skip;
+		while (len > skip && isspace((unsigned char)line[len - 1]))
+			--len;
+		free(*valuep);
+		*valuep = (char *)myMalloc(len - skip + 1);
+		memcpy(*valuep, line + skip, len - skip);
+		(*valuep)[len - skip] = '\0';
+	}
+	return realsize;
+}
+
+/*
+ * returns: cached copy of url, NULL if there is none
+ */
+static condEntry_t *
+condFind(const char *url)
+{
+	int i;
+
+	for (i = 0; i < COND_CACHE_SIZE; ++i) {
+		if (condCache[i].url && !strcmp(condCache[i].url, url))
+			return &condCache[i];
+	}
+	return NULL;
+}
+
+/*
+ * Keep copy of page if the server sent validators, replacing the least
+ * recently used entry if the cache is full.
+ */
+static void
+condStore(const char *url, const memBuf_t *mp)
+{
+	condEntry_t *cp = condFind(url);
+	int i;
+
+	if (!cp) {
+		if (!respEtag && !respLastModified)
+			return;
+		cp = &condCache[0];
+		for (i = 0; i < COND_CACHE_SIZE && cp->url; ++i) {
+			if (!condCache[i].url || condCache[i].used < cp->used)
+				cp = &condCache[i];
+		}
+	}
+	free(cp->url);
+	free(cp->etag);
+	free(cp->lastModified);
+	free(cp->body);
+	memset(cp, 0, sizeof(*cp));
+	if (!respEtag && !respLastModified)
+		return;
+	cp->url = myStrdup(url);
+	cp->etag = respEtag ? myStrdup(respEtag) : NULL;
+	cp->lastModified = respLastModified ? myStrdup(respLastModified) : NULL;
+	cp->body = (char *)myMalloc(mp->size + 1);
+	if (mp->size)
+		memcpy(cp->body, mp->memory, mp->size);
+	cp->size = mp->size;
+	cp->fetched = lastTiming.fetched;
+	cp->used = time(NULL);
+}
+
 int
 memEof(memBuf_t *mp)
 {
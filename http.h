@@ -27,13 +27,36 @@
 #ifndef HTTP_H_INCLUDED
 #define HTTP_H_INCLUDED
 
+#include "arena.h"
 #include "auctioninfo.h"
 
+/*
+ * Phases of a request as reported by libcurl, in seconds from the start
+ * of the request.  Each phase includes the ones before it.
+ */
+typedef struct {
+   double namelookup;	/* DNS lookup done */
+   double connect;	/* TCP connect done */
+   double appconnect;	/* SSL handshake done, 0 for plain http */
+   double pretransfer;	/* about to send request */
+   double starttransfer;	/* first byte of response received */
+   double total;	/* transfer done, including redirects */
+   long bytesSent;
+   long bytesReceived;	/* on the wire, compressed */
+   long bodySize;	/* decompressed */
+   int notModified;	/* page unchanged, answered from cache */
+   time_t fetched;	/* page fetched, older than request if notModified */
+} httpTiming_t;
+
 typedef struct {
    char *memory;
    size_t size;
    char *readptr;
    time_t timeToFirstByte;
+   httpTiming_t timing;
+   arena_t *arena;	/* scratch memory of parsers, see memArena() */
+   void *tokens;	/* tokenizer state of page (arena), see html.c */
+   int fragment;	/* from strToMemBuf(), no arena */
 } memBuf_t;
 
 extern int memEof(memBuf_t *mp);
@@ -46,12 +69,17 @@ extern char *memCaseStr(memBuf_t *mp, const char *s);
 extern char *memChr(memBuf_t *mp, char c);
 extern char *memGetMetaRefresh(memBuf_t *mp);
 extern time_t getTimeToFirstByte(memBuf_t *mp);
+extern arena_t *memArena(memBuf_t *mp);
+/* timing of last request, also if it failed */
+extern const httpTiming_t *httpLastTiming(void);
 
 extern int initCurlStuff(void);
 extern void cleanupCurlStuff(void);
+extern int httpResetSession(void);
 
 extern int httpError(auctionInfo *aip);
 extern memBuf_t *httpGet(const char *url, const char *logUrl);
+extern memBuf_t *httpGetCond(const char *url, const char *logUrl);
 extern memBuf_t *httpPost(const char *url, const char *data, const char *logData);
 extern void freeMembuf(memBuf_t *mp);
 extern memBuf_t *strToMemBuf(const char *s, memBuf_t *buf);
@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * State journal.
+ *
+ * Every change of auction state worth keeping is appended to the journal
+ * as one tab separated line:
+ *
+ *	I <time> <auction> <endTime> <price> <quantity> <quantityBid> <bids>
+ *	  <won> <winning> <reserve> <currency> <title>	auction info fetched
+ *	B <time> <auction> <bidResult>			bid placed
+ *	W <time> <auction> <won>			outcome checked
+ *
+ * Lines are flushed immediately, so nothing is lost if esniper dies.
+ * fsync() is batched: it is done after a bid or won check, before
+ * sleeping, and every JOURNAL_SYNC_RECORDS records.
+ *
+ * On startup the journal is replayed into a table holding the latest
+ * state of each auction, and rewritten from that table, which drops
+ * auctions that ended more than JOURNAL_KEEP seconds ago.
+ *
+ * Bid keys are not journaled: they belong to the eBay login session,
+ * which does not survive a restart.
+ */
+
+#include "journal.h"
+#include "buffer.h"
+#include "esniper.h"
+#include "util.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(WIN32)
+#	include <io.h>
+#	define fsync(fd) _commit(fd)
+#else
+#	include <unistd.h>
+#endif
+
+#define JOURNAL_SYNC_RECORDS 32
+/* forget auctions one week after they ended */
+#define JOURNAL_KEEP (7 * 86400)
+#define JOURNAL_MAXFIELDS 13
+
+typedef struct {
+	char *auction;
+	time_t infoTime;	/* time of last info record, 0 = none */
+	time_t endTime;
+	double price;
+	int quantity;
+	int quantityBid;
+	int bids;
+	int won;
+	int winning;
+	int reserve;
+	char *currency;
+	char *title;
+	time_t bidTime;		/* time of last bid, 0 = none */
+	int bidResult;
+	time_t wonTime;		/* time outcome was checked, 0 = unknown */
+	int wonCount;
+} journalEntry_t;
+
+static FILE *journalFp = NULL;
+static char *journalName = NULL;
+static int pending = 0;
+static journalEntry_t *entries = NULL;
+static int numEntries = 0;
+
+static journalEntry_t *findEntry(const char *auction, int create);
+static int applyRecord(char *line);
+static void writeRecord(int sync, const char *fmt, ...);
+static int writeEntries(FILE *fp);
+static char *cleanField(const char *s);
+
+/*
+ * journalOpen(): replay journal, rewrite it and open it for appending.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+journalOpen(const char *filename)
+{
+	FILE *fp;
+	char *buf = NULL, *tmpname;
+	size_t bufsize = 0, count = 0;
+	int c, records = 0, bad = 0;
+
+	if ((fp = fopen(filename, "r"))) {
+		while ((c = getc(fp)) != EOF) {
+			if (c != '\n') {
+				addchar(buf, bufsize, count, (char)c);
+				continue;
+			}
+			term(buf, bufsize, count);
+			if (applyRecord(buf))
+				++bad;
+			else
+				++records;
+			count = 0;
+		}
+		/* partial last line: esniper died while writing it */
+		if (count)
+			++bad;
+		fclose(fp);
+		free(buf);
+		printLog(stdout, "Journal %s: %d record(s) replayed, %d auction(s)\n",
+			 filename, records, numEntries);
+		if (bad)
+			printLog(stderr, "Journal %s: %d bad record(s) ignored\n",
+				 filename, bad);
+	} else if (errno != ENOENT) {
+		printLog(stderr, "Cannot read journal %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+
+	/* write compacted journal, then replace the old one */
+	tmpname = myStrdup2(filename, ".tmp");
+	if (!(fp = fopen(tmpname, "w"))) {
+		printLog(stderr, "Cannot write journal %s: %s\n", tmpname,
+			 strerror(errno));
+		free(tmpname);
+		return 1;
+	}
+	if (writeEntries(fp) || fflush(fp) || fsync(fileno(fp))) {
+		printLog(stderr, "Cannot write journal %s: %s\n", tmpname,
+			 strerror(errno));
+		fclose(fp);
+		remove(tmpname);
+		free(tmpname);
+		return 1;
+	}
+	fclose(fp);
+#if defined(WIN32)
+	remove(filename);
+#endif
+	if (rename(tmpname, filename)) {
+		printLog(stderr, "Cannot rename %s to %s: %s\n", tmpname,
+			 filename, strerror(errno));
+		free(tmpname);
+		return 1;
+	}
+	free(tmpname);
+
+	if (!(journalFp = fopen(filename, "a"))) {
+		printLog(stderr, "Cannot open journal %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+	journalName = myStrdup(filename);
+	return 0;
+}
+
+void
+journalClose(void)
+{
+	if (!journalFp)
+		return;
+	journalSync();
+	fclose(journalFp);
+	journalFp = NULL;
+	free(journalName);
+	journalName = NULL;
+}
+
+/*
+ * Force journal records written so far to disk.
+ */
+void
+journalSync(void)
+{
+	if (!journalFp || !pending)
+		return;
+	if (fsync(fileno(journalFp)))
+		printLog(stderr, "Cannot sync journal %s: %s\n", journalName,
+			 strerror(errno));
+	pending = 0;
+}
+
+/*
+ * journalRestore(): set auction state from journal.
+ *
+ * returns: 1 if the state is complete enough that the auction does not
+ *	need to be fetched from eBay now, else 0
+ */
+int
+journalRestore(auctionInfo *aip)
+{
+	journalEntry_t *ep = findEntry(aip->auction, 0);
+
+	if (!ep || !ep->infoTime)
+		return 0;
+	aip->title = auctionString(aip, aip->title, ep->title);
+	aip->currency = auctionString(aip, aip->currency, ep->currency);
+	aip->endTime = ep->endTime;
+	aip->remain = ep->endTime - time(NULL);
+	aip->price = ep->price;
+	aip->quantity = ep->quantity;
+	aip->quantityBid = ep->quantityBid;
+	aip->bids = ep->bids;
+	aip->won = ep->won;
+	aip->winning = ep->winning;
+	aip->reserve = ep->reserve;
+	if (ep->bidTime)
+		aip->bidResult = ep->bidResult;
+	log(("journalRestore(): auction %s restored\n", aip->auction));
+	/* outcome known */
+	if (ep->wonTime) {
+		aip->won = ep->wonCount;
+		return 1;
+	}
+	/* still running, will be fetched again when it is watched */
+	return ep->endTime > time(NULL);
+}
+
+/*
+ * Auction info has been fetched.
+ */
+void
+journalInfo(const auctionInfo *aip)
+{
+	char *currency, *title;
+
+	if (!journalFp)
+		return;
+	currency = cleanField(aip->currency);
+	title = cleanField(aip->title);
+	writeRecord(0, "I\t%ld\t%s\t%ld\t%.2f\t%d\t%d\t%d\t%d\t%d\t%d\t%s\t%.200s",
+		    (long)time(NULL), aip->auction, (long)aip->endTime,
+		    aip->price, aip->quantity, aip->quantityBid, aip->bids,
+		    aip->won, aip->winning, aip->reserve, currency, title);
+	free(currency);
+	free(title);
+}
+
+/*
+ * Bid has been placed.
+ */
+void
+journalBid(const auctionInfo *aip)
+{
+	if (journalFp)
+		writeRecord(1, "B\t%ld\t%s\t%d", (long)time(NULL), aip->auction,
+			    aip->bidResult);
+}
+
+/*
+ * Outcome of auction has been checked.
+ */
+void
+journalWon(const auctionInfo *aip, int won)
+{
+	if (journalFp)
+		writeRecord(1, "W\t%ld\t%s\t%d", (long)time(NULL), aip->auction,
+			    won);
+}
+
+/*
+ * Append record to journal and apply it to the state table.
+ */
+static void
+writeRecord(int sync, const char *fmt, ...)
+{
+	char line[1024];
+	va_list arglist;
+
+	va_start(arglist, fmt);
+	vsnprintf(line, sizeof(line), fmt, arglist);
+	va_end(arglist);
+
+	if (fprintf(journalFp, "%s\n", line) < 0 || fflush(journalFp))
+		printLog(stderr, "Cannot write journal %s: %s\n", journalName,
+			 strerror(errno));
+	(void)applyRecord(line);
+	++pending;
+	if (sync || pending >= JOURNAL_SYNC_RECORDS)
+		journalSync();
+}
+
+/*
+ * Apply journal record to state table.  Modifies line.
+ *
+ * returns: 0 = OK, 1 = bad record
+ */
+static int
+applyRecord(char *line)
+{
+	char *field[JOURNAL_MAXFIELDS];
+	int n = 0;
+	journalEntry_t *ep;
+	time_t t;
+
+	field[n++] = line;
+	for (; *line && n < JOURNAL_MAXFIELDS; ++line) {
+		if (*line == '\t') {
+			*line = '\0';
+			field[n++] = line + 1;
+		}
+	}
+	if (n < 4 || strlen(field[0]) != 1 || !*field[2] ||
+	    !(t = (time_t)atol(field[1])))
+		return 1;
+
+	switch (field[0][0]) {
+	case 'I':
+		if (n != JOURNAL_MAXFIELDS)
+			return 1;
+		ep = findEntry(field[2], 1);
+		ep->infoTime = t;
+		ep->endTime = (time_t)atol(field[3]);
+		ep->price = atof(field[4]);
+		ep->quantity = atoi(field[5]);
+		ep->quantityBid = atoi(field[6]);
+		ep->bids = atoi(field[7]);
+		ep->won = atoi(field[8]);
+		ep->winning = atoi(field[9]);
+		ep->reserve = atoi(field[10]);
+		free(ep->currency);
+		ep->currency = myStrdup(field[11]);
+		free(ep->title);
+		ep->title = myStrdup(field[12]);
+		break;
+	case 'B':
+		ep = findEntry(field[2], 1);
+		ep->bidTime = t;
+		ep->bidResult = atoi(field[3]);
+		break;
+	case 'W':
+		ep = findEntry(field[2], 1);
+		ep->wonTime = t;
+		ep->wonCount = atoi(field[3]);
+		break;
+	default:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Write latest state of all auctions which are still of interest.
+ *
+ * returns: 0 = OK, else error
+ */
+static int
+writeEntries(FILE *fp)
+{
+	time_t old = time(NULL) - JOURNAL_KEEP;
+	int i;
+
+	for (i = 0; i < numEntries; ++i) {
+		const journalEntry_t *ep = &entries[i];
+
+		if (ep->infoTime < old && ep->bidTime < old &&
+		    ep->wonTime < old)
+			continue;
+		if (ep->infoTime &&
+		    fprintf(fp, "I\t%ld\t%s\t%ld\t%.2f\t%d\t%d\t%d\t%d\t%d\t%d\t%s\t%s\n",
+			    (long)ep->infoTime, ep->auction, (long)ep->endTime,
+			    ep->price, ep->quantity, ep->quantityBid, ep->bids,
+			    ep->won, ep->winning, ep->reserve, ep->currency,
+			    ep->title) < 0)
+			return 1;
+		if (ep->bidTime &&
+		    fprintf(fp, "B\t%ld\t%s\t%d\n", (long)ep->bidTime,
+			    ep->auction, ep->bidResult) < 0)
+			return 1;
+		if (ep->wonTime &&
+		    fprintf(fp, "W\t%ld\t%s\t%d\n", (long)ep->wonTime,
+			    ep->auction, ep->wonCount) < 0)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * returns: state table entry of auction, NULL if not found and not created
+ */
+static journalEntry_t *
+findEntry(const char *auction, int create)
+{
+	journalEntry_t *ep;
+	int i;
+
+	for (i = 0; i < numEntries; ++i) {
+		if (!strcmp(entries[i].auction, auction))
+			return &entries[i];
+	}
+	if (!create)
+		return NULL;
+	entries = (journalEntry_t *)myRealloc(entries,
+			(size_t)(numEntries + 1) * sizeof(journalEntry_t));
+	ep = &entries[numEntries++];
+	memset(ep, 0, sizeof(journalEntry_t));
+	ep->auction = myStrdup(auction);
+	ep->currency = myStrdup("");
+	ep->title = myStrdup("");
+	ep->won = -1;
+	ep->bidResult = -1;
+	return ep;
+}
+
+/*
+ * returns: malloc()'ed copy of s, with tabs and line ends replaced by
+ *	blanks
+ */
+static char *
+cleanField(const char *s)
+{
+	char *ret = myStrdup(s ? s : ""), *cp;
+
+	for (cp = ret; *cp; ++cp) {
+		if (*cp == '\t' || *cp == '\n' || *cp == '\r')
+			*cp = ' ';
+	}
+	return ret;
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Streaming scanner for JSON embedded in pages.
+ *
+ * Item state on eBay pages is in JSON inside script tags, often mixed with
+ * JavaScript.  The scanner reads the text once, keeping only the keys of
+ * the enclosing objects, and picks the scalar values whose keys end with
+ * one of the wanted paths.  Anything that is not JSON is skipped, and
+ * unquoted JavaScript keys are accepted.
+ *
+ * A path is a list of keys separated by '.', matched against the end of
+ * the key path of a value, so "price.value" matches
+ * {"item":{"price":{"value":"12.50"}}}.  Arrays are transparent.
+ * Alternatives are separated by '|', e.g. "bidCount|numBids".
+ */
+
+#include "json.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_MAX_DEPTH 64
+
+typedef struct {
+	const char *key;	/* key of current member, NULL = none/array */
+	size_t keyLen;
+	int isArray;
+} jsonLevel_t;
+
+static const char *scanString(const char *s, const char *end);
+static int pathMatch(const char *path, const jsonLevel_t *stack, int depth);
+static int keyMatch(const char *path, const char *pathEnd, const jsonLevel_t *stack, int depth);
+
+/*
+ * Scan s up to end for values of paths (NULL terminated).  values[i] is
+ * set for the first match of paths[i], unless it was set before, so a
+ * page can be scanned piece by piece.
+ *
+ * returns: number of paths with a value
+ */
+int
+jsonScan(const char *s, const char *end, const char *const *paths, jsonValue_t *values)
+{
+	jsonLevel_t stack[JSON_MAX_DEPTH];
+	int depth = 0;		/* may exceed JSON_MAX_DEPTH, deeper levels are not kept */
+	int numPaths, found = 0, i;
+
+	for (numPaths = 0; paths[numPaths]; ++numPaths) {
+		if (values[numPaths].value)
+			++found;
+	}
+	while (s < end && found < numPaths) {
+		const char *start = s, *next;
+		int isString = 0, isKey;
+
+		if (*s == '{' || *s == '[') {
+			if (depth < JSON_MAX_DEPTH) {
+				stack[depth].key = NULL;
+				stack[depth].isArray = *s == '[';
+			}
+			++depth;
+			++s;
+			continue;
+		}
+		if (*s == '}' || *s == ']') {
+			if (depth > 0)
+				--depth;
+			if (depth > 0 && depth <= JSON_MAX_DEPTH)
+				stack[depth - 1].key = NULL;
+			++s;
+			continue;
+		}
+		if (*s == '"' || *s == '\'') {
+			next = scanString(s, end);
+			++start;
+			s = next;
+			isString = 1;
+		} else if (isalnum((int)*s) || *s == '-' || *s == '_' || *s == '$') {
+			while (s < end && (isalnum((int)*s) || strchr("-+._$", *s)))
+				++s;
+			next = s;
+		} else {
+			/* punctuation of JavaScript, or ',' ':' of JSON */
+			++s;
+			continue;
+		}
+
+		/* key or value? */
+		while (s < end && isspace((int)*s))
+			++s;
+		isKey = s < end && *s == ':';
+		if (depth == 0 || depth > JSON_MAX_DEPTH)
+			continue;
+		if (isKey) {
+			stack[depth - 1].key = start;
+			stack[depth - 1].keyLen = (size_t)(next - start) - isString;
+			++s;
+			continue;
+		}
+		/* words that are not JSON values end the member */
+		if (!isString && !isdigit((int)*start) && *start != '-' &&
+		    strncmp(start, "true", 4) && strncmp(start, "false", 5) &&
+		    strncmp(start, "null", 4)) {
+			stack[depth - 1].key = NULL;
+			continue;
+		}
+		for (i = 0; i < numPaths; ++i) {
+			if (!values[i].value && pathMatch(paths[i], stack, depth)) {
+				values[i].value = start;
+				values[i].len = (size_t)(next - start) - isString;
+				values[i].isString = isString;
+				++found;
+			}
+		}
+		if (!stack[depth - 1].isArray)
+			stack[depth - 1].key = NULL;
+	}
+	return found;
+}
+
+/*
+ * Copy of a value, with escapes of strings resolved.  \uXXXX outside of
+ * ASCII becomes '?'.
+ */
+char *
+jsonString(arena_t *ap, const jsonValue_t *vp)
+{
+	char *ret = (char *)arenaAlloc(ap, vp->len + 1), *cp = ret;
+	const char *s = vp->value, *end = vp->value + vp->len;
+
+	while (s < end) {
+		if (*s != '\\' || !vp->isString || s + 1 >= end) {
+			*cp++ = *s++;
+			continue;
+		}
+		switch (*++s) {
+		case 'n': *cp++ = '\n'; break;
+		case 't': *cp++ = '\t'; break;
+		case 'r': *cp++ = '\r'; break;
+		case 'b': *cp++ = '\b'; break;
+		case 'f': *cp++ = '\f'; break;
+		case 'u':
+			if (end - s > 4) {
+				char hex[5];
+				long c;
+
+				memcpy(hex, s + 1, 4);
+				hex[4] = '\0';
+				c = strtol(hex, NULL, 16);
+				*cp++ = c > 0 && c < 128 ? (char)c : '?';
+				s += 4;
+				break;
+			}
+			/* FALLTHROUGH */
+		default:
+			*cp++ = *s;
+			break;
+		}
+		++s;
+	}
+	*cp = '\0';
+	return ret;
+}
+
+/*
+ * End of the string starting at s, after the closing quote.  A string
+ * that is not closed on the same line (apostrophe in a comment, etc)
+ * ends at the newline.
+ */
+static const char *
+scanString(const char *s, const char *end)
+{
+	char quote = *s++;
+
+	while (s < end && *s != quote && *s != '\n') {
+		if (*s == '\\' && s + 1 < end)
+			++s;
+		++s;
+	}
+	return s < end && *s == quote ? s + 1 : s;
+}
+
+/*
+ * Does one of the alternatives of path match the key path on stack?
+ */
+static int
+pathMatch(const char *path, const jsonLevel_t *stack, int depth)
+{
+	for (;;) {
+		const char *bar = strchr(path, '|');
+		const char *pathEnd = bar ? bar : path + strlen(path);
+
+		if (keyMatch(path, pathEnd, stack, depth))
+			return 1;
+		if (!bar)
+			return 0;
+		path = bar + 1;
+	}
+}
+
+static int
+keyMatch(const char *path, const char *pathEnd, const jsonLevel_t *stack, int depth)
+{
+	int level = depth - 1;
+
+	/* compare keys from the innermost one */
+	while (pathEnd > path) {
+		const char *key = pathEnd;
+		size_t len;
+
+		while (key > path && key[-1] != '.')
+			--key;
+		len = (size_t)(pathEnd - key);
+		while (level >= 0 && stack[level].isArray)
+			--level;
+		if (level < 0 || !stack[level].key || stack[level].keyLen != len ||
+		    strncmp(stack[level].key, key, len))
+			return 0;
+		--level;
+		pathEnd = key > path ? key - 1 : key;
+	}
+	return 1;
+}
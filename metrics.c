@@ -0,0 +1,647 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Metrics registry and a minimal http listener serving it in Prometheus
+ * text format (version 0.0.4).
+ *
+ * All values live in static tables indexed by the enums in metrics.h,
+ * so updating a metric is a single store on the hot path.  The text is
+ * only built when the endpoint is scraped.  The listener and the
+ * connections of scrapes are serviced by daemonSleep(), i.e. whenever
+ * esniper is waiting, through the same select() as the control socket.
+ * Requests are read as they arrive, so a slow client never holds up the
+ * wait for a bid; a scrape arriving during a request is answered when
+ * that request is done.
+ */
+
+#include "metrics.h"
+#include "esniper.h"
+#include "util.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if !defined(WIN32)
+#	include <fcntl.h>
+#	include <netdb.h>
+#	include <sys/types.h>
+#	include <sys/select.h>
+#	include <sys/socket.h>
+#	include <sys/time.h>
+#	include <sys/un.h>
+#	include <unistd.h>
+#endif
+
+#define NUM_BUCKETS 9
+/* time allowed for a client to send its request */
+#define REQUEST_TIMEOUT 2
+/* scrapes being read at the same time */
+#define MAX_SCRAPES 4
+
+typedef struct {
+	unsigned long bucket[NUM_BUCKETS];
+	unsigned long count;
+	double sum;
+} histogram_t;
+
+typedef struct {
+	const char *name;
+	const char *help;
+} metricName_t;
+
+static const metricName_t counterName[] = {
+	{"esniper_bug_reports_total", "Bug reports printed"},
+	{"esniper_parse_failures_total", "eBay pages that could not be parsed"},
+	{"esniper_bids_total", "Bids placed"},
+	{"esniper_items_won_total", "Items won"},
+	{"esniper_parse_sections_skipped_total", "Unchanged bid history page sections not parsed again"},
+	{"esniper_parse_cpu_saved_microseconds_total", "CPU time saved by skipping unchanged page sections"},
+	{"esniper_parse_bytes_saved_total", "Memory allocations saved by skipping unchanged page sections"},
+};
+
+static const metricName_t gaugeName[] = {
+	{"esniper_auctions", "Auctions not yet sniped"},
+	{"esniper_quantity", "Items still to be won"},
+};
+
+/* enum auctionErrorCode without ae_ prefix */
+static const char *auctionErrorName[] = {
+	"none",
+	"baditem",
+	"notitle",
+	"noprice",
+	"convprice",
+	"noquantity",
+	"notime",
+	"badtime",
+	"nohighbid",
+	"curlerror",
+	"bidprice",
+	"bidtokens",
+	"badpass",
+	"outbid",
+	"reservenotmet",
+	"ended",
+	"duplicate",
+	"toomany",
+	"unavailable",
+	"login",
+	"buyerblockpref",
+	"buyerblockprefdoesnotshiptolocation",
+	"buyerblockprefnolinkedpaypalaccount",
+	"highbidder",
+	"mustsignin",
+	"cannotbid",
+	"dutchsamebidquantity",
+	"captcha",
+	"cancelled",
+	"bidassistant",
+	"buyerblockprefitemcountlimitexceeded",
+	"bidgreaterthanbin_binblock",
+	"alert",
+	"buyerrequirements",
+	"manualaction",
+	/* ae_unknown must be last error */
+	"unknown",
+};
+
+/* must match enum traceEvent */
+static const char *requestName[] = {
+	"login",
+	"getInfo",
+	"preBid",
+	"bid",
+	"parse",
+	"http",
+	"sleep",
+};
+
+static const double latencyBucket[NUM_BUCKETS] = {
+	0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30
+};
+/* seconds after (positive) or before the intended bid time */
+static const double bidTimeBucket[NUM_BUCKETS] = {
+	-5, -2, -1, -0.5, 0, 0.5, 1, 2, 5
+};
+
+static unsigned long counters[mc_last];
+static double gauges[mg_last];
+static unsigned long auctionErrors[ae_unknown + 1];
+static histogram_t latency[te_last];
+static histogram_t bidTime;
+static time_t startTime = 0;
+
+static char *text = NULL;
+static size_t textSize = 0;
+static size_t textLen = 0;
+
+static void observe(histogram_t *hp, const double *bucket, double value);
+static void textPrintf(const char *fmt, ...);
+static void textHistogram(const char *name, const char *label,
+			  const histogram_t *hp, const double *bucket);
+static const char *buildText(void);
+
+void
+metricsCount(enum metricCounter counter, int n)
+{
+	counters[counter] += (unsigned long)n;
+}
+
+void
+metricsGauge(enum metricGauge gauge, double value)
+{
+	gauges[gauge] = value;
+}
+
+void
+metricsAuctionError(enum auctionErrorCode code)
+{
+	if (code < ae_none || code > ae_unknown)
+		code = ae_unknown;
+	++auctionErrors[code];
+	switch (code) {
+	case ae_notitle:
+	case ae_noprice:
+	case ae_convprice:
+	case ae_noquantity:
+	case ae_notime:
+	case ae_badtime:
+	case ae_nohighbid:
+	case ae_unknown:
+		++counters[mc_parseFailure];
+		break;
+	default:
+		break;
+	}
+}
+
+void
+metricsLatency(enum traceEvent event, double seconds)
+{
+	if (event >= 0 && event < te_last)
+		observe(&latency[event], latencyBucket, seconds);
+}
+
+void
+metricsBidTime(time_t target)
+{
+#if defined(WIN32)
+	double now = (double)time(NULL);
+#else
+	struct timeval tv;
+	double now;
+
+	gettimeofday(&tv, NULL);
+	now = (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+#endif
+	observe(&bidTime, bidTimeBucket, now - (double)target);
+}
+
+static void
+observe(histogram_t *hp, const double *bucket, double value)
+{
+	int i;
+
+	for (i = 0; i < NUM_BUCKETS; ++i) {
+		if (value <= bucket[i])
+			++hp->bucket[i];
+	}
+	++hp->count;
+	hp->sum += value;
+}
+
+static void
+textPrintf(const char *fmt, ...)
+{
+	va_list arglist;
+	int len;
+
+	for (;;) {
+		va_start(arglist, fmt);
+		len = vsnprintf(text + textLen, textSize - textLen, fmt,
+				arglist);
+		va_end(arglist);
+		if (len >= 0 && (size_t)len < textSize - textLen)
+			break;
+		textSize = textSize ? textSize * 2 : 4096;
+		text = (char *)myRealloc(text, textSize);
+	}
+	textLen += (size_t)len;
+}
+
+/*
+ * Write all samples of a histogram.  label is either empty or ends
+ * with a comma.
+ */
+static void
+textHistogram(const char *name, const char *label, const histogram_t *hp,
+	      const double *bucket)
+{
+	int i;
+
+	for (i = 0; i < NUM_BUCKETS; ++i)
+		textPrintf("%s_bucket{%sle=\"%g\"} %lu\n", name, label,
+			   bucket[i], hp->bucket[i]);
+	textPrintf("%s_bucket{%sle=\"+Inf\"} %lu\n", name, label, hp->count);
+	if (*label) {
+		char *l = myStrdup(label);
+
+		/* drop trailing comma */
+		l[strlen(l) - 1] = '\0';
+		textPrintf("%s_sum{%s} %g\n", name, l, hp->sum);
+		textPrintf("%s_count{%s} %lu\n", name, l, hp->count);
+		free(l);
+	} else {
+		textPrintf("%s_sum %g\n", name, hp->sum);
+		textPrintf("%s_count %lu\n", name, hp->count);
+	}
+}
+
+/*
+ * returns: metrics in Prometheus text format, valid until next call
+ */
+static const char *
+buildText(void)
+{
+	int i;
+	char label[64];
+
+	textLen = 0;
+	textPrintf("# HELP esniper_start_time_seconds Start time of esniper\n"
+		   "# TYPE esniper_start_time_seconds gauge\n"
+		   "esniper_start_time_seconds %ld\n", (long)startTime);
+	for (i = 0; i < mc_last; ++i)
+		textPrintf("# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+			   counterName[i].name, counterName[i].help,
+			   counterName[i].name, counterName[i].name,
+			   counters[i]);
+	for (i = 0; i < mg_last; ++i)
+		textPrintf("# HELP %s %s\n# TYPE %s gauge\n%s %g\n",
+			   gaugeName[i].name, gaugeName[i].help,
+			   gaugeName[i].name, gaugeName[i].name, gauges[i]);
+
+	textPrintf("# HELP esniper_auction_errors_total Auction errors by code\n"
+		   "# TYPE esniper_auction_errors_total counter\n");
+	for (i = ae_none + 1; i <= ae_unknown; ++i) {
+		if (auctionErrors[i])
+			textPrintf("esniper_auction_errors_total{code=\"%s\"} %lu\n",
+				   auctionErrorName[i], auctionErrors[i]);
+	}
+
+	textPrintf("# HELP esniper_request_duration_seconds Duration of requests by type\n"
+		   "# TYPE esniper_request_duration_seconds histogram\n");
+	for (i = 0; i < te_last; ++i) {
+		if (i == te_sleep)
+			continue;
+		sprintf(label, "request=\"%s\",", requestName[i]);
+		textHistogram("esniper_request_duration_seconds", label,
+			      &latency[i], latencyBucket);
+	}
+
+	textPrintf("# HELP esniper_bid_time_error_seconds Time bids were sent relative to the intended bid time\n"
+		   "# TYPE esniper_bid_time_error_seconds histogram\n");
+	textHistogram("esniper_bid_time_error_seconds", "", &bidTime,
+		      bidTimeBucket);
+	return text;
+}
+
+#if defined(WIN32)
+int
+metricsOpen(const char *addr)
+{
+	printLog(stderr, "Metrics endpoint is not supported on this platform.\n");
+	return 1;
+}
+
+void
+metricsClose(void)
+{
+}
+
+int
+metricsFd(void)
+{
+	return -1;
+}
+
+#else /* !WIN32 */
+
+typedef struct {
+	int fd;			/* 0 = free */
+	time_t accepted;
+	size_t len;
+	char req[1024];
+} scrape_t;
+
+static int listenFd = -1;
+static char *socketPath = NULL;
+static scrape_t scrapes[MAX_SCRAPES];
+
+static int openUnix(const char *path);
+static int openInet(const char *addr);
+static void acceptScrape(void);
+static void readScrape(scrape_t *sp);
+static void answerScrape(scrape_t *sp);
+static void closeScrape(scrape_t *sp);
+static void writeAll(int fd, const char *buf, size_t len);
+
+/*
+ * metricsOpen(): listen for metrics scrapes on addr.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+metricsOpen(const char *addr)
+{
+	startTime = time(NULL);
+	if (strchr(addr, '/') ? openUnix(addr) : openInet(addr))
+		return 1;
+	/* a connection reset before accept() must not block */
+	fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+	log(("metricsOpen(): listening on %s\n", addr));
+	return 0;
+}
+
+void
+metricsClose(void)
+{
+	int i;
+
+	if (listenFd < 0)
+		return;
+	for (i = 0; i < MAX_SCRAPES; ++i) {
+		if (scrapes[i].fd > 0)
+			closeScrape(&scrapes[i]);
+	}
+	close(listenFd);
+	listenFd = -1;
+	if (socketPath) {
+		unlink(socketPath);
+		free(socketPath);
+		socketPath = NULL;
+	}
+}
+
+int
+metricsFd(void)
+{
+	return listenFd;
+}
+
+/*
+ * Add listener and scrape connections to fds.  Scrapes which did not
+ * send their request in time are dropped.
+ *
+ * returns: highest fd, maxfd if none is higher
+ */
+int
+metricsSelect(fd_set *fds, int maxfd)
+{
+	time_t now = time(NULL);
+	int i;
+
+	if (listenFd < 0)
+		return maxfd;
+	FD_SET(listenFd, fds);
+	if (listenFd > maxfd)
+		maxfd = listenFd;
+	for (i = 0; i < MAX_SCRAPES; ++i) {
+		scrape_t *sp = &scrapes[i];
+
+		if (sp->fd <= 0)
+			continue;
+		if (now - sp->accepted > REQUEST_TIMEOUT) {
+			log(("metricsSelect(): scrape timed out\n"));
+			closeScrape(sp);
+			continue;
+		}
+		FD_SET(sp->fd, fds);
+		if (sp->fd > maxfd)
+			maxfd = sp->fd;
+	}
+	return maxfd;
+}
+
+static int
+openUnix(const char *path)
+{
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printLog(stderr, "Metrics socket path %s is too long\n", path);
+		return 1;
+	}
+	if ((listenFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		printLog(stderr, "Cannot create metrics socket: %s\n",
+			 strerror(errno));
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(listenFd, 5)) {
+		printLog(stderr, "Cannot listen on metrics socket %s: %s\n",
+			 path, strerror(errno));
+		close(listenFd);
+		listenFd = -1;
+		return 1;
+	}
+	socketPath = myStrdup(path);
+	return 0;
+}
+
+/*
+ * addr is [host:]port, host defaults to localhost.
+ */
+static int
+openInet(const char *addr)
+{
+	struct addrinfo hints, *res = NULL, *ai;
+	char *copy = myStrdup(addr);
+	char *port = strrchr(copy, ':');
+	const char *host = "localhost";
+	int err, on = 1;
+
+	if (port) {
+		*port++ = '\0';
+		if (*copy)
+			host = copy;
+	} else
+		port = copy;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if ((err = getaddrinfo(host, port, &hints, &res))) {
+		printLog(stderr, "Bad metrics address %s: %s\n", addr,
+			 gai_strerror(err));
+		free(copy);
+		return 1;
+	}
+	for (ai = res; ai; ai = ai->ai_next) {
+		if ((listenFd = socket(ai->ai_family, ai->ai_socktype,
+				       ai->ai_protocol)) < 0)
+			continue;
+		setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if (!bind(listenFd, ai->ai_addr, ai->ai_addrlen) &&
+		    !listen(listenFd, 5))
+			break;
+		close(listenFd);
+		listenFd = -1;
+	}
+	if (listenFd < 0)
+		printLog(stderr, "Cannot listen on metrics address %s: %s\n",
+			 addr, strerror(errno));
+	freeaddrinfo(res);
+	free(copy);
+	return listenFd < 0;
+}
+
+/*
+ * Serve the fds of metricsSelect() that select() found readable.  Each
+ * read takes what has arrived, the request is answered once complete.
+ */
+void
+metricsProcess(const fd_set *fds)
+{
+	int i;
+
+	if (listenFd < 0)
+		return;
+	for (i = 0; i < MAX_SCRAPES; ++i) {
+		if (scrapes[i].fd > 0 && FD_ISSET(scrapes[i].fd, fds))
+			readScrape(&scrapes[i]);
+	}
+	if (FD_ISSET(listenFd, fds))
+		acceptScrape();
+}
+
+static void
+acceptScrape(void)
+{
+	int i, oldest = 0, fd = accept(listenFd, NULL, NULL);
+
+	if (fd < 0) {
+		log(("metricsProcess(): accept failed: %s\n", strerror(errno)));
+		return;
+	}
+	for (i = 0; i < MAX_SCRAPES; ++i) {
+		if (scrapes[i].fd <= 0)
+			break;
+		if (scrapes[i].accepted < scrapes[oldest].accepted)
+			oldest = i;
+	}
+	if (i == MAX_SCRAPES) {
+		/* all busy, make room */
+		closeScrape(&scrapes[oldest]);
+		i = oldest;
+	}
+	scrapes[i].fd = fd;
+	scrapes[i].accepted = time(NULL);
+	scrapes[i].len = 0;
+}
+
+static void
+readScrape(scrape_t *sp)
+{
+	ssize_t n = read(sp->fd, sp->req + sp->len, sizeof(sp->req) - 1 - sp->len);
+
+	if (n <= 0) {
+		closeScrape(sp);
+		return;
+	}
+	sp->len += (size_t)n;
+	sp->req[sp->len] = '\0';
+	/* request line and headers, or all there is room for */
+	if (strstr(sp->req, "\r\n\r\n") || strstr(sp->req, "\n\n") ||
+	    sp->len == sizeof(sp->req) - 1)
+		answerScrape(sp);
+}
+
+static void
+answerScrape(scrape_t *sp)
+{
+	char *path, *end;
+	const char *status, *body;
+	char header[256];
+
+	if (strncmp(sp->req, "GET ", 4)) {
+		status = "405 Method Not Allowed";
+		body = "method not allowed\n";
+	} else {
+		path = sp->req + 4;
+		end = path + strcspn(path, " ?\r\n");
+		*end = '\0';
+		if (!strcmp(path, "/metrics") || !strcmp(path, "/")) {
+			status = "200 OK";
+			body = buildText();
+		} else {
+			status = "404 Not Found";
+			body = "not found\n";
+		}
+	}
+	sprintf(header, "HTTP/1.0 %s\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: %lu\r\n"
+		"Connection: close\r\n\r\n",
+		status, (unsigned long)strlen(body));
+	writeAll(sp->fd, header, strlen(header));
+	writeAll(sp->fd, body, strlen(body));
+	closeScrape(sp);
+}
+
+static void
+closeScrape(scrape_t *sp)
+{
+	close(sp->fd);
+	sp->fd = 0;
+	sp->len = 0;
+}
+
+static void
+writeAll(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, buf, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			log(("metrics writeAll(): write failed: %s\n",
+			     strerror(errno)));
+			return;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+}
+
+#endif /* !WIN32 */
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#include "auctioninfo.h"
+#include "trace.h"
+#include <time.h>
+#if !defined(WIN32)
+#	include <sys/select.h>
+#endif
+
+/*
+ * Metrics registry, exported in Prometheus text format.  Request latency
+ * is collected from the trace events, so every traced phase gets a
+ * histogram whether or not a trace file is written.
+ */
+enum metricCounter {
+	mc_bugReport,
+	mc_parseFailure,
+	mc_bid,
+	mc_won,
+	mc_sectionSkipped,
+	mc_parseCpuSaved,
+	mc_parseBytesSaved,
+	/* mc_last must be last */
+	mc_last
+};
+
+enum metricGauge {
+	mg_auctions,
+	mg_quantity,
+	/* mg_last must be last */
+	mg_last
+};
+
+extern void metricsCount(enum metricCounter counter, int n);
+extern void metricsGauge(enum metricGauge gauge, double value);
+extern void metricsAuctionError(enum auctionErrorCode code);
+extern void metricsLatency(enum traceEvent event, double seconds);
+/* bid is being sent, target is the time it was scheduled for */
+extern void metricsBidTime(time_t target);
+
+/*
+ * Serve metrics over http.  addr is [host:]port, or the path of a unix
+ * domain socket; metricsFd() is -1 if it is not open.  metricsSelect()
+ * adds the listener and pending scrapes to the fds of select(), and
+ * metricsProcess() serves those found readable without blocking.
+ */
+extern int metricsOpen(const char *addr);
+extern void metricsClose(void);
+extern int metricsFd(void);
+#if !defined(WIN32)
+extern int metricsSelect(fd_set *fds, int maxfd);
+extern void metricsProcess(const fd_set *fds);
+#endif
+
+#endif /* METRICS_H_INCLUDED */
@@ -5,8 +5,10 @@
 #	 of gcc's warning options enabled
 #
 
-SRC = auction.c auctionfile.c auctioninfo.c buffer.c esniper.c \
-	history.c html.c http.c options.c util.c
+SRC = arena.c auction.c auctionfile.c auctioninfo.c bidlog.c buffer.c \
+	capture.c daemon.c esniper.c governor.c history.c html.c htmlxml.c \
+	http.c journal.c json.c metrics.c options.c reload.c resolve.c retry.c \
+	rules.c status.c trace.c util.c
 
 # System dependencies
 # HP-UX 10.20
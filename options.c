@@ -56,6 +56,11 @@ static int parseIntValue(const char *name, const char *value,
 static int parseSpecialValue(const char *name, const char *value,
 			     optionTable_t *tableptr,
 			     const char *filename, const char *line);
+static int isCommandLine(const optionTable_t *table,
+			 const optionTable_t *tableptr);
+
+/* set while rereading a changed configuration file */
+static int reloading = 0;
 
 /*
  * readConfigFile(): read configuration from file, skipping auctions
@@ -141,6 +146,38 @@ readConfigFile(const char *filename, optionTable_t *table)
 	return ret;
 } /* readConfigFile() */
 
+/*
+ * reloadConfigFile(): read configuration file again after it has been
+ *		changed.  Options given on the command line still take
+ *		precedence and are left alone.
+ *
+ * returns: see readConfigFile()
+ */
+int
+reloadConfigFile(const char *filename, optionTable_t *table)
+{
+	int ret;
+
+	reloading = 1;
+	ret = readConfigFile(filename, table);
+	reloading = 0;
+	return ret;
+}
+
+/*
+ * setStartupOnly(): mark all table entries for value as used at startup
+ *		only, e.g. files which are opened once.  They are not
+ *		changed when a configuration file is reloaded.
+ */
+void
+setStartupOnly(optionTable_t *table, const void *value)
+{
+	for (; table->value; table++) {
+		if (table->value == value)
+			table->isStartupOnly = 1;
+	}
+}
+
 /*
  * parseGetoptValue(): parse option character and value
  *
@@ -184,7 +221,18 @@ parseConfigValue(const char *name, const char *value,
 		if (tablename && !strcmp(name, tablename))
 			break;
 	}
-	if (tableptr->value) {	/* found */
+	if (tableptr->value && !filename)
+		tableptr->isCommandLine = 1;
+	if (tableptr->value && reloading && isCommandLine(table, tableptr)) {
+		log(("%s set on command line, not reloaded\n", name));
+	} else if (tableptr->value && reloading && tableptr->isStartupOnly) {
+		const char *cur = tableptr->type == OPTION_STRING ?
+				  *(char **)tableptr->value : NULL;
+
+		if (cur && strcmp(cur, nullStr(value)))
+			printLog(stderr, "%s can only be changed by restarting esniper\n", name);
+		log(("%s only used at startup, not reloaded\n", name));
+	} else if (tableptr->value) {	/* found */
 		switch (tableptr->type) {
 		case OPTION_BOOL:
 		case OPTION_BOOL_NEG:
@@ -219,6 +267,22 @@ parseConfigValue(const char *name, const char *value,
 	return ret;
 }
 
+/*
+ * isCommandLine(): check if a value has been set on the command line,
+ *		possibly through another table entry (e.g. -r and reduce).
+ *
+ * returns: 1 = set on command line, 0 = not
+ */
+static int
+isCommandLine(const optionTable_t *table, const optionTable_t *tableptr)
+{
+	for (; table->value; table++) {
+		if (table->value == tableptr->value && table->isCommandLine)
+			return 1;
+	}
+	return 0;
+}
+
 /*
  * parseBoolValue(): parse a boolean value
  *
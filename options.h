@@ -62,9 +62,13 @@ struct optionTable {
 	int (*checkfunc)(const void* valueptr, const optionTable_t* tableptr,
 			 const char* filename, const char *line);
 	int isSet;
+	int isCommandLine;	/* set on command line, keep on reload */
+	int isStartupOnly;	/* only used at startup, keep on reload */
 };
 
 extern int readConfigFile(const char *filename, optionTable_t *table);
+extern int reloadConfigFile(const char *filename, optionTable_t *table);
+extern void setStartupOnly(optionTable_t *table, const void *value);
 extern int parseGetoptValue(int option, const char *optval,
 			    optionTable_t *table);
 extern char * logOptionValues(const optionTable_t *table);
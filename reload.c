@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Hot reload of configuration and auction files.
+ *
+ * The directory containing each file is watched rather than the file
+ * itself, because most editors save by writing a new file and renaming it
+ * over the old one, which would silently end a watch on the file.
+ */
+
+#include "reload.h"
+#include "esniper.h"
+#include "util.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#	include <sys/inotify.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#	define HAVE_INOTIFY 1
+#endif
+
+#if defined(HAVE_INOTIFY)
+
+typedef struct {
+	int wd;			/* inotify watch descriptor of directory */
+	char *filename;		/* file name as given */
+	char *basename;		/* file name within directory */
+	reloadFunc_t func;
+	int changed;
+} watch_t;
+
+static int inotifyFd = -1;
+static watch_t *watches = NULL;
+static int numWatches = 0;
+
+/*
+ * reloadWatch(): call func whenever filename has been changed.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+reloadWatch(const char *filename, reloadFunc_t func)
+{
+	char *dir, *slash;
+	struct stat st;
+	int wd;
+
+	/* devices like /dev/null change all the time */
+	if (stat(filename, &st) || !S_ISREG(st.st_mode)) {
+		log(("reloadWatch(): %s is not a regular file, not watched\n",
+		     filename));
+		return 1;
+	}
+	if (inotifyFd < 0 && (inotifyFd = inotify_init()) < 0) {
+		printLog(stderr, "Cannot watch %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+	dir = myStrdup(filename);
+	if ((slash = strrchr(dir, '/'))) {
+		if (slash == dir)
+			++slash;
+		*slash = '\0';
+	} else {
+		free(dir);
+		dir = myStrdup(".");
+	}
+	wd = inotify_add_watch(inotifyFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd < 0) {
+		printLog(stderr, "Cannot watch %s: %s\n", dir, strerror(errno));
+		free(dir);
+		return 1;
+	}
+	free(dir);
+
+	watches = (watch_t *)myRealloc(watches,
+				(size_t)(numWatches + 1) * sizeof(watch_t));
+	watches[numWatches].wd = wd;
+	watches[numWatches].filename = myStrdup(filename);
+	watches[numWatches].basename = (slash = strrchr(filename, '/')) ?
+				myStrdup(slash + 1) : myStrdup(filename);
+	watches[numWatches].func = func;
+	watches[numWatches].changed = 0;
+	++numWatches;
+	log(("reloadWatch(): watching %s\n", filename));
+	return 0;
+}
+
+/*
+ * returns: file descriptor to wait on for changes, -1 if nothing is watched
+ */
+int
+reloadFd(void)
+{
+	return inotifyFd;
+}
+
+/*
+ * reloadProcess(): read pending change events and call reload functions,
+ * once per changed file.
+ *
+ * returns: number of files reloaded
+ */
+int
+reloadProcess(void)
+{
+	char buf[4096];
+	ssize_t len;
+	int i, ret = 0;
+
+	if (inotifyFd < 0)
+		return 0;
+	len = read(inotifyFd, buf, sizeof(buf));
+	if (len <= 0) {
+		if (len < 0 && errno != EINTR && errno != EAGAIN) {
+			log(("reloadProcess(): read failed: %s\n", strerror(errno)));
+		}
+		return 0;
+	}
+	for (i = 0; i < len; ) {
+		const struct inotify_event *ev =
+			(const struct inotify_event *)&buf[i];
+		int j;
+
+		for (j = 0; ev->len && j < numWatches; ++j) {
+			if (watches[j].wd == ev->wd &&
+			    !strcmp(watches[j].basename, ev->name))
+				watches[j].changed = 1;
+		}
+		i += (int)(sizeof(struct inotify_event) + ev->len);
+	}
+	/* func may add watches, so don't keep a pointer into the table */
+	for (i = 0; i < numWatches; ++i) {
+		if (watches[i].changed) {
+			watches[i].changed = 0;
+			printLog(stdout, "%s: %s changed, reloading\n",
+				 timestamp(), watches[i].filename);
+			(*watches[i].func)(watches[i].filename);
+			++ret;
+		}
+	}
+	return ret;
+}
+
+void
+reloadClose(void)
+{
+	int i;
+
+	for (i = 0; i < numWatches; ++i) {
+		free(watches[i].filename);
+		free(watches[i].basename);
+	}
+	free(watches);
+	watches = NULL;
+	numWatches = 0;
+	if (inotifyFd >= 0) {
+		close(inotifyFd);
+		inotifyFd = -1;
+	}
+}
+
+#else /* !HAVE_INOTIFY */
+
+int
+reloadWatch(const char *filename, reloadFunc_t func)
+{
+	log(("reloadWatch(): file watching not supported, ignoring %s\n",
+	     filename));
+	return 1;
+}
+
+int
+reloadFd(void)
+{
+	return -1;
+}
+
+int
+reloadProcess(void)
+{
+	return 0;
+}
+
+void
+reloadClose(void)
+{
+}
+
+#endif /* HAVE_INOTIFY */
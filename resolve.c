@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Resolver cache.
+ *
+ * resolveRefresh() is called whenever esniper goes to sleep.  Every
+ * RESOLVE_INTERVAL seconds it looks up all hosts, in a detached thread
+ * if threads are available.  Addresses that could not be refreshed are
+ * kept: an old address is better than waiting for DNS while bidding.
+ *
+ * The lookup thread never logs (the log ring has a single producer);
+ * changes are logged by the main thread when it builds the curl list.
+ */
+
+#include "resolve.h"
+#include "buffer.h"
+#include "esniper.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(WIN32)
+#	include <winsock2.h>
+#	include <ws2tcpip.h>
+#else
+#	include <sys/types.h>
+#	include <sys/socket.h>
+#	include <netdb.h>
+#	include <netinet/in.h>
+#	include <arpa/inet.h>
+#endif
+#if defined(HAVE_LIBPTHREAD) && defined(__GNUC__)
+#	include <pthread.h>
+#	define RESOLVE_ASYNC 1
+#endif
+
+/* seconds between lookups */
+#define RESOLVE_INTERVAL 300
+/* seconds between retries after a failed lookup */
+#define RESOLVE_RETRY 30
+
+typedef struct {
+	char *host;
+	char *port;	/* NULL: http and https */
+	char *addrs;	/* comma separated, NULL = never resolved */
+	time_t resolved;	/* time of last successful lookup */
+	int failed;	/* last lookup failed */
+} resolveEntry_t;
+
+static resolveEntry_t *entries = NULL;
+static int numEntries = 0;
+static unsigned int generation = 1;	/* incremented on every change */
+static time_t lastRefresh = 0;
+static int refreshFailed = 0;
+static int running = 0;
+static struct curl_slist *curlList = NULL;
+
+#if defined(RESOLVE_ASYNC)
+static pthread_mutex_t resolveMutex = PTHREAD_MUTEX_INITIALIZER;
+#	define lock() pthread_mutex_lock(&resolveMutex)
+#	define unlock() pthread_mutex_unlock(&resolveMutex)
+#else
+#	define lock()
+#	define unlock()
+#endif
+
+static void addHost(const char *host, const char *port);
+static void addProxy(const char *proxy);
+static char *lookup(const char *host);
+static void *refresh(void *arg);
+
+/*
+ * Register host, unless it is known already.
+ */
+static void
+addHost(const char *host, const char *port)
+{
+	int i;
+
+	if (!host || !*host)
+		return;
+	for (i = 0; i < numEntries; ++i) {
+		if (!strcmp(entries[i].host, host) &&
+		    !strcmp(nullStr(entries[i].port), nullStr(port)))
+			return;
+	}
+	entries = (resolveEntry_t *)myRealloc(entries,
+			(size_t)(numEntries + 1) * sizeof(resolveEntry_t));
+	entries[numEntries].host = myStrdup(host);
+	entries[numEntries].port = port ? myStrdup(port) : NULL;
+	entries[numEntries].addrs = NULL;
+	entries[numEntries].resolved = 0;
+	entries[numEntries].failed = 0;
+	++numEntries;
+}
+
+/*
+ * Register host of proxy url [scheme://]host[:port][/].
+ */
+static void
+addProxy(const char *proxy)
+{
+	const char *s = strstr(proxy, "://");
+	char *host, *end;
+
+	host = myStrdup(s ? s + 3 : proxy);
+	if ((end = strchr(host, '/')))
+		*end = '\0';
+	if ((end = strchr(host, '@')))
+		memmove(host, end + 1, strlen(end));
+	if ((end = strrchr(host, ':'))) {
+		*end++ = '\0';
+		addHost(host, end);
+	} else
+		addHost(host, "1080");
+	free(host);
+}
+
+/*
+ * Look up all addresses of host.  Runs in the lookup thread, so no
+ * logging and no exit on allocation failure.
+ *
+ * returns: comma separated list of addresses (malloc'ed), NULL on error
+ */
+static char *
+lookup(const char *host)
+{
+	struct addrinfo hints, *res = NULL, *ai;
+	char *addrs = NULL;
+	size_t size = 0, len = 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, NULL, &hints, &res))
+		return NULL;
+	for (ai = res; ai; ai = ai->ai_next) {
+		char buf[INET6_ADDRSTRLEN + 2];
+		const void *addr;
+		size_t n;
+
+		if (ai->ai_family == AF_INET)
+			addr = &((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+		else if (ai->ai_family == AF_INET6)
+			addr = &((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr;
+		else
+			continue;
+		if (!inet_ntop(ai->ai_family, addr,
+			       buf + (ai->ai_family == AF_INET6), sizeof(buf) - 2))
+			continue;
+		if (ai->ai_family == AF_INET6) {
+			buf[0] = '[';
+			strcat(buf, "]");
+		}
+		n = strlen(buf);
+		if (len + n + 2 > size) {
+			char *tmp;
+
+			size = len + n + 64;
+			if (!(tmp = (char *)realloc(addrs, size))) {
+				free(addrs);
+				freeaddrinfo(res);
+				return NULL;
+			}
+			addrs = tmp;
+		}
+		if (len)
+			addrs[len++] = ',';
+		strcpy(addrs + len, buf);
+		len += n;
+#if LIBCURL_VERSION_NUM < 0x073b00
+		/* only one address per entry before libcurl 7.59.0 */
+		break;
+#endif
+	}
+	freeaddrinfo(res);
+	return addrs;
+}
+
+/*
+ * Look up all hosts in arg (NULL terminated array of malloc'ed names) and
+ * store the results.
+ */
+static void *
+refresh(void *arg)
+{
+	char **hosts = (char **)arg;
+	int i, j, failed = 0;
+
+	for (i = 0; hosts[i]; ++i) {
+		char *addrs = lookup(hosts[i]);
+		time_t now = time(NULL);
+
+		if (!addrs)
+			failed = 1;
+		lock();
+		for (j = 0; j < numEntries; ++j) {
+			resolveEntry_t *ep = &entries[j];
+
+			if (strcmp(ep->host, hosts[i]))
+				continue;
+			ep->failed = !addrs;
+			if (!addrs)
+				continue;
+			ep->resolved = now;
+			if (!ep->addrs || strcmp(ep->addrs, addrs)) {
+				free(ep->addrs);
+				ep->addrs = strdup(addrs);
+				++generation;
+			}
+		}
+		unlock();
+		free(addrs);
+		free(hosts[i]);
+	}
+	free(hosts);
+	lock();
+	refreshFailed = failed;
+	running = 0;
+	unlock();
+	return NULL;
+}
+
+void
+resolveRefresh(void)
+{
+	time_t now = time(NULL);
+	char **hosts;
+	int i, n = 0;
+
+	lock();
+	if (running ||
+	    now - lastRefresh < (refreshFailed ? RESOLVE_RETRY : RESOLVE_INTERVAL)) {
+		unlock();
+		return;
+	}
+	/* options may have changed since last time */
+	addHost(options.historyHost, NULL);
+	addHost(options.prebidHost, NULL);
+	addHost(options.bidHost, NULL);
+	addHost(options.loginHost, NULL);
+	addHost(options.myeBayHost, NULL);
+	if (options.proxy && *options.proxy)
+		addProxy(options.proxy);
+	hosts = (char **)myMalloc((size_t)(numEntries + 1) * sizeof(char *));
+	for (i = 0; i < numEntries; ++i) {
+		/* proxy may share a host name with an eBay host */
+		int j;
+
+		for (j = 0; j < i && strcmp(entries[j].host, entries[i].host); ++j)
+			;
+		if (j == i)
+			hosts[n++] = myStrdup(entries[i].host);
+	}
+	hosts[n] = NULL;
+	lastRefresh = now;
+	running = 1;
+	unlock();
+	log(("resolveRefresh(): looking up %d hosts\n", n));
+
+#if defined(RESOLVE_ASYNC)
+	{
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, refresh, hosts) == 0) {
+			pthread_detach(thread);
+			return;
+		}
+		log(("resolveRefresh(): cannot start thread, resolving now\n"));
+	}
+#endif
+	refresh(hosts);
+}
+
+struct curl_slist *
+resolveList(unsigned int *gen)
+{
+	struct curl_slist *list = NULL;
+	int i;
+
+	lock();
+	if (*gen == generation) {
+		unlock();
+		return NULL;
+	}
+	for (i = 0; i < numEntries; ++i) {
+		resolveEntry_t *ep = &entries[i];
+		static const char *defaultPorts[] = { "80", "443", NULL };
+		const char *onePort[2];
+		const char **port = defaultPorts;
+
+		if (!ep->addrs)
+			continue;
+		if (ep->port) {
+			onePort[0] = ep->port;
+			onePort[1] = NULL;
+			port = onePort;
+		}
+		for (; *port; ++port) {
+			char *entry = myStrdup4(ep->host, ":", *port, ":");
+			char *tmp = myStrdup2(entry, ep->addrs);
+
+			list = curl_slist_append(list, tmp);
+			free(tmp);
+			free(entry);
+		}
+		log(("resolveList(): %s is %s\n", ep->host, ep->addrs));
+	}
+	*gen = generation;
+	unlock();
+	curl_slist_free_all(curlList);
+	curlList = list;
+	return list;
+}
+
+char *
+resolveStatus(void)
+{
+	char *buf = NULL;
+	size_t bufsize = 0, count = 0;
+	time_t now = time(NULL);
+	int i;
+
+	lock();
+	for (i = 0; i < numEntries; ++i) {
+		resolveEntry_t *ep = &entries[i];
+		char line[64];
+		const char *s;
+
+		for (s = "dns: "; *s; ++s)
+			addchar(buf, bufsize, count, *s);
+		for (s = ep->host; *s; ++s)
+			addchar(buf, bufsize, count, *s);
+		if (ep->port) {
+			addchar(buf, bufsize, count, ':');
+			for (s = ep->port; *s; ++s)
+				addchar(buf, bufsize, count, *s);
+		}
+		addchar(buf, bufsize, count, ' ');
+		for (s = ep->addrs ? ep->addrs : "-"; *s; ++s)
+			addchar(buf, bufsize, count, *s);
+		if (ep->resolved)
+			sprintf(line, " age %lds%s\n", (long)(now - ep->resolved),
+				ep->failed ? " (refresh failed)" : "");
+		else
+			sprintf(line, " %s\n", running ? "(resolving)" :
+				ep->failed ? "(failed)" : "(pending)");
+		for (s = line; *s; ++s)
+			addchar(buf, bufsize, count, *s);
+	}
+	unlock();
+	term(buf, bufsize, count);
+	return buf;
+}
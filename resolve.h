@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RESOLVE_H_INCLUDED
+#define RESOLVE_H_INCLUDED
+
+#include <curl/curl.h>
+
+/*
+ * Resolver cache for the eBay hosts (and the proxy, if any).  Addresses
+ * are looked up ahead of time, in the background where threads are
+ * available, and handed to libcurl with CURLOPT_RESOLVE, so a bid never
+ * waits for DNS.  The cache outlives the curl handle.
+ */
+
+/* start a refresh if the cache is due for one */
+extern void resolveRefresh(void);
+/*
+ * returns: new CURLOPT_RESOLVE list if the cache changed since
+ * *generation (which is updated), else NULL.  The list belongs to the
+ * cache and stays valid until the next list is returned.
+ */
+extern struct curl_slist *resolveList(unsigned int *generation);
+/* returns: one line per host, caller must free */
+extern char *resolveStatus(void);
+
+#endif /* RESOLVE_H_INCLUDED */
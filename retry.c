@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Retry policy engine.
+ *
+ * The policy table lists, per request type, what to do about particular
+ * errors; RETRY_ANY entries cover all other errors.  An entry limits the
+ * number of tries with that error, and counted errors also add up
+ * toward the per request limit in requestLimit[].  The n-th retry of an
+ * error waits base * 2^(n-1) seconds, at most cap, less up to a quarter
+ * at random so that several esnipers don't retry in lockstep.
+ */
+
+#include "retry.h"
+#include "daemon.h"
+#include "esniper.h"
+#include "util.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(WIN32)
+#	include <process.h>
+#	define getpid() _getpid()
+#else
+#	include <unistd.h>
+#endif
+
+#define RETRY_ANY ((enum auctionErrorCode)-1)
+/* a retry must start this many seconds before the deadline */
+#define RETRY_MARGIN 1
+
+typedef struct {
+	enum retryRequest request;
+	enum auctionErrorCode error;
+	enum retryAction action;
+	int maxTries;		/* with this error, 0 = no limit */
+	int counts;		/* counts toward requestLimit */
+	double base;		/* first delay, seconds */
+	double cap;		/* maximum delay */
+} retryPolicy_t;
+
+static const retryPolicy_t policies[] = {
+	/* request	error		action	  tries count base  cap */
+	{ rr_getInfo,	ae_mustsignin,	ra_login,	2, 0,  0.0,    0.0 },
+	/* blank time remaining, give it another chance */
+	{ rr_getInfo,	ae_notime,	ra_retry,	3, 1,  2.0,    2.0 },
+	{ rr_getInfo,	ae_curlerror,	ra_retry,	3, 1,  1.0,    4.0 },
+	{ rr_getInfo,	RETRY_ANY,	ra_fail,	0, 0,  0.0,    0.0 },
+
+	/* typical eBay maintenance period is two hours */
+	{ rr_firstInfo,	ae_unavailable,	ra_retry,	0, 0,  3600.0, 3600.0 },
+	{ rr_firstInfo,	ae_notitle,	ra_retry,	4, 1,  1.0,    4.0 },
+	{ rr_firstInfo,	RETRY_ANY,	ra_fail,	0, 0,  0.0,    0.0 },
+
+	{ rr_watch,	ae_unavailable,	ra_retry,	0, 0,  3600.0, 3600.0 },
+	{ rr_watch,	RETRY_ANY,	ra_retry,	0, 1,  10.0,   600.0 },
+
+	{ rr_startup,	ae_unavailable,	ra_retry,	0, 0,  3600.0, 3600.0 },
+	{ rr_startup,	ae_login,	ra_fail,	0, 0,  0.0,    0.0 },
+	/* the governor holds back the retry after a captcha */
+	{ rr_startup,	ae_captcha,	ra_retry,	0, 1,  0.0,    0.0 },
+	{ rr_startup,	RETRY_ANY,	ra_retry,	0, 1,  2.0,    30.0 },
+
+	/* page loaded, but no bid key: trying again won't help */
+	{ rr_preBid,	ae_bidtokens,	ra_fail,	0, 0,  0.0,    0.0 },
+	{ rr_preBid,	ae_highbidder,	ra_fail,	0, 0,  0.0,    0.0 },
+	{ rr_preBid,	ae_mustsignin,	ra_login,	3, 1,  0.0,    0.0 },
+	{ rr_preBid,	RETRY_ANY,	ra_retry,	0, 1,  0.5,    4.0 },
+
+	{ rr_bid,	ae_mustsignin,	ra_login,	3, 0,  0.0,    0.0 },
+	{ rr_bid,	ae_curlerror,	ra_retry,	3, 1,  0.2,    1.0 },
+	{ rr_bid,	RETRY_ANY,	ra_fail,	0, 0,  0.0,    0.0 },
+};
+
+/* counted tries per request, including the first */
+static const int requestLimit[] = {
+	3,	/* getInfo */
+	4,	/* firstInfo */
+	50,	/* watch */
+	3,	/* startup */
+	5,	/* preBid */
+	3,	/* bid */
+};
+
+static const retryPolicy_t *findPolicy(enum retryRequest request,
+				       enum auctionErrorCode error);
+static time_t deadline(enum retryRequest request,
+		       const auctionInfo *aip);
+static double jitter(double delay);
+
+void
+retryInit(retry_t *rp, enum retryRequest request)
+{
+	rp->request = request;
+	rp->attempts = 1;
+	rp->errorAttempts = 0;
+	rp->lastError = ae_none;
+	rp->delay = 0.0;
+}
+
+/*
+ * returns: time by which a retry must have started, 0 = none.  That is
+ * the end of the auction for bids, and the bid instant, if it is still
+ * ahead, for everything else.
+ */
+static time_t
+deadline(enum retryRequest request, const auctionInfo *aip)
+{
+	time_t bidTime;
+
+	if (!aip->endTime)
+		return 0;
+	if (request == rr_bid)
+		return aip->endTime;
+	if (options.bidtime <= 0)
+		return 0;
+	bidTime = aip->endTime - aip->latency - options.bidtime;
+	return bidTime > time(NULL) ? bidTime : 0;
+}
+
+enum retryAction
+retryNext(retry_t *rp, const auctionInfo *aip)
+{
+	enum auctionErrorCode error = aip->auctionError;
+	const retryPolicy_t *pp = findPolicy(rp->request, error);
+	time_t until = deadline(rp->request, aip);
+	double delay;
+	int n;
+
+	if (error != rp->lastError) {
+		rp->lastError = error;
+		rp->errorAttempts = 1;
+	} else
+		++rp->errorAttempts;
+	rp->delay = 0.0;
+
+	if (pp->action == ra_fail)
+		return ra_fail;
+	if (pp->maxTries && rp->errorAttempts >= pp->maxTries)
+		return ra_fail;
+	if (pp->counts && rp->attempts++ >= requestLimit[rp->request])
+		return ra_fail;
+	if (pp->action == ra_login)
+		return ra_login;
+
+	delay = pp->base;
+	for (n = 1; n < rp->errorAttempts && delay < pp->cap; ++n)
+		delay *= 2.0;
+	if (delay > pp->cap)
+		delay = pp->cap;
+	rp->delay = jitter(delay);
+	if (until && time(NULL) + (time_t)rp->delay + RETRY_MARGIN > until) {
+		log(("retryNext(): request %d error %d: no time to retry\n",
+		     rp->request, error));
+		return ra_deadline;
+	}
+	log(("retryNext(): request %d error %d try %d: retry in %.1f seconds\n",
+	     rp->request, error, rp->errorAttempts + 1, rp->delay));
+	return ra_retry;
+}
+
+/*
+ * Wait as decided by retryNext().  Long waits service the daemon socket.
+ */
+void
+retryWait(const retry_t *rp)
+{
+	double delay = rp->delay;
+
+	if (delay >= 1.0) {
+		unsigned int seconds = (unsigned int)delay;
+
+		if (seconds >= 60)
+			printLog(stdout, "%s: Will retry, sleeping for %u minutes\n",
+				 timestamp(), seconds / 60);
+		daemonSleep(seconds);
+		delay -= seconds;
+	}
+	if (delay > 0.0) {
+#if defined(WIN32)
+		_sleep((unsigned long)(delay * 1000.0));
+#else
+		struct timespec ts;
+
+		ts.tv_sec = 0;
+		ts.tv_nsec = (long)(delay * 1e9);
+		while (nanosleep(&ts, &ts) && errno == EINTR)
+			;
+#endif
+	}
+}
+
+static const retryPolicy_t *
+findPolicy(enum retryRequest request, enum auctionErrorCode error)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(policies) / sizeof(policies[0]); ++i) {
+		if (policies[i].request == request &&
+		    (policies[i].error == error ||
+		     policies[i].error == RETRY_ANY))
+			return &policies[i];
+	}
+	/* not reached, every request has a RETRY_ANY entry */
+	return &policies[0];
+}
+
+/*
+ * returns: delay reduced by up to a quarter
+ */
+static double
+jitter(double delay)
+{
+	static int seeded = 0;
+
+	if (!seeded) {
+		srand((unsigned int)time(NULL) ^ (unsigned int)getpid());
+		seeded = 1;
+	}
+	return delay * (1.0 - 0.25 * rand() / (RAND_MAX + 1.0));
+}
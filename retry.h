@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RETRY_H_INCLUDED
+#define RETRY_H_INCLUDED
+
+#include "auctioninfo.h"
+#include <time.h>
+
+/*
+ * Retry policy engine.  What to do after a failed request is looked up
+ * by request type and auctionErrorCode.  Delays grow exponentially with
+ * jitter, and no retry is scheduled past the deadline of the request
+ * (the bid instant, or the end of the auction for the bid itself).
+ */
+enum retryRequest {
+	rr_getInfo,	/* single info fetch */
+	rr_firstInfo,	/* first info fetch of watch() */
+	rr_watch,	/* polls of watch() */
+	rr_startup,	/* info fetch of sortAuctions() */
+	rr_preBid,
+	rr_bid,
+	/* rr_last must be last */
+	rr_last
+};
+
+enum retryAction {
+	ra_fail,	/* give up */
+	ra_retry,	/* wait with retryWait(), then try again */
+	ra_login,	/* log in again, then try again at once */
+	ra_deadline	/* retry would be too late, go ahead without */
+};
+
+typedef struct {
+	enum retryRequest request;
+	int attempts;		/* failed attempts counting toward limit */
+	int errorAttempts;	/* failed attempts with current error */
+	enum auctionErrorCode lastError;
+	double delay;		/* before next try, seconds */
+} retry_t;
+
+extern void retryInit(retry_t *rp, enum retryRequest request);
+extern enum retryAction retryNext(retry_t *rp, const auctionInfo *aip);
+extern void retryWait(const retry_t *rp);
+
+#endif /* RETRY_H_INCLUDED */
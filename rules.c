@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Bid price rules.
+ *
+ * Each line of the rules file is a pattern followed by a price:
+ *
+ *	# comment
+ *	1234567890	25.00
+ *	*canon*ef 50mm*	80
+ *	*broken*	-
+ *
+ * A pattern of digits only is an auction number, anything else is a shell
+ * wildcard pattern (see fnmatch(3)) matched against the auction title,
+ * ignoring case.  Without fnmatch() (WIN32) only * and ? are wildcards.
+ * The first matching line gives the bid price, "-" means not to bid.
+ * Auctions without matching line are not bid on either.
+ */
+
+#include "rules.h"
+#include "esniper.h"
+#include "util.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if !defined(WIN32)
+#	include <fnmatch.h>
+#endif
+
+#define RULES_LINE 1024
+
+typedef struct {
+	char *pattern;	/* lower case, unless auction number */
+	char *price;	/* NULL = don't bid */
+	int isAuction;
+} rule_t;
+
+static rule_t *rules = NULL;
+static int numRules = 0;
+static time_t rulesMtime = 0;
+
+static char *lowerDup(const char *s);
+#if defined(WIN32)
+static int wildMatch(const char *pattern, const char *s);
+#endif
+
+/*
+ * rulesLoad(): read rules file, unless it has not changed since it was
+ * last read.
+ *
+ * returns: 0 = unchanged, 1 = (re)loaded, -1 = error
+ */
+int
+rulesLoad(const char *filename)
+{
+	char line[RULES_LINE];
+	struct stat sb;
+	FILE *fp;
+	int lineNum = 0;
+
+	if (stat(filename, &sb)) {
+		printLog(stderr, "Cannot open rules file %s: %s\n", filename,
+			 strerror(errno));
+		return -1;
+	}
+	if (rules && sb.st_mtime == rulesMtime)
+		return 0;
+	if (!(fp = fopen(filename, "r"))) {
+		printLog(stderr, "Cannot open rules file %s: %s\n", filename,
+			 strerror(errno));
+		return -1;
+	}
+	rulesFree();
+	rulesMtime = sb.st_mtime;
+	while (fgets(line, sizeof(line), fp)) {
+		char *pattern = line, *price, *end;
+		rule_t *rp;
+
+		++lineNum;
+		while (isspace((int)*pattern))
+			++pattern;
+		if (!*pattern || *pattern == '#')
+			continue;
+		/* price is the last word, pattern may contain blanks */
+		for (end = pattern + strlen(pattern);
+		     end > pattern && isspace((int)end[-1]); --end)
+			;
+		*end = '\0';
+		for (price = end; price > pattern && !isspace((int)price[-1]);
+		     --price)
+			;
+		if (price == pattern) {
+			printLog(stderr, "Rules file %s, line %d: no price\n",
+				 filename, lineNum);
+			continue;
+		}
+		for (end = price; isspace((int)end[-1]); --end)
+			;
+		*end = '\0';
+
+		rules = (rule_t *)myRealloc(rules,
+				(size_t)(numRules + 1) * sizeof(rule_t));
+		rp = &rules[numRules++];
+		rp->isAuction = strspn(pattern, "0123456789") == strlen(pattern);
+		rp->pattern = rp->isAuction ? myStrdup(pattern) : lowerDup(pattern);
+		rp->price = strcmp(price, "-") ?
+			priceFixup(myStrdup(price), NULL) : NULL;
+	}
+	fclose(fp);
+	log(("rulesLoad(): %d rules read from %s\n", numRules, filename));
+	return 1;
+}
+
+void
+rulesFree(void)
+{
+	int i;
+
+	for (i = 0; i < numRules; ++i) {
+		free(rules[i].pattern);
+		free(rules[i].price);
+	}
+	free(rules);
+	rules = NULL;
+	numRules = 0;
+}
+
+/*
+ * rulesPrice(): bid price for auction.
+ *
+ * returns: price, NULL if the auction should not be bid on
+ */
+const char *
+rulesPrice(const char *auction, const char *title)
+{
+	char *lower = lowerDup(title ? title : "");
+	const char *price = NULL;
+	int i;
+
+	for (i = 0; i < numRules; ++i) {
+		const rule_t *rp = &rules[i];
+
+		if (rp->isAuction ? !strcmp(rp->pattern, auction) :
+#if defined(WIN32)
+		    wildMatch(rp->pattern, lower)
+#else
+		    !fnmatch(rp->pattern, lower, 0)
+#endif
+		    ) {
+			price = rp->price;
+			break;
+		}
+	}
+	free(lower);
+	return price;
+}
+
+static char *
+lowerDup(const char *s)
+{
+	char *ret = myStrdup(s), *cp;
+
+	for (cp = ret; *cp; ++cp)
+		*cp = (char)tolower((int)*cp);
+	return ret;
+}
+
+#if defined(WIN32)
+/*
+ * Stand-in for fnmatch(): * matches any string, ? any character.
+ *
+ * returns: 1 if s matches pattern, 0 if not
+ */
+static int
+wildMatch(const char *pattern, const char *s)
+{
+	const char *star = NULL, *retry = NULL;
+
+	while (*s) {
+		if (*pattern == '*') {
+			/* remember where to go on if the rest fails */
+			star = ++pattern;
+			retry = s;
+		} else if (*pattern == '?' || *pattern == *s) {
+			++pattern;
+			++s;
+		} else if (star) {
+			pattern = star;
+			s = ++retry;
+		} else
+			return 0;
+	}
+	while (*pattern == '*')
+		++pattern;
+	return !*pattern;
+}
+#endif
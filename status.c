@@ -0,0 +1,673 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Status stream.
+ *
+ * Each line is a JSON object with the state of one auction, e.g.
+ *
+ *	{"time":1700000000,"auction":"123456789","title":"...",
+ *	 "price":12.50,"currency":"US","bids":3,"endTime":1700003600,
+ *	 "latency":1,"winning":0,"bidResult":-1,"won":-1,"error":0}
+ *
+ * (on a single line).  A line is only written if one of the fields
+ * changed since the last line for that auction, so a frontend following
+ * the stream reads deltas instead of rescanning the log.  "won" is the
+ * number of items won once the outcome is known, -1 before; "error" is
+ * the auctionErrorCode of the last request.
+ *
+ * If the path contains %s, each auction has its own file, with %s
+ * replaced by the auction number.  The path may be a FIFO: if nobody is
+ * reading it, or the reader falls behind, lines are dropped rather than
+ * blocking esniper.
+ *
+ * Status table.
+ *
+ * A memory mapped file with STATUS_SLOTS slots, shared by all esniper
+ * processes of a user, each slot holding pid, auction, title, price, end
+ * time, state and last error of one active auction.  A process claims a
+ * free slot (pid 0, or pid of a process that is gone) with flock() held
+ * and from then on is the only writer of that slot.  Readers take no
+ * lock: every slot is a seqlock, its sequence number is odd while the
+ * owner writes, so a reader copies the slot and retries if the sequence
+ * number was odd or changed meanwhile.  Slots are freed when esniper
+ * exits.  "esniper -L file" lists the table.
+ */
+
+#include "status.h"
+#include "esniper.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(WIN32)
+#	include <io.h>
+#	define O_NONBLOCK 0
+#	define write(fd, buf, len) _write((fd), (buf), (unsigned int)(len))
+#else
+#	include <signal.h>
+#	include <sys/file.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#if defined(__GNUC__)
+#	define memoryBarrier() __sync_synchronize()
+#else
+#	define memoryBarrier()
+#endif
+
+#define STATUS_LINE 1024
+#define STATUS_SLOTS 64
+#define STATUS_MAGIC 0x45534e54UL	/* "ESNT" */
+/* give up reading a slot that is rewritten all the time */
+#define STATUS_READ_TRIES 1000
+
+#if !defined(WIN32)
+enum statusState {
+	ss_watching,
+	ss_winning,	/* currently high bidder */
+	ss_bid,		/* bid placed, outcome not known yet */
+	ss_won,
+	ss_lost,
+	ss_error
+};
+
+static const char *stateName[] = {
+	"watching",
+	"winning",
+	"bid",
+	"won",
+	"lost",
+	"error"
+};
+
+typedef struct {
+	volatile unsigned long seq;	/* odd while owner writes */
+	long pid;			/* owner, 0 = free */
+	char auction[24];
+	char title[80];
+	double price;
+	long endTime;
+	int state;			/* enum statusState */
+	int error;			/* enum auctionErrorCode */
+} statusSlot_t;
+
+typedef struct {
+	unsigned long magic;
+	unsigned long numSlots;
+	statusSlot_t slot[STATUS_SLOTS];
+} statusTable_t;
+#endif
+
+typedef struct {
+	char *auction;
+	char *title;
+	double price;
+	int bids;
+	time_t endTime;
+	time_t latency;
+	int winning;
+	int bidResult;
+	int won;
+	int error;
+	int slot;	/* index into status table, -1 = none */
+} statusEntry_t;
+
+static char *statusPath = NULL;
+static int statusFd = -1;		/* single stream, -1 = not open */
+static statusEntry_t *entries = NULL;
+static int numEntries = 0;
+#if !defined(WIN32)
+static statusTable_t *table = NULL;
+static int tableFd = -1;
+#endif
+
+static int enabled(void);
+static statusEntry_t *findEntry(const char *auction);
+static void publish(const auctionInfo *aip, statusEntry_t *ep);
+static void writeStatus(const auctionInfo *aip, const statusEntry_t *ep);
+#if !defined(WIN32)
+static void writeSlot(statusEntry_t *ep);
+static int claimSlot(const char *auction);
+static void releaseSlot(statusEntry_t *ep);
+static int ownerAlive(long pid);
+static int readSlot(const statusSlot_t *sp, statusSlot_t *copy);
+#endif
+static int openStream(const char *path);
+static size_t jsonString(char *buf, size_t size, const char *s);
+
+/*
+ * statusOpen(): start writing the status stream.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+statusOpen(const char *path)
+{
+	statusPath = myStrdup(path);
+	if (strstr(path, "%s"))
+		return 0;
+	statusFd = openStream(path);
+	/* a FIFO without reader is fine, open it again later */
+	if (statusFd < 0 && errno != ENXIO) {
+		printLog(stderr, "Cannot open status stream %s: %s\n", path,
+			 strerror(errno));
+		free(statusPath);
+		statusPath = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+void
+statusClose(void)
+{
+	int i;
+
+#if !defined(WIN32)
+	if (table) {
+		for (i = 0; i < numEntries; ++i)
+			releaseSlot(&entries[i]);
+		munmap((void *)table, sizeof(statusTable_t));
+		table = NULL;
+		close(tableFd);
+		tableFd = -1;
+	}
+#endif
+	if (statusFd >= 0)
+		close(statusFd);
+	statusFd = -1;
+	free(statusPath);
+	statusPath = NULL;
+	for (i = 0; i < numEntries; ++i) {
+		free(entries[i].auction);
+		free(entries[i].title);
+	}
+	free(entries);
+	entries = NULL;
+	numEntries = 0;
+}
+
+/*
+ * Publish the state of the auction if it changed.
+ */
+void
+statusUpdate(const auctionInfo *aip)
+{
+	statusEntry_t *ep;
+	const char *title = aip->title ? aip->title : "";
+
+	if (!enabled())
+		return;
+	ep = findEntry(aip->auction);
+	if (ep->title && !strcmp(ep->title, title) &&
+	    ep->price == aip->price && ep->bids == aip->bids &&
+	    ep->endTime == aip->endTime && ep->latency == aip->latency &&
+	    ep->winning == aip->winning && ep->bidResult == aip->bidResult &&
+	    ep->won == aip->won && ep->error == (int)aip->auctionError)
+		return;
+	if (!ep->title || strcmp(ep->title, title)) {
+		free(ep->title);
+		ep->title = myStrdup(title);
+	}
+	ep->price = aip->price;
+	ep->bids = aip->bids;
+	ep->endTime = aip->endTime;
+	ep->latency = aip->latency;
+	ep->winning = aip->winning;
+	ep->bidResult = aip->bidResult;
+	ep->won = aip->won;
+	ep->error = (int)aip->auctionError;
+	publish(aip, ep);
+}
+
+/*
+ * Outcome of auction has been checked.  won may be an assumption, if
+ * eBay didn't tell.
+ */
+void
+statusWon(const auctionInfo *aip, int won)
+{
+	statusEntry_t *ep;
+
+	if (!enabled())
+		return;
+	statusUpdate(aip);
+	ep = findEntry(aip->auction);
+	if (ep->won == won)
+		return;
+	ep->won = won;
+	publish(aip, ep);
+}
+
+/*
+ * Auction will not be updated again, e.g. removed from the daemon's queue
+ * or outcome checked.  Its entry is freed and its status table slot is
+ * free for other auctions.
+ */
+void
+statusRemove(const auctionInfo *aip)
+{
+	int i;
+
+	for (i = 0; i < numEntries; ++i) {
+		if (!strcmp(entries[i].auction, aip->auction))
+			break;
+	}
+	if (i == numEntries)
+		return;
+#if !defined(WIN32)
+	if (table)
+		releaseSlot(&entries[i]);
+#endif
+	free(entries[i].auction);
+	free(entries[i].title);
+	--numEntries;
+	memmove(&entries[i], &entries[i + 1],
+		(size_t)(numEntries - i) * sizeof(statusEntry_t));
+}
+
+static int
+enabled(void)
+{
+#if defined(WIN32)
+	return statusPath != NULL;
+#else
+	return statusPath || table;
+#endif
+}
+
+static statusEntry_t *
+findEntry(const char *auction)
+{
+	statusEntry_t *ep;
+	int i;
+
+	for (i = 0; i < numEntries; ++i) {
+		if (!strcmp(entries[i].auction, auction))
+			return &entries[i];
+	}
+	entries = (statusEntry_t *)myRealloc(entries,
+			(numEntries + 1) * sizeof(statusEntry_t));
+	ep = &entries[numEntries++];
+	memset(ep, 0, sizeof(*ep));
+	ep->auction = myStrdup(auction);
+	ep->slot = -1;
+	return ep;
+}
+
+static void
+publish(const auctionInfo *aip, statusEntry_t *ep)
+{
+	if (statusPath)
+		writeStatus(aip, ep);
+#if !defined(WIN32)
+	if (table)
+		writeSlot(ep);
+#endif
+}
+
+static void
+writeStatus(const auctionInfo *aip, const statusEntry_t *ep)
+{
+	char line[STATUS_LINE];
+	size_t len;
+	int fd = statusFd;
+	const char *sp;
+
+	len = (size_t)snprintf(line, sizeof(line), "{\"time\":%ld,\"auction\":",
+			       (long)time(NULL));
+	len += jsonString(line + len, sizeof(line) - len, ep->auction);
+	len += (size_t)snprintf(line + len, sizeof(line) - len, ",\"title\":");
+	len += jsonString(line + len, sizeof(line) - len, ep->title);
+	len += (size_t)snprintf(line + len, sizeof(line) - len,
+		",\"price\":%.2f,\"currency\":", ep->price);
+	len += jsonString(line + len, sizeof(line) - len,
+			  aip->currency ? aip->currency : "");
+	len += (size_t)snprintf(line + len, sizeof(line) - len,
+		",\"bids\":%d,\"endTime\":%ld,\"latency\":%ld,\"winning\":%d,"
+		"\"bidResult\":%d,\"won\":%d,\"error\":%d}\n",
+		ep->bids, (long)ep->endTime, (long)ep->latency, ep->winning,
+		ep->bidResult, ep->won, ep->error);
+	if (len >= sizeof(line))
+		return;	/* cannot happen, title is truncated */
+
+	if ((sp = strstr(statusPath, "%s"))) {
+		/* not a format, the path may contain other % */
+		char *head = myStrndup(statusPath, (size_t)(sp - statusPath));
+		char *path = myStrdup3(head, aip->auction, sp + 2);
+
+		fd = openStream(path);
+		free(head);
+		free(path);
+	} else if (fd < 0)
+		fd = statusFd = openStream(statusPath);
+	if (fd < 0)
+		return;
+	/* one write, so readers never see half a line */
+	if (write(fd, line, len) < 0 && errno != EAGAIN) {
+		log(("statusUpdate(): %s\n", strerror(errno)));
+		if (fd == statusFd) {
+			/* reader of FIFO went away */
+			close(statusFd);
+			statusFd = -1;
+		}
+	}
+	if (fd != statusFd)
+		close(fd);
+}
+
+static int
+openStream(const char *path)
+{
+	return open(path, O_WRONLY | O_APPEND | O_CREAT | O_NONBLOCK, 0600);
+}
+
+/*
+ * Write s as JSON string, at most 200 bytes of it.
+ *
+ * returns: length written
+ */
+static size_t
+jsonString(char *buf, size_t size, const char *s)
+{
+	size_t len = 0;
+	int n = 0;
+
+	if (size < 3)
+		return 0;
+	buf[len++] = '"';
+	for (; *s && n < 200 && len + 8 < size; ++s, ++n) {
+		unsigned char c = (unsigned char)*s;
+
+		if (c == '"' || c == '\\') {
+			buf[len++] = '\\';
+			buf[len++] = (char)c;
+		} else if (c < 0x20)
+			len += (size_t)sprintf(buf + len, "\\u%04x", c);
+		else
+			buf[len++] = (char)c;
+	}
+	/* cut before a UTF-8 character that didn't fit completely */
+	if (((unsigned char)*s & 0xc0) == 0x80) {
+		while (len > 1 && ((unsigned char)buf[len - 1] & 0xc0) == 0x80)
+			--len;
+		if (len > 1 && (unsigned char)buf[len - 1] >= 0xc0)
+			--len;
+	}
+	buf[len++] = '"';
+	buf[len] = '\0';
+	return len;
+}
+
+#if defined(WIN32)
+int
+statusTableOpen(const char *filename)
+{
+	return 0;
+}
+
+int
+statusList(const char *filename, FILE *fp)
+{
+	printLog(stderr, "Status table is not supported on this platform\n");
+	return 1;
+}
+
+#else /* !WIN32 */
+
+/*
+ * statusTableOpen(): publish state of auctions in the status table in
+ * filename.  An empty filename turns the table off.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+statusTableOpen(const char *filename)
+{
+	struct stat sb;
+	void *p;
+
+	if (!filename || !*filename)
+		return 0;
+	if ((tableFd = open(filename, O_RDWR | O_CREAT, 0600)) < 0) {
+		printLog(stderr, "Cannot open status table %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+	while (flock(tableFd, LOCK_EX) && errno == EINTR)
+		;
+	if (fstat(tableFd, &sb) || ((size_t)sb.st_size < sizeof(statusTable_t) &&
+	    ftruncate(tableFd, (off_t)sizeof(statusTable_t)))) {
+		printLog(stderr, "Cannot set up status table %s: %s\n",
+			 filename, strerror(errno));
+		flock(tableFd, LOCK_UN);
+		close(tableFd);
+		tableFd = -1;
+		return 1;
+	}
+	p = mmap(NULL, sizeof(statusTable_t), PROT_READ | PROT_WRITE,
+		 MAP_SHARED, tableFd, 0);
+	if (p == MAP_FAILED) {
+		printLog(stderr, "Cannot map status table %s: %s\n", filename,
+			 strerror(errno));
+		flock(tableFd, LOCK_UN);
+		close(tableFd);
+		tableFd = -1;
+		return 1;
+	}
+	table = (statusTable_t *)p;
+	/* new file, or written by an incompatible version */
+	if (table->magic != STATUS_MAGIC ||
+	    table->numSlots != STATUS_SLOTS) {
+		memset(table, 0, sizeof(statusTable_t));
+		table->magic = STATUS_MAGIC;
+		table->numSlots = STATUS_SLOTS;
+	}
+	flock(tableFd, LOCK_UN);
+	log(("statusTableOpen(): publishing status in %s\n", filename));
+	return 0;
+}
+
+/*
+ * statusList(): print active auctions of the status table in filename,
+ * one per line, fields separated by tabs: pid, auction, state, price,
+ * end time, error code and title.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+statusList(const char *filename, FILE *fp)
+{
+	const statusTable_t *tp;
+	int fd, i;
+
+	if ((fd = open(filename, O_RDONLY)) < 0) {
+		printLog(stderr, "Cannot open status table %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+	tp = (const statusTable_t *)mmap(NULL, sizeof(statusTable_t),
+					 PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if ((const void *)tp == MAP_FAILED) {
+		printLog(stderr, "Cannot map status table %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+	if (tp->magic != STATUS_MAGIC || tp->numSlots != STATUS_SLOTS) {
+		printLog(stderr, "%s is not an esniper status table\n", filename);
+		munmap((void *)tp, sizeof(statusTable_t));
+		return 1;
+	}
+	for (i = 0; i < STATUS_SLOTS; ++i) {
+		statusSlot_t copy;
+		char endTime[20];
+		time_t t;
+
+		if (readSlot(&tp->slot[i], &copy) || !copy.pid ||
+		    !ownerAlive(copy.pid))
+			continue;
+		t = (time_t)copy.endTime;
+		if (!t || !strftime(endTime, sizeof(endTime),
+				    "%Y-%m-%d %H:%M:%S", localtime(&t)))
+			strcpy(endTime, "-");
+		fprintf(fp, "%ld\t%s\t%s\t%.2f\t%s\t%d\t%s\n", copy.pid,
+			copy.auction, (unsigned)copy.state <
+			sizeof(stateName) / sizeof(stateName[0]) ?
+			stateName[copy.state] : "?", copy.price, endTime,
+			copy.error, copy.title);
+	}
+	munmap((void *)tp, sizeof(statusTable_t));
+	return 0;
+}
+
+/*
+ * Copy the slot in its owner's current state.
+ *
+ * returns: 0 = OK, 1 = owner kept writing
+ */
+static int
+readSlot(const statusSlot_t *sp, statusSlot_t *copy)
+{
+	int tries;
+
+	for (tries = 0; tries < STATUS_READ_TRIES; ++tries) {
+		unsigned long seq = sp->seq;
+
+		if (seq & 1)
+			continue;
+		memoryBarrier();
+		memcpy(copy, (const void *)sp, sizeof(*copy));
+		memoryBarrier();
+		if (sp->seq == seq)
+			return 0;
+	}
+	return 1;
+}
+
+static int
+ownerAlive(long pid)
+{
+	return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+}
+
+/*
+ * Find a free slot and mark it ours.
+ *
+ * returns: slot index, -1 = table is full
+ */
+static int
+claimSlot(const char *auction)
+{
+	statusSlot_t *sp;
+	int i;
+
+	while (flock(tableFd, LOCK_EX) && errno == EINTR)
+		;
+	for (i = 0; i < STATUS_SLOTS; ++i) {
+		sp = &table->slot[i];
+		if (!sp->pid || !ownerAlive(sp->pid))
+			break;
+	}
+	if (i < STATUS_SLOTS) {
+		sp->seq |= 1;	/* may be odd if owner died writing */
+		memoryBarrier();
+		sp->pid = (long)getpid();
+		memset(sp->auction, 0, sizeof(sp->auction));
+		strncpy(sp->auction, auction, sizeof(sp->auction) - 1);
+		memoryBarrier();
+		sp->seq++;
+	} else {
+		log(("claimSlot(): status table full, auction %s not published\n", auction));
+		i = -1;
+	}
+	flock(tableFd, LOCK_UN);
+	return i;
+}
+
+static void
+releaseSlot(statusEntry_t *ep)
+{
+	statusSlot_t *sp;
+
+	if (ep->slot < 0)
+		return;
+	sp = &table->slot[ep->slot];
+	sp->seq++;
+	memoryBarrier();
+	sp->pid = 0;
+	memoryBarrier();
+	sp->seq++;
+	ep->slot = -1;
+}
+
+static void
+writeSlot(statusEntry_t *ep)
+{
+	statusSlot_t *sp;
+	char *p;
+	int state;
+
+	if (ep->slot < 0 && (ep->slot = claimSlot(ep->auction)) < 0)
+		return;
+	if (ep->won > 0)
+		state = ss_won;
+	else if (ep->won == 0)
+		state = ss_lost;
+	else if (ep->error != ae_none)
+		state = ss_error;
+	else if (ep->winning > 0)
+		state = ss_winning;
+	else if (ep->bidResult == 0)
+		state = ss_bid;
+	else
+		state = ss_watching;
+
+	sp = &table->slot[ep->slot];
+	sp->seq++;
+	memoryBarrier();
+	memset(sp->title, 0, sizeof(sp->title));
+	strncpy(sp->title, ep->title, sizeof(sp->title) - 1);
+	/* keep -L output one line per auction */
+	for (p = sp->title; *p; ++p) {
+		if ((unsigned char)*p < ' ')
+			*p = ' ';
+	}
+	sp->price = ep->price;
+	sp->endTime = (long)ep->endTime;
+	sp->state = state;
+	sp->error = ep->error;
+	memoryBarrier();
+	sp->seq++;
+}
+
+#endif /* !WIN32 */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATUS_H_INCLUDED
+#define STATUS_H_INCLUDED
+
+#include "auctioninfo.h"
+#include <stdio.h>
+
+/*
+ * Status stream for frontends: one JSON object per line, written whenever
+ * the state of an auction changes.
+ */
+extern int statusOpen(const char *path);
+extern void statusClose(void);
+extern void statusUpdate(const auctionInfo *aip);
+extern void statusWon(const auctionInfo *aip, int won);
+/* auction is done with, forget it and give up its status table slot */
+extern void statusRemove(const auctionInfo *aip);
+
+/*
+ * Status table: live state of all active auctions of all esniper
+ * processes in a shared memory mapped file.
+ */
+extern int statusTableOpen(const char *filename);
+extern int statusList(const char *filename, FILE *fp);
+
+#endif /* STATUS_H_INCLUDED */
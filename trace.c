@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Event trace.
+ *
+ * The trace file starts with an 8 byte magic string and a 32 bit byte
+ * order mark, followed by fixed size records.  A string record ('S')
+ * assigns an id to an auction number, which follows the record.  Begin
+ * ('B') and end ('E') records carry a timestamp in microseconds, the
+ * event and the id of the auction (0 = none).  Records are buffered by
+ * stdio and flushed whenever esniper goes to sleep.
+ */
+
+#include "trace.h"
+#include "esniper.h"
+#include "metrics.h"
+#include "util.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(WIN32)
+#	include <sys/timeb.h>
+#else
+#	include <sys/time.h>
+#endif
+
+#define TRACE_MAGIC "ESNTRC1\n"
+#define TRACE_BYTEORDER 0x01020304UL
+#define TRACE_MAXDEPTH 16
+
+typedef struct {
+	uint64_t usec;		/* time of event */
+	uint32_t id;		/* auction id, 0 = none */
+	uint16_t len;		/* string records: length of string */
+	uint8_t kind;		/* 'B'egin, 'E'nd or 'S'tring */
+	uint8_t event;		/* enum traceEvent */
+} traceRecord_t;
+
+static const char *traceEventName[] = {
+	"login",
+	"getInfo",
+	"preBid",
+	"bid",
+	"parse",
+	"http",
+	"sleep",
+};
+
+static FILE *traceFp = NULL;
+static char **traceIds = NULL;	/* auction of id n is traceIds[n-1] */
+static uint32_t numTraceIds = 0;
+static struct {
+	uint32_t id;
+	uint8_t event;
+	uint64_t begin;
+} traceStack[TRACE_MAXDEPTH];
+static int traceDepth = 0;
+
+static uint32_t traceId(const char *auction);
+static void traceWrite(int kind, enum traceEvent event, uint32_t id,
+		       const char *s, uint64_t usec);
+static uint64_t traceTime(void);
+
+/*
+ * traceOpen(): start recording events.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+traceOpen(const char *filename)
+{
+	uint32_t byteorder = TRACE_BYTEORDER;
+
+	if (!(traceFp = fopen(filename, "wb"))) {
+		printLog(stderr, "Cannot create trace file %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+	fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC) - 1, traceFp);
+	fwrite(&byteorder, sizeof(byteorder), 1, traceFp);
+	return 0;
+}
+
+void
+traceClose(void)
+{
+	if (!traceFp)
+		return;
+	while (traceDepth > 0)
+		traceEnd(te_last);
+	fclose(traceFp);
+	traceFp = NULL;
+}
+
+/*
+ * Begin an event.  Events are timed even if no trace file is written,
+ * their durations feed the metrics.
+ */
+void
+traceBegin(enum traceEvent event, const char *auction)
+{
+	uint32_t id = 0;
+	uint64_t now = traceTime();
+
+	if (traceFp) {
+		if (auction)
+			id = traceId(auction);
+		else if (traceDepth > 0 && traceDepth <= TRACE_MAXDEPTH)
+			id = traceStack[traceDepth - 1].id;
+	}
+	if (traceDepth < TRACE_MAXDEPTH) {
+		traceStack[traceDepth].id = id;
+		traceStack[traceDepth].event = (uint8_t)event;
+		traceStack[traceDepth].begin = now;
+	}
+	++traceDepth;
+	if (!traceFp)
+		return;
+	traceWrite('B', event, id, NULL, now);
+	/* nothing is going to happen for a while */
+	if (event == te_sleep)
+		fflush(traceFp);
+}
+
+/*
+ * End the innermost event.  event is recorded, but the converter only
+ * needs the track.
+ */
+void
+traceEnd(enum traceEvent event)
+{
+	uint32_t id = 0;
+	uint64_t now;
+
+	if (traceDepth <= 0)
+		return;
+	now = traceTime();
+	--traceDepth;
+	if (traceDepth < TRACE_MAXDEPTH) {
+		id = traceStack[traceDepth].id;
+		metricsLatency((enum traceEvent)traceStack[traceDepth].event,
+			(double)(now - traceStack[traceDepth].begin) / 1e6);
+	}
+	if (traceFp)
+		traceWrite('E', event, id, NULL, now);
+}
+
+/*
+ * returns: id of auction, writing a string record on first use
+ */
+static uint32_t
+traceId(const char *auction)
+{
+	uint32_t i;
+
+	for (i = 0; i < numTraceIds; ++i) {
+		if (!strcmp(traceIds[i], auction))
+			return i + 1;
+	}
+	traceIds = (char **)myRealloc(traceIds,
+			(numTraceIds + 1) * sizeof(char *));
+	traceIds[numTraceIds++] = myStrdup(auction);
+	traceWrite('S', te_last, numTraceIds, auction, traceTime());
+	return numTraceIds;
+}
+
+static void
+traceWrite(int kind, enum traceEvent event, uint32_t id, const char *s,
+	   uint64_t usec)
+{
+	traceRecord_t rec;
+
+	rec.usec = usec;
+	rec.id = id;
+	rec.len = s ? (uint16_t)strlen(s) : 0;
+	rec.kind = (uint8_t)kind;
+	rec.event = (uint8_t)event;
+	fwrite(&rec, sizeof(rec), 1, traceFp);
+	if (s)
+		fwrite(s, 1, rec.len, traceFp);
+}
+
+static uint64_t
+traceTime(void)
+{
+#if defined(WIN32)
+	struct timeb tb;
+
+	ftime(&tb);
+	return (uint64_t)tb.time * 1000000 + (uint64_t)tb.millitm * 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
+#endif
+}
+
+/*
+ * traceConvert(): write trace file as Chrome trace event JSON.
+ *
+ * returns: 0 = OK, else error
+ */
+int
+traceConvert(const char *filename, FILE *out)
+{
+	FILE *fp = fopen(filename, "rb");
+	char magic[sizeof(TRACE_MAGIC) - 1];
+	uint32_t byteorder;
+	traceRecord_t rec;
+	const char *sep = "\n";
+
+	if (!fp) {
+		printLog(stderr, "Cannot open trace file %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+	if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+	    memcmp(magic, TRACE_MAGIC, sizeof(magic)) ||
+	    fread(&byteorder, sizeof(byteorder), 1, fp) != 1) {
+		printLog(stderr, "%s is not an esniper trace file\n", filename);
+		fclose(fp);
+		return 1;
+	}
+	if (byteorder != TRACE_BYTEORDER) {
+		printLog(stderr, "Trace file %s was written on a machine with different byte order\n", filename);
+		fclose(fp);
+		return 1;
+	}
+
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"esniper\"}}", sep);
+	sep = ",\n";
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		if (rec.kind == 'S') {
+			char auction[65];
+			size_t len = rec.len < sizeof(auction) ? rec.len : sizeof(auction) - 1;
+
+			if (fread(auction, 1, len, fp) != len ||
+			    fseek(fp, (long)(rec.len - len), SEEK_CUR))
+				break;
+			auction[len] = '\0';
+			fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"auction %s\"}}",
+				sep, (unsigned long)rec.id, auction);
+		} else if ((rec.kind == 'B' || rec.kind == 'E') &&
+			   rec.event < te_last) {
+			fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"esniper\",\"ph\":\"%c\",\"ts\":%.0f,\"pid\":1,\"tid\":%lu}",
+				sep, traceEventName[rec.event], rec.kind,
+				(double)rec.usec, (unsigned long)rec.id);
+		} else if (rec.kind == 'E') {
+			/* closed at exit */
+			fprintf(out, "%s{\"ph\":\"E\",\"ts\":%.0f,\"pid\":1,\"tid\":%lu}",
+				sep, (double)rec.usec, (unsigned long)rec.id);
+		}
+	}
+	fprintf(out, "\n]}\n");
+	fclose(fp);
+	return 0;
+}
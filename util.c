@@ -28,6 +28,7 @@
 #include "esniper.h"
 #include "auction.h"
 #include "buffer.h"
+#include "metrics.h"
 #include <ctype.h>
 #include <curl/curl.h>
 #include <errno.h>
@@ -47,8 +48,18 @@
 #	include <termios.h>
 #	include <unistd.h>
 #endif
+#if !defined(va_copy)
+#	define va_copy(dst, src) ((dst) = (src))
+#endif
+#if defined(HAVE_LIBPTHREAD) && defined(__GNUC__)
+#	include <pthread.h>
+#	define LOG_ASYNC 1
+#endif
 
 static void vlog(const char *fmt, va_list arglist);
+static void logWrite(const char *buf, size_t len);
+static void logCharFlush(void);
+static void logDrain(void);
 static void toLowerString(char *s);
 static void seedPasswordRandom(void);
 static void cryptPassword(char *password);
@@ -85,29 +96,42 @@ myRealloc(void *buf, size_t size)
 	return ret;
 }
 
+/*
+ * Allocate from arena ap, or from the heap if ap is NULL.  Memory from an
+ * arena must not be passed to free().
+ */
+void *
+myMallocIn(arena_t *ap, size_t size)
+{
+	return ap ? arenaAlloc(ap, size) : myMalloc(size);
+}
+
 char *
 myStrdup(const char *s)
 {
-	char *ret;
-	size_t len;
+	return myStrdupIn(NULL, s);
+}
 
-	if (!s)
-		return NULL;
-	len = strlen(s);
-	ret = myMalloc(len + 1);
-	memcpy(ret, s, len);
-	ret[len] = '\0';
-	return ret;
+char *
+myStrdupIn(arena_t *ap, const char *s)
+{
+	return s ? myStrndupIn(ap, s, strlen(s)) : NULL;
 }
 
 char *
 myStrndup(const char *s, size_t len)
+{
+	return myStrndupIn(NULL, s, len);
+}
+
+char *
+myStrndupIn(arena_t *ap, const char *s, size_t len)
 {
 	char *ret;
 
 	if (!s)
 		return NULL;
-	ret = myMalloc(len + 1);
+	ret = myMallocIn(ap, len + 1);
 	memcpy(ret, s, len);
 	ret[len] = '\0';
 	return ret;
@@ -116,43 +140,229 @@ myStrndup(const char *s, size_t len)
 char *
 myStrdup2(const char *s1, const char *s2)
 {
-	char *ret = myMalloc(strlen(s1) + strlen(s2) + 1);
-
-	sprintf(ret, "%s%s", s1, s2);
-	return ret;
+	return myStrdup4In(NULL, s1, s2, "", "");
 }
 
 char *
 myStrdup3(const char *s1, const char *s2, const char *s3)
 {
-	char *ret = myMalloc(strlen(s1) + strlen(s2) + strlen(s3) + 1);
-
-	sprintf(ret, "%s%s%s", s1, s2, s3);
-	return ret;
+	return myStrdup4In(NULL, s1, s2, s3, "");
 }
 
 char *
 myStrdup4(const char *s1, const char *s2, const char *s3, const char *s4)
 {
-	char *ret = myMalloc(strlen(s1) + strlen(s2) + strlen(s3) + strlen(s4) + 1);
+	return myStrdup4In(NULL, s1, s2, s3, s4);
+}
+
+char *
+myStrdup2In(arena_t *ap, const char *s1, const char *s2)
+{
+	return myStrdup4In(ap, s1, s2, "", "");
+}
+
+char *
+myStrdup3In(arena_t *ap, const char *s1, const char *s2, const char *s3)
+{
+	return myStrdup4In(ap, s1, s2, s3, "");
+}
+
+char *
+myStrdup4In(arena_t *ap, const char *s1, const char *s2, const char *s3,
+	    const char *s4)
+{
+	size_t len1, len2, len3, len4;
+	char *ret;
+
+	len1 = strlen(s1 = nullStr(s1));
+	len2 = strlen(s2 = nullStr(s2));
+	len3 = strlen(s3 = nullStr(s3));
+	len4 = strlen(s4 = nullStr(s4));
+	ret = myMallocIn(ap, len1 + len2 + len3 + len4 + 1);
 
-	sprintf(ret, "%s%s%s%s", s1, s2, s3, s4);
+	memcpy(ret, s1, len1);
+	memcpy(ret + len1, s2, len2);
+	memcpy(ret + len1 + len2, s3, len3);
+	memcpy(ret + len1 + len2 + len3, s4, len4 + 1);
 	return ret;
 }
 
 /*
  * Debugging functions.
+ *
+ * If threads are available, log output is copied into a ring buffer and
+ * written by a background thread, so logging costs a memcpy() instead of
+ * stdio calls and an fflush() per line.  The writer flushes the log file
+ * whenever it runs out of data, and checks for new data every
+ * LOG_FLUSH_MSEC milliseconds, or at once when logDrain() wakes it.  The
+ * main thread is the only producer, so
+ * the ring needs no lock, only ordered loads and stores of head and tail.
+ * If the thread can't be started, output is written directly.
  */
 
 static FILE *logfile = NULL;
 
+/* logChar() output is collected here and handed over in one piece */
+static char logCharBuf[512];
+static size_t logCharCount = 0;
+
+#if defined(LOG_ASYNC)
+#define LOG_RING_SIZE (1024 * 1024)	/* must be a power of 2 */
+#define LOG_FLUSH_MSEC 200
+
+#define loadAcquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define storeRelease(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static char logRing[LOG_RING_SIZE];
+static size_t ringHead = 0;	/* advanced by main thread only */
+static size_t ringTail = 0;	/* advanced by writer thread only */
+static int logThreadStarted = 0;
+/* held by writer while it uses logfile, and while logfile is replaced */
+static pthread_mutex_t logFileMutex = PTHREAD_MUTEX_INITIALIZER;
+/* logDrain() wakes the writer and waits until it is idle */
+static pthread_mutex_t logWakeMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t logIdle = PTHREAD_COND_INITIALIZER;
+static int logWakeup = 0;
+
+/*
+ * Writer thread: copy ring buffer to log file.
+ */
+static void *
+logWriter(void *arg)
+{
+	int dirty = 0;
+
+	for (;;) {
+		size_t head = loadAcquire(&ringHead);
+		size_t tail = ringTail;
+
+		if (head == tail) {
+			struct timeval tv;
+			struct timespec until;
+
+			if (dirty) {
+				pthread_mutex_lock(&logFileMutex);
+				if (logfile)
+					fflush(logfile);
+				pthread_mutex_unlock(&logFileMutex);
+				dirty = 0;
+			}
+			gettimeofday(&tv, NULL);
+			tv.tv_usec += LOG_FLUSH_MSEC * 1000;
+			until.tv_sec = tv.tv_sec + tv.tv_usec / 1000000;
+			until.tv_nsec = (tv.tv_usec % 1000000) * 1000;
+			pthread_mutex_lock(&logWakeMutex);
+			pthread_cond_broadcast(&logIdle);
+			if (!logWakeup)
+				pthread_cond_timedwait(&logWake, &logWakeMutex, &until);
+			logWakeup = 0;
+			pthread_mutex_unlock(&logWakeMutex);
+			continue;
+		}
+		pthread_mutex_lock(&logFileMutex);
+		while (tail != head) {
+			size_t off = tail & (LOG_RING_SIZE - 1);
+			size_t n = head - tail;
+
+			if (n > LOG_RING_SIZE - off)
+				n = LOG_RING_SIZE - off;
+			if (logfile)
+				fwrite(&logRing[off], 1, n, logfile);
+			tail += n;
+		}
+		pthread_mutex_unlock(&logFileMutex);
+		storeRelease(&ringTail, tail);
+		dirty = 1;
+	}
+	return NULL;
+}
+#endif
+
+/*
+ * Hand log output over to writer thread, or write it if there is none.
+ */
+static void
+logWrite(const char *buf, size_t len)
+{
+#if defined(LOG_ASYNC)
+	size_t head = ringHead;
+
+	if (!logThreadStarted) {
+		fwrite(buf, 1, len, logfile);
+		fflush(logfile);
+		return;
+	}
+	while (len > 0) {
+		size_t space = LOG_RING_SIZE - (head - loadAcquire(&ringTail));
+		size_t off = head & (LOG_RING_SIZE - 1);
+		size_t n = len < space ? len : space;
+
+		if (space == 0) {
+			/* writer is behind, don't lose log output */
+			usleep(1000);
+			continue;
+		}
+		if (n > LOG_RING_SIZE - off)
+			n = LOG_RING_SIZE - off;
+		memcpy(&logRing[off], buf, n);
+		head += n;
+		buf += n;
+		len -= n;
+		storeRelease(&ringHead, head);
+	}
+#else
+	fwrite(buf, 1, len, logfile);
+	fflush(logfile);
+#endif
+}
+
+/*
+ * Pass characters collected by logChar() on.
+ */
+static void
+logCharFlush(void)
+{
+	if (logCharCount && logfile)
+		logWrite(logCharBuf, logCharCount);
+	logCharCount = 0;
+}
+
+/*
+ * Wait until all log output has been written, before the log file is
+ * closed or replaced.
+ */
+static void
+logDrain(void)
+{
+	logCharFlush();
+#if defined(LOG_ASYNC)
+	if (!logThreadStarted)
+		return;
+	pthread_mutex_lock(&logWakeMutex);
+	while (loadAcquire(&ringTail) != ringHead) {
+		logWakeup = 1;
+		pthread_cond_signal(&logWake);
+		pthread_cond_wait(&logIdle, &logWakeMutex);
+	}
+	pthread_mutex_unlock(&logWakeMutex);
+#endif
+}
+
 void
 logClose()
 {
+	logDrain();
+#if defined(LOG_ASYNC)
+	pthread_mutex_lock(&logFileMutex);
+#endif
 	if (logfile) {
 		fclose(logfile);
 		logfile = NULL;
 	}
+#if defined(LOG_ASYNC)
+	pthread_mutex_unlock(&logFileMutex);
+#endif
 }
 
 void
@@ -212,6 +422,20 @@ logOpen(const auctionInfo *aip, const char *logdir)
 		free(tmp);
 	}
 	logClose();
+#if defined(LOG_ASYNC)
+	if (!logThreadStarted) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, logWriter, NULL) == 0) {
+			pthread_detach(thread);
+			logThreadStarted = 1;
+		}
+	}
+	if (!logThreadStarted) {
+		/* non-fatal error! */
+		fprintf(stderr, "Unable to start log writer thread, writing log directly\n");
+	}
+#endif
 	if (!(logfile = fopen(logfilename, "a"))) {
 		/* non-fatal error! */
 		fprintf(stderr, "Unable to open log file %s: %s\n",
@@ -232,25 +456,49 @@ vlog(const char *fmt, va_list arglist)
 #else
 	struct timeval tv;
 #endif
-	char timebuf[80];	/* more than big enough */
+	/* date and time are formatted once per second */
+	static char timebuf[80];	/* more than big enough */
+	static time_t timebufTime = -1;
+	char buf[1024], *line = buf;
+	size_t prefix;
+	int len;
 	time_t t;
+	va_list args;
 
 	if (!logfile)
 		return;
+	logCharFlush();
 
 #if defined(WIN32)
 	ftime(&tb);
 	t = (time_t)(tb.time);
-	strftime(timebuf, sizeof(timebuf), "\n*** %Y-%m-%d %H:%M:%S", localtime(&t));
-	fprintf(logfile, "%s.%03d ", timebuf, tb.millitm);
 #else
 	gettimeofday(&tv, NULL);
 	t = (time_t)(tv.tv_sec);
-	strftime(timebuf, sizeof(timebuf), "\n*** %Y-%m-%d %H:%M:%S", localtime(&t));
-	fprintf(logfile, "%s.%06ld ", timebuf, (long)tv.tv_usec);
 #endif
-	vfprintf(logfile, fmt, arglist);
-	fflush(logfile);
+	if (t != timebufTime) {
+		strftime(timebuf, sizeof(timebuf), "\n*** %Y-%m-%d %H:%M:%S", localtime(&t));
+		timebufTime = t;
+	}
+#if defined(WIN32)
+	prefix = (size_t)sprintf(buf, "%s.%03d ", timebuf, tb.millitm);
+#else
+	prefix = (size_t)sprintf(buf, "%s.%06ld ", timebuf, (long)tv.tv_usec);
+#endif
+	va_copy(args, arglist);
+	len = vsnprintf(buf + prefix, sizeof(buf) - prefix, fmt, args);
+	va_end(args);
+	if (len < 0)
+		return;
+	if ((size_t)len >= sizeof(buf) - prefix) {
+		/* too long for stack buffer, format again */
+		line = (char *)myMalloc(prefix + (size_t)len + 1);
+		memcpy(line, buf, prefix);
+		vsnprintf(line + prefix, (size_t)len + 1, fmt, arglist);
+	}
+	logWrite(line, prefix + (size_t)len);
+	if (line != buf)
+		free(line);
 }
 
 /*
@@ -329,6 +577,7 @@ bugReport(const char *func, const char *file, int line, auctionInfo *aip, memBuf
 	const char *newVersion = checkVersion();
 	char *optionlog;
 
+	metricsCount(mc_bugReport, 1);
 	if (newVersion) {
 		printLog(stdout,
 			"esniper encountered a bug.  "
@@ -373,7 +622,6 @@ bugReport(const char *func, const char *file, int line, auctionInfo *aip, memBuf
 				 "\tpagename = \"%s\", pageid = \"%s\", srcid = \"%s\"\n",
 				 nullStr(pp->pageName), nullStr(pp->pageId),
 				 nullStr(pp->srcId));
-			freePageInfo(pp);
 		}
 	}
 	if(optiontab) {
@@ -423,9 +671,12 @@ logChar(int c)
 		return;
 
 	if (c == EOF)
-		fflush(logfile);
-	else
-		putc(c, logfile);
+		logCharFlush();
+	else {
+		if (logCharCount >= sizeof(logCharBuf))
+			logCharFlush();
+		logCharBuf[logCharCount++] = (char)c;
+	}
 }
 
 /* read from file until you see the given character. */
@@ -624,7 +875,7 @@ priceFixup(char *price, auctionInfo *aip)
 			;
 		tmp = price[start];
 		price[start] = '\0';
-		aip->currency = myStrdup(price);
+		aip->currency = auctionString(aip, NULL, price);
 		price[start] = tmp;
 	}
 	for (; start < len && !isdigit((int)price[start]) && price[start] != ',' && price[start] != '.'; ++start)
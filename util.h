@@ -27,6 +27,7 @@
 #ifndef UTIL_H_INCLUDED
 #define UTIL_H_INCLUDED
 
+#include "arena.h"
 #include "auctioninfo.h"
 #include <stdarg.h>
 #include <stdio.h>
@@ -40,6 +41,13 @@ extern char *myStrndup(const char *, size_t len);
 extern char *myStrdup2(const char *, const char *);
 extern char *myStrdup3(const char *, const char *, const char *);
 extern char *myStrdup4(const char *, const char *, const char *, const char *);
+/* ap NULL: heap */
+extern void *myMallocIn(arena_t *ap, size_t);
+extern char *myStrdupIn(arena_t *ap, const char *);
+extern char *myStrndupIn(arena_t *ap, const char *, size_t len);
+extern char *myStrdup2In(arena_t *ap, const char *, const char *);
+extern char *myStrdup3In(arena_t *ap, const char *, const char *, const char *);
+extern char *myStrdup4In(arena_t *ap, const char *, const char *, const char *, const char *);
 
 extern void logClose(void);
 extern void logOpen(const auctionInfo *aip, const char *logdir);